@@ -0,0 +1,554 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// benchmark suite
+// runs standard workloads each in it's own process on fresh heap and reports throughput, pauses and peak rss,
+// results can be written as json and compared against results of previous run, baseline that doesn't exist yet
+// is skipped so output of one run can be baseline of the next
+// usage: simplegc_bench [-w workload,...] [-s scale] [-r runs] [-a budget] [-c] [-j mark threads]
+//                       [-o output.json] [-b baseline.json] [-t threshold percent]
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "gc.h"
+
+// default number of objects allocated between collections
+#define BENCH_BUDGET 25000
+// most workloads and runs of each
+#define BENCH_WORKLOADS 8
+#define BENCH_RUNS 15
+
+static gc_object_class cls;
+
+// xorshift random numbers, every run does the same work
+static uint64_t seed;
+static uint64_t bench_random(){
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+// objects allocated since last collection and number of them collection starts at
+static uint32_t allocated;
+static uint32_t budget = BENCH_BUDGET;
+
+// allocate object of benchmark class
+static inline gc_object* bench_alloc(gc_heap* heap, uint32_t refs){
+    gc_object* obj = gc_heap_alloc(heap,refs);
+    obj->class = &cls;
+    allocated += 1;
+    return obj;
+}
+
+// collect once allocation budget is used up, workloads call it only where every live object is reachable from roots
+static inline void bench_poll(gc_heap* heap){
+    if(allocated >= budget){
+        gc_heap_collect(heap);
+        allocated = 0;
+    }
+}
+
+// reference of object
+static inline gc_object* bench_ref(gc_object* obj, uint32_t i){
+    return ((gc_object**)(obj+1))[i];
+}
+
+// allocate rooted object holding given number of references
+static gc_object* bench_root(gc_heap* heap, uint32_t refs){
+    gc_object* root = bench_alloc(heap,refs);
+    gc_heap_add_root(heap,root);
+    return root;
+}
+
+// allocation throughput, short lived objects of few sizes with every 16th one kept for a while
+static uint64_t bench_alloc_run(gc_heap* heap, uint32_t scale){
+    uint64_t count = 20000000ull*scale;
+    gc_object* ring = bench_root(heap,1024);
+    for(uint64_t i = 0; i < count; ++i){
+        gc_object* obj = bench_alloc(heap,(uint32_t)(i & 3));
+        if((i & 15) == 0)
+            gc_heap_set_ref(heap,ring,(uint32_t)((i >> 4) & 1023),obj);
+        bench_poll(heap);
+    }
+    return count;
+}
+
+// build complete binary tree of given depth bottom up
+static gc_object* bench_tree(gc_heap* heap, uint32_t depth){
+    gc_object* node = bench_alloc(heap,2);
+    if(depth > 0){
+        gc_heap_set_ref(heap,node,0,bench_tree(heap,depth-1));
+        gc_heap_set_ref(heap,node,1,bench_tree(heap,depth-1));
+    }
+    return node;
+}
+
+// count nodes of binary tree
+static uint64_t bench_tree_check(gc_object* node){
+    if(bench_ref(node,0) == null)
+        return 1;
+    return 1 + bench_tree_check(bench_ref(node,0)) + bench_tree_check(bench_ref(node,1));
+}
+
+// binary-trees, long lived tree kept while many temporary trees of growing depth are built and walked
+static uint64_t bench_trees_run(gc_heap* heap, uint32_t scale){
+    const uint32_t max_depth = 16;
+    uint64_t nodes = 0;
+    gc_object* root = bench_root(heap,1);
+    gc_heap_set_ref(heap,root,0,bench_tree(heap,max_depth));
+    for(uint32_t depth = 4; depth <= max_depth; depth += 2){
+        uint64_t iterations = ((uint64_t)scale) << (max_depth - depth + 4);
+        for(uint64_t i = 0; i < iterations; ++i){
+            nodes += bench_tree_check(bench_tree(heap,depth));
+            // temporary tree is garbage by now
+            bench_poll(heap);
+        }
+    }
+    if(bench_tree_check(bench_ref(root,0)) != (2u << max_depth) - 1)
+        fprintf(stderr,"binary-trees: long lived tree lost nodes\n");
+    return nodes;
+}
+
+// linked list churn, nodes are appended to tail and removed from head so each lives through whole list
+// and older nodes keep referencing younger ones
+static uint64_t bench_list_run(gc_heap* heap, uint32_t scale){
+    const uint32_t length = 200000;
+    uint64_t count = 10000000ull*scale;
+    gc_object* root = bench_root(heap,1);
+    gc_object* tail = bench_alloc(heap,2);
+    gc_heap_set_ref(heap,root,0,tail);
+    for(uint32_t i = 1; i < length; ++i){
+        gc_object* node = bench_alloc(heap,2);
+        gc_heap_set_ref(heap,tail,0,node);
+        tail = node;
+        bench_poll(heap);
+    }
+    for(uint64_t i = 0; i < count; ++i){
+        gc_object* node = bench_alloc(heap,2);
+        gc_heap_set_ref(heap,tail,0,node);
+        tail = node;
+        gc_heap_set_ref(heap,root,0,bench_ref(bench_ref(root,0),0));
+        bench_poll(heap);
+    }
+    return count;
+}
+
+// large long lived heap with small young set, young objects are replaced all the time
+// and every 64th one is stored into random old object, old generation is rarely traced
+// first reference of each old object is the next one so every old object stays reachable
+static uint64_t bench_old_run(gc_heap* heap, uint32_t scale){
+    uint32_t old_count = 1000000*scale;
+    uint64_t count = 10000000ull*scale;
+    gc_object** old = (gc_object**)malloc(sizeof(gc_object*)*old_count);
+    gc_object* root = bench_root(heap,old_count/64);
+    for(uint32_t i = 0; i < old_count; ++i){
+        old[i] = bench_alloc(heap,4);
+        if(i % 64 == 0)
+            gc_heap_set_ref(heap,root,i/64,old[i]);
+    }
+    for(uint32_t i = 0; i < old_count; ++i){
+        gc_heap_set_ref(heap,old[i],0,old[(i+1) % old_count]);
+        for(uint32_t j = 1; j < 4; ++j)
+            gc_heap_set_ref(heap,old[i],j,old[bench_random() % old_count]);
+    }
+    // move whole graph to oldest generation before young set starts
+    gc_config* config = gc_heap_get_config(heap);
+    uint64_t intervals[2*GC_STATS_GENS];
+    for(uint8_t i = 0; i < config->gens_count; ++i){
+        intervals[2*i] = config->gens[i].promotion_interval;
+        intervals[2*i+1] = config->gens[i].refresh_interval;
+        config->gens[i].promotion_interval = 1;
+    }
+    config->gens[config->gens_count-1].refresh_interval = 1;
+    for(uint8_t i = 0; i <= config->gens_count; ++i){
+        do{
+            gc_heap_collect(heap);
+        }while(!config->cycle_full);
+    }
+    for(uint8_t i = 0; i < config->gens_count; ++i){
+        config->gens[i].promotion_interval = intervals[2*i];
+        config->gens[i].refresh_interval = intervals[2*i+1];
+    }
+    allocated = 0;
+    gc_object* young = bench_root(heap,1024);
+    for(uint64_t i = 0; i < count; ++i){
+        gc_object* obj = bench_alloc(heap,2);
+        gc_heap_set_ref(heap,young,(uint32_t)(bench_random() & 1023),obj);
+        if((i & 63) == 0)
+            gc_heap_set_ref(heap,old[bench_random() % old_count],1 + (uint32_t)((i >> 6) % 3),obj);
+        bench_poll(heap);
+    }
+    free(old);
+    return count;
+}
+
+// wide reference arrays, large objects are filled with small ones and replaced once full
+static uint64_t bench_wide_run(gc_heap* heap, uint32_t scale){
+    const uint32_t width = 16384, arrays = 64;
+    uint64_t count = 5000000ull*scale;
+    gc_object* root = bench_root(heap,arrays);
+    for(uint32_t i = 0; i < arrays; ++i)
+        gc_heap_set_ref(heap,root,i,bench_alloc(heap,width));
+    for(uint64_t i = 0; i < count; ++i){
+        uint32_t slot = (uint32_t)(i % width);
+        gc_object* array = bench_ref(root,(uint32_t)(bench_random() % arrays));
+        if(slot == width-1){
+            // full array is dropped for new one
+            array = bench_alloc(heap,width);
+            gc_heap_set_ref(heap,root,(uint32_t)(bench_random() % arrays),array);
+        }
+        gc_heap_set_ref(heap,array,slot,bench_alloc(heap,1));
+        bench_poll(heap);
+    }
+    return count;
+}
+
+// workload, returns number of operations done
+typedef struct {
+    const char* name;
+    const char* unit; // what operation is
+    uint64_t (*run)(gc_heap* heap, uint32_t scale);
+} bench_workload;
+
+static const bench_workload workloads[] = {
+    {"alloc", "objects", &bench_alloc_run},
+    {"binary-trees", "nodes", &bench_trees_run},
+    {"list-churn", "nodes", &bench_list_run},
+    {"old-heap", "stores", &bench_old_run},
+    {"wide-arrays", "stores", &bench_wide_run}
+};
+#define BENCH_WORKLOADS_COUNT (sizeof(workloads)/sizeof(workloads[0]))
+
+// result of workload run, sent by child process running it
+typedef struct {
+    double seconds;
+    uint64_t operations;
+    double throughput; // operations per second
+    double allocation_rate; // allocated bytes per second
+    uint64_t pauses;
+    uint64_t pause_p50;
+    uint64_t pause_p99;
+    uint64_t pause_max;
+    uint64_t gc_time; // total pause time
+    uint64_t peak_rss; // peak resident set size in kilobytes
+    char stats[8192]; // heap stats json
+} bench_result;
+
+// benchmark options
+static uint32_t scale = 1;
+static bool concurrent = false;
+static uint32_t mark_threads = 0;
+
+// run workload on fresh heap
+static void bench_workload_run(const bench_workload* w, bench_result* r){
+    gc_config config;
+    gc_gen_config c[3];
+    c[0].refresh_interval = 1000000ull; // 1 millis
+    c[0].promotion_interval = 5000000ull; // 5 millis
+    c[1].refresh_interval = 10000000ull; // 10 millis
+    c[1].promotion_interval = 50000000ull; // 50 millis
+    c[2].refresh_interval = 1000000000ull; // 1 second
+    c[2].promotion_interval = 0;
+    config.gens_count = 3;
+    config.gens = c;
+    config.pause_threshold = 1000;
+    config.max_pause = 5000000ull; // 5 millis
+    gc_heap* heap = gc_heap_create(&config);
+    if(mark_threads > 1 && !gc_heap_set_mark_threads(heap,mark_threads))
+        perror("gc_heap_set_mark_threads");
+    if(concurrent){
+        gc_heap_thread_attach(heap);
+        if(!gc_heap_set_concurrent(heap,true,0))
+            perror("gc_heap_set_concurrent");
+    }
+    seed = 88172645463325252ull;
+    allocated = 0;
+
+    uint64_t start = get_nanotime();
+    r->operations = w->run(heap,scale);
+    r->seconds = ((double)(get_nanotime() - start))/1000000000;
+
+    gc_stats stats;
+    gc_heap_get_stats(heap,&stats);
+    r->throughput = r->operations/r->seconds;
+    r->allocation_rate = stats.allocated_bytes/r->seconds;
+    r->pauses = stats.pauses;
+    r->pause_p50 = stats.pause_p50;
+    r->pause_p99 = stats.pause_p99;
+    r->pause_max = stats.pause_max;
+    r->gc_time = stats.pause_time;
+    gc_stats_json(&stats,r->stats,sizeof(r->stats));
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    r->peak_rss = (uint64_t)usage.ru_maxrss;
+
+    if(concurrent){
+        gc_heap_set_concurrent(heap,false,0);
+        gc_heap_thread_detach(heap);
+    }
+    gc_heap_destroy(heap);
+}
+
+// run workload in child process so peak rss belongs to it alone
+static bool bench_workload_fork(const bench_workload* w, bench_result* r){
+    int fds[2];
+    if(pipe(fds) != 0){
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0){
+        perror("fork");
+        return false;
+    }
+    if(pid == 0){
+        close(fds[0]);
+        bench_workload_run(w,r);
+        size_t written = 0;
+        while(written < sizeof(bench_result)){
+            ssize_t n = write(fds[1],((char*)r)+written,sizeof(bench_result)-written);
+            if(n <= 0)
+                _exit(1);
+            written += (size_t)n;
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    size_t received = 0;
+    for(;;){
+        ssize_t n = read(fds[0],((char*)r)+received,sizeof(bench_result)-received);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        received += (size_t)n;
+    }
+    close(fds[0]);
+    int status;
+    waitpid(pid,&status,0);
+    if(received != sizeof(bench_result) || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        fprintf(stderr,"%s: workload failed\n",w->name);
+        return false;
+    }
+    return true;
+}
+
+// find numeric field of workload in results json written by previous run
+static bool bench_baseline_field(const char* baseline, const char* workload, const char* field, double* value){
+    char key[64];
+    snprintf(key,sizeof(key),"\"name\":\"%s\"",workload);
+    const char* p = strstr(baseline,key);
+    if(p == null)
+        return false;
+    // fields of workload end where it's heap stats start
+    const char* end = strstr(p,"\"stats\":");
+    snprintf(key,sizeof(key),"\"%s\":",field);
+    p = strstr(p,key);
+    if(p == null || (end != null && p > end))
+        return false;
+    *value = strtod(p + strlen(key),null);
+    return true;
+}
+
+// read whole file into null terminated string
+static char* bench_read_file(const char* path){
+    FILE* f = fopen(path,"rb");
+    if(f == null)
+        return null;
+    char* data = null;
+    size_t size = 0, capacity = 0, n;
+    do{
+        if(size + 4096 + 1 > capacity){
+            capacity = capacity == 0 ? 65536 : capacity*2;
+            data = (char*)realloc(data,capacity);
+        }
+        n = fread(data+size,1,4096,f);
+        size += n;
+    }while(n > 0);
+    fclose(f);
+    data[size] = '\0';
+    return data;
+}
+
+// compare metric with baseline, returns true if it got worse by more than threshold percent, negative threshold never does
+static bool bench_compare(const char* baseline, const char* workload, const char* field, double value,
+                          bool higher_better, double threshold){
+    double base;
+    if(!bench_baseline_field(baseline,workload,field,&base) || base <= 0){
+        printf("  %-16s %14.0f   (no baseline)\n",field,value);
+        return false;
+    }
+    double change = (value - base)*100/base;
+    bool regressed = threshold >= 0 && (higher_better ? change < -threshold : change > threshold);
+    printf("  %-16s %14.0f %14.0f %+8.1f%%%s\n",field,base,value,change,regressed ? "  REGRESSED" : "");
+    return regressed;
+}
+
+static void bench_usage(const char* name){
+    fprintf(stderr,"usage: %s [-w workload,...] [-s scale] [-r runs] [-a budget] [-c] [-j mark threads]\n"
+                   "       [-o output.json] [-b baseline.json] [-t threshold percent]\n"
+                   "workloads:",name);
+    for(uint32_t i = 0; i < BENCH_WORKLOADS_COUNT; ++i)
+        fprintf(stderr," %s",workloads[i].name);
+    fprintf(stderr,"\n");
+}
+
+int main(int argc, char** argv){
+    const char* selected = null;
+    const char* output = null;
+    const char* baseline_path = null;
+    uint32_t runs = 1;
+    double threshold = 10;
+    int opt;
+    while((opt = getopt(argc,argv,"w:s:r:a:cj:o:b:t:")) != -1){
+        switch(opt){
+        case 'w': selected = optarg; break;
+        case 's': scale = (uint32_t)atol(optarg); break;
+        case 'r': runs = (uint32_t)atol(optarg); break;
+        case 'a': budget = (uint32_t)atol(optarg); break;
+        case 'c': concurrent = true; break;
+        case 'j': mark_threads = (uint32_t)atol(optarg); break;
+        case 'o': output = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        default:
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc || scale == 0 || runs == 0 || runs > BENCH_RUNS || budget == 0){
+        bench_usage(argv[0]);
+        return 1;
+    }
+    char* baseline = null;
+    if(baseline_path != null && (baseline = bench_read_file(baseline_path)) == null){
+        if(errno != ENOENT){
+            perror(baseline_path);
+            return 1;
+        }
+        printf("no baseline at %s yet, results aren't compared\n",baseline_path);
+    }
+
+    cls.gc_mark_black = &gc_object_mark_black;
+    cls.gc_contains = &gc_object_contains;
+    cls.gc_finalize = null;
+
+    // pick workloads by name, all by default
+    const bench_workload* chosen[BENCH_WORKLOADS];
+    uint32_t chosen_count = 0;
+    for(uint32_t i = 0; i < BENCH_WORKLOADS_COUNT; ++i){
+        if(selected == null){
+            chosen[chosen_count++] = &workloads[i];
+            continue;
+        }
+        size_t len = strlen(workloads[i].name);
+        for(const char* p = selected; p != null; p = strchr(p,',')){
+            if(*p == ',')
+                p += 1;
+            if(strncmp(p,workloads[i].name,len) == 0 && (p[len] == ',' || p[len] == '\0')){
+                chosen[chosen_count++] = &workloads[i];
+                break;
+            }
+        }
+    }
+    if(chosen_count == 0){
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    static bench_result results[BENCH_WORKLOADS];
+    static bench_result samples[BENCH_RUNS];
+    printf("scale: %u, runs: %u, budget: %u, concurrent: %s, mark threads: %u\n",scale,runs,budget,
+           concurrent ? "yes" : "no",mark_threads);
+    printf("%-14s %10s %16s %10s %10s %10s %10s %8s %10s\n","workload","seconds","throughput","MB/s",
+           "p50 ms","p99 ms","max ms","pauses","rss MB");
+    for(uint32_t i = 0; i < chosen_count; ++i){
+        // run with median throughput is reported
+        for(uint32_t j = 0; j < runs; ++j){
+            if(!bench_workload_fork(chosen[i],&samples[j]))
+                return 1;
+        }
+        for(uint32_t j = 1; j < runs; ++j){
+            for(uint32_t k = j; k > 0 && samples[k].throughput < samples[k-1].throughput; --k){
+                bench_result t = samples[k];
+                samples[k] = samples[k-1];
+                samples[k-1] = t;
+            }
+        }
+        bench_result* r = &results[i];
+        *r = samples[runs/2];
+        printf("%-14s %10.2f %10.2fM %-5s %10.1f %10.3f %10.3f %10.3f %8lu %10.1f\n",chosen[i]->name,r->seconds,
+               r->throughput/1000000,chosen[i]->unit,r->allocation_rate/(1024*1024),((double)r->pause_p50)/1000000,
+               ((double)r->pause_p99)/1000000,((double)r->pause_max)/1000000,(unsigned long)r->pauses,
+               ((double)r->peak_rss)/1024);
+    }
+
+    if(output != null){
+        FILE* f = fopen(output,"w");
+        if(f == null){
+            perror(output);
+            return 1;
+        }
+        fprintf(f,"{\"scale\":%u,\"runs\":%u,\"budget\":%u,\"concurrent\":%s,\"mark_threads\":%u,\"workloads\":[",
+                scale,runs,budget,concurrent ? "true" : "false",mark_threads);
+        for(uint32_t i = 0; i < chosen_count; ++i){
+            bench_result* r = &results[i];
+            fprintf(f,"%s\n{\"name\":\"%s\",\"unit\":\"%s\",\"seconds\":%.6f,\"operations\":%lu,\"throughput\":%.0f,"
+                    "\"allocation_rate\":%.0f,\"pauses\":%lu,\"pause_p50\":%lu,\"pause_p99\":%lu,\"pause_max\":%lu,"
+                    "\"gc_time\":%lu,\"peak_rss\":%lu,\"stats\":%s}",i == 0 ? "" : ",",chosen[i]->name,
+                    chosen[i]->unit,r->seconds,(unsigned long)r->operations,r->throughput,r->allocation_rate,
+                    (unsigned long)r->pauses,(unsigned long)r->pause_p50,(unsigned long)r->pause_p99,
+                    (unsigned long)r->pause_max,(unsigned long)r->gc_time,(unsigned long)r->peak_rss,r->stats);
+        }
+        fprintf(f,"\n]}\n");
+        fclose(f);
+    }
+
+    // throughput shouldn't drop and pauses, gc time and memory shouldn't grow by more than threshold,
+    // longest pause is single sample and only shown
+    bool regressed = false;
+    if(baseline != null){
+        printf("\ncompared to %s, threshold %.1f%%\n",baseline_path,threshold);
+        printf("  %-16s %14s %14s %9s\n","metric","baseline","current","change");
+        for(uint32_t i = 0; i < chosen_count; ++i){
+            bench_result* r = &results[i];
+            printf("%s\n",chosen[i]->name);
+            regressed |= bench_compare(baseline,chosen[i]->name,"throughput",r->throughput,true,threshold);
+            regressed |= bench_compare(baseline,chosen[i]->name,"pause_p50",r->pause_p50,false,threshold);
+            regressed |= bench_compare(baseline,chosen[i]->name,"pause_p99",r->pause_p99,false,threshold);
+            bench_compare(baseline,chosen[i]->name,"pause_max",r->pause_max,false,-1);
+            regressed |= bench_compare(baseline,chosen[i]->name,"gc_time",r->gc_time,false,threshold);
+            regressed |= bench_compare(baseline,chosen[i]->name,"peak_rss",r->peak_rss,false,threshold);
+        }
+        free(baseline);
+    }
+    return regressed ? 2 : 0;
+}
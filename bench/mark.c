@@ -0,0 +1,118 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// mark throughput benchmark
+// builds random object graph larger than last level cache and times full cycles with and without mark prefetching
+// usage: simplegc_bench_mark [objects] [refs per object] [mark threads] [cycles]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gc.h"
+
+static gc_object_class cls;
+
+// xorshift random numbers, graph is the same on every run
+static uint64_t seed = 88172645463325252ull;
+static uint64_t bench_random(){
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+// average duration in nanoseconds of full cycles marking whole graph with given prefetch distance
+static uint64_t bench_cycles(uint32_t prefetch, uint32_t cycles){
+    gc_set_mark_prefetch(prefetch);
+    // first cycle warms caches and pool up
+    gc();
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < cycles; ++i){
+        uint64_t t = get_nanotime();
+        do{
+            gc();
+        }while(!gc_get_config()->cycle_full);
+        total += get_nanotime() - t;
+    }
+    return total/cycles;
+}
+
+int main(int argc, char** argv){
+    uint32_t objects = argc > 1 ? (uint32_t)atol(argv[1]) : 4000000;
+    uint32_t refs = argc > 2 ? (uint32_t)atol(argv[2]) : 4;
+    uint32_t threads = argc > 3 ? (uint32_t)atol(argv[3]) : 1;
+    uint32_t cycles = argc > 4 ? (uint32_t)atol(argv[4]) : 5;
+    if(objects < 2 || refs == 0 || cycles == 0){
+        fprintf(stderr,"usage: %s [objects] [refs per object] [mark threads] [cycles]\n",argv[0]);
+        return 1;
+    }
+
+    cls.gc_mark_black = &gc_object_mark_black;
+    cls.gc_contains = &gc_object_contains;
+    cls.gc_finalize = null;
+
+    // single generation refreshed by every cycle, so every cycle marks whole graph in one pause
+    gc_config config;
+    gc_gen_config c[1];
+    c[0].refresh_interval = 1;
+    c[0].promotion_interval = 0;
+    config.gens_count = 1;
+    config.gens = c;
+    config.pause_threshold = 100000;
+    config.max_pause = 60000000000ull; // 60 seconds
+    gc_init(&config);
+    if(threads > 1 && !gc_set_mark_threads(threads)){
+        perror("gc_set_mark_threads");
+        return 1;
+    }
+
+    // every object references random others, so marking visits objects in no particular memory order
+    gc_object** all = (gc_object**)malloc(sizeof(gc_object*)*objects);
+    for(uint32_t i = 0; i < objects; ++i){
+        all[i] = gc_alloc(refs);
+        all[i]->class = &cls;
+    }
+    for(uint32_t i = 0; i < objects; ++i){
+        for(uint32_t j = 0; j < refs; ++j)
+            gc_set_ref(all[i],j,all[bench_random() % objects]);
+    }
+    // root references every 64th object at random
+    uint32_t roots_count = objects/64 > 0 ? objects/64 : 1;
+    gc_object* roots = gc_alloc(roots_count);
+    roots->class = &cls;
+    for(uint32_t i = 0; i < roots_count; ++i)
+        gc_set_ref(roots,i,all[bench_random() % objects]);
+    gc_add_root(roots);
+    free(all);
+
+    printf("objects: %u, refs per object: %u, mark threads: %u, heap: %.1f MB\n",objects,refs,threads,
+           ((double)objects)*(sizeof(gc_object) + refs*sizeof(gc_object*))/(1024*1024));
+    uint64_t plain = bench_cycles(0,cycles);
+    printf("no prefetch: %.2f millis per full cycle\n",((double)plain)/1000000);
+    uint64_t prefetched = bench_cycles(8,cycles);
+    printf("prefetch distance 8: %.2f millis per full cycle\n",((double)prefetched)/1000000);
+    printf("speedup: %.2fx\n",((double)plain)/prefetched);
+
+    gc_destroy();
+    return 0;
+}
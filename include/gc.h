@@ -30,21 +30,30 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define null 0
 
 struct gc_object_class_t;
 
+// gc heap, every heap is collected independently with it's own configuration
+typedef struct gc_heap_t gc_heap;
+
 // gc object
+// pointers come first and 32 bit mark is packed with counters so header has no padding, 32 bytes on 64 bit
 typedef struct gc_object_t {
     struct gc_object_t** gc_prev;
     struct gc_object_t* gc_next;
+    struct gc_object_class_t* class;
     uint32_t gc_mark;
-    struct gc_object_class_t* class;    
-    uint16_t refs_count;
+    uint16_t refs_count; // number of references, GC_REFS_LARGE if it doesn't fit, see gc_object_refs_count
+    uint16_t gc_flags; // for internal use only
 } gc_object;
 
+// refs_count of objects with more references than fit into header, their number is kept in front of it
+#define GC_REFS_LARGE 0xFFFF
+
 // generation config
 typedef struct {
     uint64_t refresh_interval; // generation refresh interval in nanoseconds
@@ -54,12 +63,17 @@ typedef struct {
     uint64_t promotion_time; // last promotion time
     uint32_t cycle_refreshed; // last cycle refreshed objects
     uint32_t cycle_promoted; // last cycle promoted objects
+    // adaptive tenuring
+    uint8_t tenure_age; // number of refreshes object has to survive in generation before it's promoted
+    uint64_t tenure_interval; // refresh interval tenuring was enabled with, adapted one stays close to it
+    uint32_t tenure_refreshed; // objects refreshed since last adaptation
+    uint32_t tenure_died; // refreshed objects found dead since last adaptation
 } gc_gen_config;
 
 // gc config
 typedef struct {
     uint64_t max_pause; // gc max pause in nanoseconds
-    uint32_t pause_threshold; // number of objects checked after which gc pause check should occur
+    uint32_t pause_threshold; // number of objects checked after which gc pause check should occur, until time per object is measured
     uint8_t gens_count; // number of generations
     gc_gen_config* gens; // generation configs array
     // for internal use only
@@ -69,6 +83,12 @@ typedef struct {
     uint32_t cycle_threshold; // number of objects in threshold during last cycle
     uint32_t cycle_objects; // number of objects checked during last cycle
     uint32_t cycle_collected; // number of collected objects during last cycle
+    uint32_t cycle_remembered; // number of remembered objects scanned during last cycle
+    uint64_t cycle_compacted; // bytes of pool memory reclaimed by compaction finished during last cycle
+    uint64_t cycle_overshoot; // nanoseconds longest pause of last cycle went over max_pause
+    uint32_t cycle_checks; // number of pause time checks made by collecting thread during last cycle
+    uint64_t cycle_large_bytes; // bytes mapped by large object space at the end of last cycle
+    uint32_t cycle_large_objects; // number of objects in large object space at the end of last cycle
     bool     cycle_full; // last cycle full
 } gc_config;
 
@@ -76,9 +96,19 @@ typedef struct {
 typedef struct gc_object_class_t {
     void (*gc_mark_black)(gc_object* obj); // this marks  object from grey to black
     bool (*gc_contains)(gc_object* obj, gc_object* ref); // this checks if object contains reference object
-    void (*gc_finalize)(gc_object* obj); // this is called before object is deallocated
+    void (*gc_finalize)(gc_object* obj); // this is called before object is deallocated, null if not needed
+    // layout of objects allocated with gc_alloc_object, ignored for objects allocated with gc_alloc
+    uint32_t size; // number of bytes following object header, references included
+    const uint64_t* refs; // bit per pointer sized word following header, set where word holds reference, null if none do
 } gc_object_class;
 
+// word index of reference field of struct laid out right after object header, used with gc_set_ref
+#define gc_layout_index(type,field) ((uint32_t)(offsetof(type,field)/sizeof(gc_object*)))
+// bit of reference field in it's word of class refs bitmap
+#define gc_layout_bit(type,field) (((uint64_t)1) << (gc_layout_index(type,field) & 63))
+// data of object following it's header
+#define gc_object_data(obj) ((void*)((obj)+1))
+
 
 // initialize garbage collector
 void gc_init(gc_config* config);
@@ -89,8 +119,31 @@ void gc_destroy();
 // allocate gc_object
 gc_object* gc_alloc(uint32_t refs_count);
 
+// allocate gc_object of class with layout
+// class size bytes following header are zero filled and only words marked in class refs bitmap are references,
+// rest is object data, gc_set_ref takes word index of reference and objects are marked by collector itself
+// without calling class gc_mark_black, refs_count of such object is number of words following it's header
+gc_object* gc_alloc_object(gc_object_class* cls);
+
 // set object reference to another object
-void gc_set_ref(gc_object* obj, uint16_t ref_index, gc_object* ref);
+void gc_set_ref(gc_object* obj, uint32_t ref_index, gc_object* ref);
+
+// set count consecutive object references starting at start to values, null values clear them
+// write barrier runs once for whole range instead of once per reference
+void gc_set_refs(gc_object* obj, uint32_t start, uint32_t count, gc_object** values);
+
+// copy count references of src starting at src_start to dst starting at dst_start, ranges might overlap
+void gc_copy_refs(gc_object* dst, uint32_t dst_start, gc_object* src, uint32_t src_start, uint32_t count);
+
+// allocate weak object, it's references don't keep objects alive and are cleared once objects they point to are garbage
+gc_object* gc_alloc_weak(uint32_t refs_count);
+
+// allocate weak table with key value pairs, key of pair i is reference 2*i and it's value is reference 2*i+1
+// value is kept alive only while it's key is alive, both are cleared once key is garbage
+gc_object* gc_alloc_weak_table(uint32_t pairs_count);
+
+// read reference of weak object or weak table
+gc_object* gc_get_weak(gc_object* obj, uint32_t ref_index);
 
 // collect garbage
 uint64_t gc();
@@ -107,6 +160,10 @@ void gc_object_mark_black(gc_object* obj);
 // this checks if object contains reference object
 bool gc_object_contains(gc_object* obj, gc_object* ref);
 
+// number of object references, refs_count holds it too unless it's GC_REFS_LARGE
+// objects of class with layout count words following header instead
+uint32_t gc_object_refs_count(gc_object* obj);
+
 // gc object finalize
 void gc_object_finalize(gc_object* obj);
 void gc_object_finalize_debug(gc_object* obj);
@@ -115,6 +172,302 @@ void gc_object_finalize_debug(gc_object* obj);
 void gc_print();
 void gc_print_object(gc_object* obj);
 
+// heap variants of gc functions, global gc functions work on default heap
+
+// create new heap, returns null on invalid config
+gc_heap* gc_heap_create(gc_config* config);
+
+// destroy heap freeing all it's objects
+void gc_heap_destroy(gc_heap* heap);
+
+// allocate gc_object on heap
+gc_object* gc_heap_alloc(gc_heap* heap, uint32_t refs_count);
+
+// allocate gc_object of class with layout on heap
+gc_object* gc_heap_alloc_object(gc_heap* heap, gc_object_class* cls);
+
+// set object reference to another object
+void gc_heap_set_ref(gc_heap* heap, gc_object* obj, uint32_t ref_index, gc_object* ref);
+
+// set consecutive object references
+void gc_heap_set_refs(gc_heap* heap, gc_object* obj, uint32_t start, uint32_t count, gc_object** values);
+
+// copy references between objects
+void gc_heap_copy_refs(gc_heap* heap, gc_object* dst, uint32_t dst_start, gc_object* src, uint32_t src_start, uint32_t count);
+
+// allocate weak object on heap
+gc_object* gc_heap_alloc_weak(gc_heap* heap, uint32_t refs_count);
+
+// allocate weak table on heap
+gc_object* gc_heap_alloc_weak_table(gc_heap* heap, uint32_t pairs_count);
+
+// read reference of weak object or weak table
+gc_object* gc_heap_get_weak(gc_heap* heap, gc_object* obj, uint32_t ref_index);
+
+// collect heap garbage
+uint64_t gc_heap_collect(gc_heap* heap);
+
+// add heap gc root
+void gc_heap_add_root(gc_heap* heap, gc_object* obj);
+
+// remove heap gc root
+void gc_heap_remove_root(gc_heap* heap, gc_object* obj);
+
+// print inner heap memory layout
+void gc_heap_print(gc_heap* heap);
+
+// get default heap used by global gc functions
+gc_heap* gc_get_heap();
+
+// mutator threads
+// by default heap can be used by single thread only, to use heap from multiple threads
+// every thread has to attach to it before using it and detach before exiting
+// attached threads allocate from their own pool slabs, publish new objects to heap in batches
+// and park at safepoint while other thread collects garbage
+// object finalizers run with heap lock held and must not allocate from the same heap
+
+// attach current thread to heap
+void gc_thread_attach();
+void gc_heap_thread_attach(gc_heap* heap);
+
+// detach current thread from heap
+void gc_thread_detach();
+void gc_heap_thread_detach(gc_heap* heap);
+
+// safepoint, attached thread parks here while other thread collects garbage
+// allocation checks for safepoint too, threads that don't allocate should call it periodically
+void gc_safepoint();
+void gc_heap_safepoint(gc_heap* heap);
+
+// safe region, collection doesn't wait for thread inside it
+// thread must not touch heap objects until leaving it, use around blocking calls
+void gc_safe_region_enter();
+void gc_heap_safe_region_enter(gc_heap* heap);
+void gc_safe_region_leave();
+void gc_heap_safe_region_leave(gc_heap* heap);
+
+// parallel marking
+// grey objects are marked by given number of threads including collecting thread, 0 or 1 disables it
+// each thread drains it's own grey queue and steals from others when it runs out, max_pause is still honored
+// class gc_mark_black callbacks then run on gc threads concurrently and must mark through gc_object_mark_black
+// must not be called while collection is in progress, returns false and sets errno if threads can't be created
+bool gc_set_mark_threads(uint32_t count);
+bool gc_heap_set_mark_threads(gc_heap* heap, uint32_t count);
+
+// mark prefetching
+// objects of class with layout or with gc_object_mark_black as class gc_mark_black are marked by collector itself,
+// references read from them are queued while headers of objects they point to are prefetched and each is shaded
+// only after given number of references were read past it, so cache misses of many objects overlap
+// distance 0 shades every reference right away, default is 8 and at most 32 references are queued
+// must not be called while collection is in progress, returns false and sets errno if distance is too large
+bool gc_set_mark_prefetch(uint32_t distance);
+bool gc_heap_set_mark_prefetch(gc_heap* heap, uint32_t distance);
+
+// weak references
+// weak objects and weak tables are set with gc_set_ref like other objects and marked by collector itself,
+// class gc_mark_black isn't called for them, their references to garbage are cleared right before it's swept
+// weak table value is marked only once it's key is, so cache entries go away with their keys even when value
+// references key, every weak object and weak table is visited once per cycle
+// references have to be read with gc_get_weak, object read during background marking is kept alive by it
+
+// store buffer
+// black objects stored into by threads not attached to heap are only logged once into buffer, stored references
+// aren't looked at until next collection rescans logged objects, so stores between collections cost a flag check
+// attached threads log their stores anyway and background marking doesn't use buffer, disabled by default
+void gc_set_store_buffer(bool enabled);
+void gc_heap_set_store_buffer(gc_heap* heap, bool enabled);
+
+// background collection
+// dedicated collector thread marks heap while mutators keep running, they pause only briefly to start
+// marking, to finish it and while garbage is freed, every pause is kept within max_pause when possible
+// overwritten references are logged during marking and objects allocated meanwhile survive the cycle
+// every thread using heap has to be attached and reach safepoints regularly, unrooted objects held by
+// thread must be stored into heap before it's next safepoint
+// gc() then waits for the next background cycle to complete and cycle_duration holds it's longest pause
+// interval is time in nanoseconds between cycles collector starts on it's own, 0 starts them on gc() only
+// must not be called while collection is in progress, returns false and sets errno if thread can't be created
+bool gc_set_concurrent(bool enabled, uint64_t interval);
+bool gc_heap_set_concurrent(gc_heap* heap, bool enabled, uint64_t interval);
+
+// background sweeping
+// garbage found by collection is handed over to sweeper thread which runs finalizers and frees it
+// queue_depth limits number of garbage lists handed over and not yet freed, policy decides what
+// collection does when queue is full, finalizers then run on sweeper thread concurrently with mutators
+// cycle_collected counts only objects freed by collecting thread
+// must not be called while collection is in progress, returns false and sets errno if thread can't be created
+typedef enum {
+    GC_SWEEP_BLOCK, // wait for sweeper to catch up, regardless of max_pause
+    GC_SWEEP_INLINE // free garbage on collecting thread as without sweeper
+} gc_sweep_policy;
+bool gc_set_sweeper(bool enabled, uint32_t queue_depth, gc_sweep_policy policy);
+bool gc_heap_set_sweeper(gc_heap* heap, bool enabled, uint32_t queue_depth, gc_sweep_policy policy);
+
+// conservative roots
+// stacks and registers of current and attached threads are scanned for words pointing into heap objects,
+// objects found are kept alive as roots without registering them, explicit roots still work alongside
+// stacks are rescanned whenever collection continues, background collector scans them at snapshot only
+// attached threads have to be attached before it's enabled, objects might be retained by stale words
+// every stack word is looked up with gc_heap_lookup, which walks all objects without gc memory pool
+void gc_set_conservative(bool enabled);
+void gc_heap_set_conservative(gc_heap* heap, bool enabled);
+
+// old generation compaction
+// after full cycle that refreshed oldest generation it's objects are moved out of sparse pool slabs into dense
+// ones, parents first with children right after them, emptied slabs are then reused or given back to the system
+// compaction continues in later gc() calls when it doesn't fit into max_pause, tracing starts again only after
+// it's done, references to moved objects are fixed meanwhile and gc_set_ref keeps both copies in sync
+// roots are never moved, mutators must not keep other object pointers across gc() and safepoints and
+// objects must store references only in their refs array, it's skipped while stacks are scanned conservatively
+// requires gc memory pool, returns false and sets errno otherwise
+bool gc_set_compaction(bool enabled);
+bool gc_heap_set_compaction(gc_heap* heap, bool enabled);
+
+// large object space
+// objects taking at least threshold bytes get mmap region of their own instead of coming from malloc, they are
+// never moved and their memory goes back to the system as soon as they are freed, default threshold is 128KB
+// 0 disables it, objects allocated already stay where they are
+// requires gc memory pool, returns false and sets errno otherwise or if threshold fits into pool slabs
+bool gc_set_large_threshold(size_t threshold);
+bool gc_heap_set_large_threshold(gc_heap* heap, size_t threshold);
+
+// adaptive tenuring
+// generations aren't promoted whole at promotion_interval, instead every object moves to the next generation
+// when it lives through tenure_age refreshes of it's current one
+// after every full cycle refresh_interval and tenure_age of each generation are tuned by survival rate of it's
+// refreshed objects, generations where most objects survive are refreshed less often and promote sooner
+// max_growth limits net growth of oldest generation in objects per second by tenuring later, 0 is no limit
+// refresh intervals stay within 8 times of those set when it's enabled
+void gc_set_tenuring(bool adaptive, uint64_t max_growth);
+void gc_heap_set_tenuring(gc_heap* heap, bool adaptive, uint64_t max_growth);
+
+// pause scheduling
+// time each phase spends per object is measured during pauses and pause time is checked once half of the time
+// left is expected to pass, so pause ends right before max_pause instead of after fixed number of objects
+// clock pause time is measured with is shared by all heaps, coarse clock is cheaper to read but ticks only
+// every few milliseconds, time since it last ticked is then estimated, time stamp counter is calibrated against
+// monotonic clock for 10 milliseconds when selected and requires invariant one
+// must not be called while collection is in progress, returns false and sets errno if clock isn't available
+typedef enum {
+    GC_CLOCK_MONOTONIC, // clock_gettime with CLOCK_MONOTONIC, default
+    GC_CLOCK_COARSE, // clock_gettime with CLOCK_MONOTONIC_COARSE
+    GC_CLOCK_TSC // cpu time stamp counter
+} gc_clock_source;
+bool gc_set_clock(gc_clock_source source);
+
+// telemetry
+// cumulative counters are kept since heap creation and can be read by any thread at any time without locks,
+// each counter is read on it's own so ones changed by collection in progress might be slightly apart
+// phase times are wall clock time spent in each phase by collecting thread, background marking included,
+// every pause of stop the world collection and of background collector is counted into pause histogram
+// generation objects and bytes include garbage not freed yet, objects allocated by attached threads
+// are counted once they are published to heap
+#define GC_STATS_GENS 64 // most generations heap can have
+#define GC_STATS_PAUSE_BUCKETS 252 // pause histogram buckets, four per power of two nanoseconds
+typedef enum {
+    GC_STATS_TRANSPARENT, // freeing transparent objects
+    GC_STATS_PROMOTION, // promoting generations
+    GC_STATS_REFRESH, // refreshing generations
+    GC_STATS_MARK, // marking grey objects
+    GC_STATS_MARK_SILVER, // scanning remembered set for silver objects
+    GC_STATS_WHITEN, // marking silver objects left white
+    GC_STATS_WEAK, // clearing weak references to garbage
+    GC_STATS_SWEEP, // making white objects transparent
+    GC_STATS_COMPACT, // compacting oldest generation
+    GC_STATS_PHASES
+} gc_stats_phase;
+typedef struct {
+    uint64_t cycles; // number of full cycles
+    uint64_t pauses; // number of pauses
+    uint64_t pause_time; // total pause time in nanoseconds
+    uint64_t pause_p50; // median pause in nanoseconds, upper bound of it's histogram bucket
+    uint64_t pause_p99; // 99th percentile pause in nanoseconds, upper bound of it's histogram bucket
+    uint64_t pause_max; // longest pause in nanoseconds
+    uint64_t pause_histogram[GC_STATS_PAUSE_BUCKETS]; // number of pauses per bucket, see gc_stats_pause_limit
+    uint64_t phase_time[GC_STATS_PHASES]; // nanoseconds spent in each phase
+    uint64_t allocated_objects; // number of allocated objects
+    uint64_t allocated_bytes; // bytes reserved for allocated objects, object headers and size class rounding included
+    uint64_t allocation_rate; // bytes allocated per second between last two full cycles
+    uint64_t collected_objects; // number of freed objects, freed by sweeper included
+    uint64_t collected_bytes; // freed bytes
+    uint64_t promoted_objects; // number of objects moved to next generation
+    uint64_t promoted_bytes; // bytes moved to next generation
+    uint64_t compacted_bytes; // pool memory reclaimed by compaction
+    uint8_t gens_count; // number of generations
+    uint64_t gen_objects[GC_STATS_GENS]; // number of objects each generation holds
+    uint64_t gen_bytes[GC_STATS_GENS]; // bytes each generation holds
+} gc_stats;
+void gc_get_stats(gc_stats* stats);
+void gc_heap_get_stats(gc_heap* heap, gc_stats* stats);
+
+// exclusive upper bound of pause durations counted in histogram bucket in nanoseconds
+uint64_t gc_stats_pause_limit(uint32_t bucket);
+
+// write stats as json object into buffer of given size, returns length of whole json same as snprintf,
+// it's truncated if buffer isn't large enough, histogram lists only non empty buckets as [limit,count] pairs
+size_t gc_stats_json(const gc_stats* stats, char* buf, size_t size);
+
+// tracing
+// while enabled every pause and every phase run by collecting thread of any heap emits begin and end events,
+// end events carry number of objects handled, full cycles emit instant events, events go into lock free ring
+// shared by all heaps, oldest ones are overwritten once it's full, so it keeps last events before an incident
+// events is ring size rounded up to power of 2, 0 is default of 65536, ring is allocated when tracing is first
+// enabled and can't be resized afterwards, disabled tracing costs a load and branch per phase
+// requires tracing compiled in, returns false and sets errno otherwise
+bool gc_set_trace(bool enabled, uint32_t events);
+
+// write events traced since last flush to file as chrome trace event json and drop them from ring
+// timestamps are CLOCK_MONOTONIC microseconds, threads are kernel thread ids, so application's own spans
+// taken with same clock line up with them in trace viewers, returns false and sets errno if file can't be written
+bool gc_trace_flush(const char* path);
+
+// heap dump
+// snapshot of every object heap holds is streamed to file descriptor as binary records, simplegc_heapdump tool
+// reports retained size by class and dominator trees of it offline, gc_print is fit for tiny heaps only
+// world is stopped only while process forks, forked child writes snapshot from it's copy of memory and exits
+// while process keeps running, memory process changes meanwhile is copied on write, so dump of large heap
+// taken while mutators churn it might take up to as much memory again, background collector takes it between cycles
+// objects held only by conservatively scanned stacks aren't roots in snapshot
+// returns false and sets errno if process can't be forked or previous dump of heap wasn't waited for yet
+bool gc_dump(int fd);
+bool gc_heap_dump(gc_heap* heap, int fd);
+
+// wait until last dump of heap is written, thread waits inside safe region
+// returns false and sets errno if dump couldn't be written completely
+bool gc_dump_wait();
+bool gc_heap_dump_wait(gc_heap* heap);
+
+// dump format, header is followed by records in native byte order, each starts with it's kind and is
+// a multiple of 8 bytes long, so dump can be read through mmap as is, objects are listed in no particular order
+// and only non null references are listed, classes are identified by address of their gc_object_class
+#define GC_DUMP_MAGIC "SGCDUMP" // header magic, zero terminated
+#define GC_DUMP_VERSION 1
+#define GC_DUMP_OBJECT 1 // object record followed by it's references as 64 bit addresses
+#define GC_DUMP_END 2 // last record, dump without it is truncated
+#define GC_DUMP_WEAK 0x01 // weak object, it's references don't keep objects alive
+#define GC_DUMP_WEAK_TABLE 0x02 // weak table, keys and values don't keep objects alive
+typedef struct {
+    char magic[8]; // GC_DUMP_MAGIC
+    uint32_t version; // GC_DUMP_VERSION
+    uint32_t gens_count; // number of heap generations
+    uint64_t time; // CLOCK_REALTIME nanoseconds snapshot was taken at
+} gc_dump_header;
+typedef struct {
+    uint8_t kind; // GC_DUMP_OBJECT
+    uint8_t gen; // generation object belongs to
+    uint8_t color; // color in current cycle, 0 white, 1 grey, 2 black, 3 silver
+    uint8_t flags; // GC_DUMP_WEAK or GC_DUMP_WEAK_TABLE
+    uint32_t roots; // root reference count
+    uint64_t address; // object address
+    uint64_t class; // object class address
+    uint64_t size; // bytes reserved for object memory block, header and size class rounding included
+    uint64_t refs_count; // number of references following record
+} gc_dump_object;
+typedef struct {
+    uint8_t kind; // GC_DUMP_END
+    uint8_t reserved[7];
+    uint64_t objects; // number of object records
+} gc_dump_end;
+
 // get time in nano seconds
 uint64_t get_nanotime();
 
@@ -122,9 +475,16 @@ uint64_t get_nanotime();
 // use with caution
 // get current gc configuration
 gc_config* gc_get_config();
+gc_config* gc_heap_get_config(gc_heap* heap);
 
 // check if object is managed by gc
 bool gc_contains(gc_object* obj);
+bool gc_heap_contains(gc_heap* heap, gc_object* obj);
+
+// find object which memory contains address, null if there is none or it's garbage not yet freed
+// constant time with gc memory pool
+gc_object* gc_lookup(void* p);
+gc_object* gc_heap_lookup(gc_heap* heap, void* p);
 
 #ifdef __cplusplus
 }
@@ -26,381 +26,1157 @@ THE SOFTWARE.
 extern "C" {
 #endif
 
-#include "gc.h"
+#include "gc_internal.h"
 #include <time.h>
 #include <malloc.h>
 #include <errno.h>
+#include <string.h>
 
-#define WHITE 0
-#define GREY  1
-#define BLACK 2
-#define SILVER 3
+// default heap used by global gc functions
+static gc_heap default_heap;
+// heap being collected by current thread, used by object class callbacks
+__thread gc_heap* collecting_heap = null;
 
-// gc configuration
-static gc_config conf;
-// gc list variables
-static gc_object* transparent = null;
-static gc_object* white = null;
-static gc_object* silver = null;
-static gc_object* grey = null;
-static gc_object** black;
+// allocate memory for gc object
+static inline gc_object* gc_object_allocate(gc_heap* heap, uint32_t refs_count){
+#ifdef GC_USE_MALLOC
+    return (gc_object*)malloc(gc_object_size(refs_count));
+#else
+    size_t size = gc_object_size(refs_count);
+    if(size > GC_POOL_MAX_SIZE)
+        return (gc_object*)gc_pool_alloc(&heap->pool,size);
+    // bump or pop slot from slab owned by heap
+    uint16_t class_index = gc_pool_class_index(size);
+    gc_pool_slab* slab = heap->slabs[class_index];
+    void* p = slab != null ? gc_pool_slab_alloc(slab) : null;
+    if(p == null){
+        if(slab != null)
+            gc_pool_return_slab(&heap->pool,slab);
+        slab = heap->slabs[class_index] = gc_pool_take_slab(&heap->pool,class_index);
+        if(slab == null)
+            return null;
+        p = gc_pool_slab_alloc(slab);
+    }
+    return (gc_object*)p;
+#endif
+}
 
-// initialize garbage collector
-void gc_init(gc_config* config){
+// free gc object memory
+static inline void gc_object_free(gc_heap* heap, gc_object* obj){
+#ifdef GC_USE_MALLOC
+    free(gc_object_block(obj));
+#else
+    gc_pool_free(&heap->pool,gc_object_block(obj),gc_object_block_size(obj));
+#endif
+}
+
+// initialize heap
+static bool gc_heap_init(gc_heap* heap, gc_config* config){
     // number of generations can't be more than 64 or equal to 0
     if(config->gens_count == 0 || config->gens_count > 64){
         errno = EINVAL;
-        return;
+        return false;
     }
+    memset(heap,0,sizeof(gc_heap));
     // copy config
-    conf = *config;
-    conf.gens = (gc_gen_config*)malloc(sizeof(gc_gen_config) * conf.gens_count);    
-    black = (gc_object**)malloc(sizeof(gc_object*) * conf.gens_count);
+    heap->conf = *config;
+    heap->conf.gens = (gc_gen_config*)malloc(sizeof(gc_gen_config) * heap->conf.gens_count);    
+    heap->black = (gc_object**)malloc(sizeof(gc_object*) * heap->conf.gens_count);
     // foreach generation config
-    for(uint8_t i = 0; i < conf.gens_count; ++i){
+    for(uint8_t i = 0; i < heap->conf.gens_count; ++i){
         // copy config and initialize generation
-        conf.gens[i] = config->gens[i];
-        conf.gens[i].refresh_time = get_nanotime();
-        conf.gens[i].promotion_time = conf.gens[i].refresh_time;
-        black[i] = null;
+        heap->conf.gens[i] = config->gens[i];
+        heap->conf.gens[i].refresh_time = get_nanotime();
+        heap->conf.gens[i].promotion_time = heap->conf.gens[i].refresh_time;
+        heap->conf.gens[i].tenure_age = GC_TENURE_INITIAL_AGE;
+        heap->conf.gens[i].tenure_interval = heap->conf.gens[i].refresh_interval;
+        heap->conf.gens[i].tenure_refreshed = 0;
+        heap->conf.gens[i].tenure_died = 0;
+        heap->black[i] = null;
     }
+    heap->mark_prefetch = GC_MARK_PREFETCH;
+    heap->stats.rate_time = get_nanotime();
+#ifndef GC_USE_MALLOC
+    gc_pool_init(&heap->pool);
+#endif
+    pthread_mutex_init(&heap->lock,null);
+    pthread_cond_init(&heap->parked_cond,null);
+    pthread_cond_init(&heap->resume_cond,null);
+    pthread_cond_init(&heap->collector_cond,null);
+    pthread_cond_init(&heap->cycle_cond,null);
+    return true;
+}
+
+// create new heap
+gc_heap* gc_heap_create(gc_config* config){
+    gc_heap* heap = (gc_heap*)malloc(sizeof(gc_heap));
+    if(heap == null){
+        errno = ENOMEM;
+        return null;
+    }
+    if(!gc_heap_init(heap,config)){
+        free(heap);
+        return null;
+    }
+    return heap;
+}
+
+// initialize garbage collector
+void gc_init(gc_config* config){
+    gc_heap_init(&default_heap,config);
 }
 
 // completely free entire list finalizing all objects inside
-inline void gc_free_list(gc_object* list){
+static inline void gc_free_list(gc_heap* heap, gc_object* list){
     while(list != null){
         gc_object* obj = list;
         list = list->gc_next; 
-        (obj->class->gc_finalize)(obj);
-        free(obj);
+        if(obj->class->gc_finalize != null)
+            (obj->class->gc_finalize)(obj);
+        gc_object_free(heap,obj);
     }
 }
 
-// deinitialize garbage collector
-void gc_destroy(){
+// free all heap objects and memory
+static void gc_heap_free(gc_heap* heap){
+    if(heap->collector)
+        gc_heap_stop_collector(heap);
+    // garbage handed over to sweeper is freed before memory pool goes away
+    if(heap->sweeper != null){
+        gc_sweeper_destroy(heap->sweeper);
+        heap->sweeper = null;
+    }
+    // thread destroying heap might still be attached to it
+    gc_heap_thread_detach(heap);
+    // dump process isn't left behind as zombie
+    if(heap->dump_pid != 0)
+        gc_heap_dump_wait(heap);
+    // objects held by unfinished compaction
+    gc_heap_compact_free(heap);
+    // objects allocated during background marking
+    if(heap->allocated != null)
+        gc_list_move_all(&heap->allocated,&heap->white);
     // free all objects from all lists
-    gc_free_list(transparent);
-    gc_free_list(white);
-    gc_free_list(silver);
-    gc_free_list(grey);
-    for(uint8_t i = 0; i < conf.gens_count; ++i)
-        gc_free_list(black[i]);
+    gc_free_list(heap,heap->transparent);
+    gc_free_list(heap,heap->white);
+    gc_free_list(heap,heap->silver);
+    gc_free_list(heap,heap->grey);
+    for(uint8_t i = 0; i < heap->conf.gens_count; ++i)
+        gc_free_list(heap,heap->black[i]);
+    // remove remembered set
+    free(heap->remset);
+    free(heap->remset_scan);
+    free(heap->store_buffer);
+    free(heap->weak);
     // remove black list and generation configs
-    free(black);
-    free(conf.gens);
-}
-
-// gc mark
-#define gc_set_mark(o,r,gi) o->gc_mark = (r << 8) | gi
-// generation part
-#define gc_gen_part(o) (o->gc_mark & 0xFF)
-#define gc_gen_num(o) (o->gc_mark & 0x3F)
-#define gc_gen_set(o,g) gc_set_mark(o,gc_root_ref_count(o), gc_color_bit(o) | (g & 0x3F))
-// color bits
-#define gc_color_bit(o) (o->gc_mark & 0xC0)
-#define gc_color(o) (gc_gen_part(o) >> 6)
-#define gc_color_is_white(o) (gc_color_bit(o) == 0x00)
-#define gc_color_is_grey(o) (gc_color_bit(o) == 0x40)
-#define gc_color_is_black(o) (gc_color_bit(o) == 0x80)
-#define gc_color_is_silver(o) (gc_color_bit(o) == 0xC0)
-#define gc_color_is_silver_or_white(o) (gc_color_is_silver(o) || gc_color_is_white(o))
-#define gc_mark_white(o) o->gc_mark &= 0xFFFFFF3F
-#define gc_mark_grey(o) gc_mark_white(o); o->gc_mark |= 0x40
-#define gc_mark_black(o) gc_mark_white(o); o->gc_mark |= 0x80
-#define gc_mark_silver(o) o->gc_mark |= 0xC0
-// root reference count
-#define gc_root_ref_count(o) (o->gc_mark >> 8)
-#define gc_inc_root_ref_count(o) gc_set_mark(o,(gc_root_ref_count(o)+1),gc_gen_part(o))
-#define gc_dec_root_ref_count(o) gc_set_mark(o,(gc_root_ref_count(o)-1),gc_gen_part(o))
-
-// add object to list
-inline void gc_list_add(gc_object** list, gc_object* obj){
-    obj->gc_next = *list;
-    if(obj->gc_next != null)
-        obj->gc_next->gc_prev = &(obj->gc_next);
-    obj->gc_prev = list;
-    *list = obj;
-}
-
-// remove object from current list
-inline void gc_list_remove(gc_object* obj){
-    *(obj->gc_prev) = obj->gc_next;
-    if(obj->gc_next != null)
-        obj->gc_next->gc_prev = obj->gc_prev;
-}
-
-// move object to list
-inline void gc_list_move(gc_object* obj, gc_object** list){
-    gc_list_remove(obj);
-    gc_list_add(list,obj);
-}
-
-// move all objects from list to list
-inline void gc_list_move_all(gc_object** from, gc_object** to){
-    if(*to != null){
-        gc_object* obj = *from;
-        while(obj->gc_next != null)
-            obj = obj->gc_next;
-        obj->gc_next = *to;
-        (*to)->gc_prev = &(obj->gc_next);
-    }
-    *to = *from;
-    (*to)->gc_prev = to;
-    *from = null;
+    free(heap->black);
+    free(heap->conf.gens);
+#ifndef GC_USE_MALLOC
+    gc_pool_destroy(&heap->pool);
+#endif
+    free(heap->log);
+    if(heap->marker != null)
+        gc_marker_destroy(heap->marker);
+    pthread_mutex_destroy(&heap->lock);
+    pthread_cond_destroy(&heap->parked_cond);
+    pthread_cond_destroy(&heap->resume_cond);
+    pthread_cond_destroy(&heap->collector_cond);
+    pthread_cond_destroy(&heap->cycle_cond);
+    memset(heap,0,sizeof(gc_heap));
+}
+
+// destroy heap
+void gc_heap_destroy(gc_heap* heap){
+    gc_heap_free(heap);
+    free(heap);
+}
+
+// deinitialize garbage collector
+void gc_destroy(){
+    gc_heap_free(&default_heap);
+}
+
+// add black object to remembered set if it references objects from other generations
+static inline void gc_remset_check(gc_heap* heap, gc_object* obj){
+    if(gc_is_remembered(obj))
+        return;
+    gc_object** refs = (gc_object**)(obj+1); // start of refs array
+    const uint64_t* map;
+    uint32_t count = gc_object_refs(obj,&map);
+    for(uint32_t i = 0; i < count; ++i){
+        if(gc_refs_map_test(map,i) && refs[i] != null && gc_gen_num(refs[i]) != gc_gen_num(obj)){
+            gc_remset_add(heap,obj);
+            return;
+        }
+    }
+}
+
+// put back not yet scanned part of detached remembered set, scanning has to start over
+static inline void gc_remset_scan_reset(gc_heap* heap){
+    heap->remset_scanned = false;
+    if(heap->remset_scan == null)
+        return;
+    for(uint32_t i = heap->remset_scan_index; i < heap->remset_scan_count; ++i){
+        gc_flag_clear(heap->remset_scan[i],GC_FLAG_REMEMBERED);
+        gc_remset_add(heap,heap->remset_scan[i]);
+    }
+    free(heap->remset_scan);
+    heap->remset_scan = null;
+    heap->remset_scan_count = heap->remset_scan_index = 0;
 }
 
 // add gc root
-void gc_add_root(gc_object* obj){
+void gc_heap_add_root(gc_heap* heap, gc_object* obj){
+    if(__atomic_load_n(&heap->compacting,__ATOMIC_RELAXED))
+        obj = gc_object_forward(obj);
+    gc_thread* t = gc_thread_find(heap);
+    if(t != null){
+        // other threads might change root ref count at the same time
+        __atomic_add_fetch(&(obj->gc_mark),1 << 8,__ATOMIC_RELAXED);
+        if(gc_color_is_silver_or_white(obj))
+            gc_thread_log(t,obj,GC_LOG_SHADE);
+        return;
+    }
     // increase root ref count
     gc_inc_root_ref_count(obj);
     // mark object as grey if it's white or silver
     if(gc_color_is_silver_or_white(obj)){
-        gc_list_move(obj,&grey);
+        gc_list_move(obj,&heap->grey);
         gc_mark_grey(obj);
     }
 }
 
+// add gc root
+void gc_add_root(gc_object* obj){
+    gc_heap_add_root(&default_heap,obj);
+}
+
 // remove gc root
-void gc_remove_root(gc_object* obj){
+void gc_heap_remove_root(gc_heap* heap, gc_object* obj){
+    if(__atomic_load_n(&heap->compacting,__ATOMIC_RELAXED))
+        obj = gc_object_forward(obj);
+    if(gc_thread_find(heap) != null){
+        // other threads might change root ref count at the same time
+        uint32_t mark = __atomic_load_n(&(obj->gc_mark),__ATOMIC_RELAXED);
+        while((mark >> 8) != 0 && !__atomic_compare_exchange_n(&(obj->gc_mark),&mark,mark - (1 << 8),true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+        return;
+    }
     // decrease root ref count
     if(gc_root_ref_count(obj) != 0)
         gc_dec_root_ref_count(obj);
 }
 
-// allocate gc_object
-gc_object* gc_alloc(uint32_t refs_count){
+// remove gc root
+void gc_remove_root(gc_object* obj){
+    gc_heap_remove_root(&default_heap,obj);
+}
+
+// allocate gc_object, objects of class with layout are initialized before other threads can see them
+static gc_object* gc_heap_allocate(gc_heap* heap, uint32_t refs_count, gc_object_class* cls){
+    // size of object must fit into address space
+    if(refs_count > (SIZE_MAX - sizeof(gc_object) - sizeof(gc_object_prefix))/sizeof(gc_object*)){
+        errno = EINVAL;
+        return null;
+    }
     // allocate new white object in generation 0 with 0 root ref count
-    gc_object* obj = (gc_object*)malloc(sizeof(gc_object) + refs_count*sizeof(gc_object*));
+    gc_object* obj;
+    gc_thread* t = gc_thread_find(heap);
+    if(t != null){
+        gc_thread_poll(t);
+        obj = gc_thread_allocate(t,refs_count);
+    }else{
+        obj = gc_object_allocate(heap,refs_count);
+    }
+    if(obj == null){
+        errno = ENOMEM;
+        return null;
+    }
+
+    // large object keeps number of references and how far it was marked in front of header
+    if(refs_count >= GC_OBJECT_LARGE_REFS){
+        gc_object_prefix* prefix = (gc_object_prefix*)obj;
+        prefix->refs_count = refs_count;
+        prefix->scan = 0;
+        obj = (gc_object*)(prefix+1);
+    }
 
     // initialize references
-    obj->refs_count = refs_count; // number of references this object might contain
+    obj->refs_count = refs_count < GC_REFS_LARGE ? refs_count : GC_REFS_LARGE; // number of references this object might contain
     gc_object** refs = (gc_object**)(obj+1); // start of refs array
-    for(uint16_t i = 0; i < refs_count; ++i)
+    for(uint32_t i = 0; i < refs_count; ++i)
         refs[i] = null;
 
     // set gc mark
     obj->gc_mark = 0; // initial gc_mark value (0 generation white color)
-    // add object to white list
-    gc_list_add(&white,obj);
+    obj->gc_flags = 0;
+    obj->class = cls;
+    if(cls != null)
+        obj->gc_flags = GC_FLAG_LAYOUT;
+    if(t != null){
+        // objects allocated during background marking are black, they weren't part of the snapshot,
+        // ones allocated during sweep aren't garbage it's freeing either
+        if(__atomic_load_n(&heap->marking,__ATOMIC_RELAXED) || __atomic_load_n(&heap->sweeping,__ATOMIC_RELAXED))
+            obj->gc_mark = 0x80;
+        // add object to thread white list, it's published to heap in batches
+        gc_list_add(&t->white,obj);
+        if(t->white_count++ == 0)
+            t->white_tail = obj;
+        t->white_bytes += gc_object_reserved(refs_count);
+        if(t->white_count >= GC_THREAD_PUBLISH_BATCH){
+            pthread_mutex_lock(&heap->lock);
+            gc_thread_publish(t);
+            pthread_mutex_unlock(&heap->lock);
+        }
+        return obj;
+    }
+    if(heap->sweeping){
+        // white objects are garbage sweep didn't get to yet, object allocated meanwhile is black
+        obj->gc_mark = 0x80;
+        gc_list_add(&(heap->black[0]),obj);
+    }else{
+        // add object to white list
+        gc_list_add(&heap->white,obj);
+    }
+    gc_stats_add(heap->stats.allocated_objects,1);
+    gc_stats_add(heap->stats.allocated_bytes,gc_object_reserved(refs_count));
     return obj;
 }
 
+// allocate gc_object
+gc_object* gc_heap_alloc(gc_heap* heap, uint32_t refs_count){
+    return gc_heap_allocate(heap,refs_count,null);
+}
+
+// allocate gc_object
+gc_object* gc_alloc(uint32_t refs_count){
+    return gc_heap_alloc(&default_heap,refs_count);
+}
+
+// allocate gc_object of class with layout
+gc_object* gc_heap_alloc_object(gc_heap* heap, gc_object_class* cls){
+    // data is zero filled with references, size is rounded up to whole words
+    return gc_heap_allocate(heap,(uint32_t)((((uint64_t)cls->size) + sizeof(gc_object*) - 1)/sizeof(gc_object*)),cls);
+}
+
+// allocate gc_object of class with layout
+gc_object* gc_alloc_object(gc_object_class* cls){
+    return gc_heap_alloc_object(&default_heap,cls);
+}
+
+// shade reference stored into part of large grey object marked already, same as if object was black
+static inline void gc_heap_shade_scanned(gc_heap* heap, gc_object* obj, gc_object* ref){
+    if(gc_color_is_silver_or_white(ref)){
+        gc_thread* t = gc_thread_find(heap);
+        if(t == null){
+            gc_list_move(ref,&heap->grey);
+            gc_mark_grey(ref);
+        }else{
+            gc_thread_log(t,ref,GC_LOG_SHADE);
+        }
+    }
+    // object is remembered once it's marked black
+    if(gc_gen_num(ref) != gc_gen_num(obj))
+        gc_flag_set(obj,GC_FLAG_CROSS);
+}
+
+// mark black object stored into grey again so it's references are scanned again
+static inline void gc_heap_rescan(gc_heap* heap, gc_thread* t, gc_object* obj){
+    if(t == null){
+        gc_list_move(obj,&heap->grey);
+        gc_mark_grey(obj);
+    }else if(!(__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_LOGGED)){
+        gc_flag_set(obj,GC_FLAG_LOGGED);
+        gc_thread_log(t,obj,GC_LOG_RESCAN);
+    }
+}
+
+// log black object stored into by thread not attached to heap, it's rescanned at next collection
+static inline void gc_heap_store_buffer_add(gc_heap* heap, gc_object* obj){
+    if(__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_LOGGED)
+        return;
+    if(heap->store_buffer_count == heap->store_buffer_size){
+        heap->store_buffer_size = heap->store_buffer_size == 0 ? 1024 : heap->store_buffer_size*2;
+        heap->store_buffer = (gc_object**)realloc(heap->store_buffer,sizeof(gc_object*)*heap->store_buffer_size);
+    }
+    gc_flag_set(obj,GC_FLAG_LOGGED);
+    heap->store_buffer[heap->store_buffer_count++] = obj;
+}
+
+// rescan black objects logged into store buffer since previous collection
+void gc_heap_apply_store_buffer(gc_heap* heap){
+    for(uint32_t i = 0; i < heap->store_buffer_count; ++i){
+        gc_object* obj = heap->store_buffer[i];
+        gc_flag_clear(obj,GC_FLAG_LOGGED);
+        if(gc_color_is_black(obj)){
+            gc_list_move(obj,&heap->grey);
+            gc_mark_grey(obj);
+        }
+    }
+    heap->store_buffer_count = 0;
+}
+
 // set object reference to another object
-void gc_set_ref(gc_object* obj, uint16_t ref_index, gc_object* ref){
+void gc_heap_set_ref(gc_heap* heap, gc_object* obj, uint32_t ref_index, gc_object* ref){
     gc_object** refs = (gc_object**)(obj+1); // start of refs array
-    refs[ref_index] = ref;
-    // if object is black because it mutated we need to mark it grey again
-    if(gc_color_is_black(obj)){
-        gc_list_move(obj,&grey);
-        gc_mark_grey(obj);
+    gc_thread* t;
+#ifdef GC_CHECKED
+#ifndef GC_USE_MALLOC
+    gc_check(gc_heap_contains(heap,obj),"gc_set_ref on object not allocated from heap",obj);
+    gc_check(ref == null || gc_heap_contains(heap,ref),"gc_set_ref to object not allocated from heap",ref);
+#endif
+    gc_check(ref_index < gc_refs_count(obj),"gc_set_ref index out of bounds",obj);
+    const uint64_t* map;
+    gc_check(ref_index < gc_object_refs(obj,&map) && gc_refs_map_test(map,ref_index),"gc_set_ref index isn't reference of class layout",obj);
+#endif
+    if(__atomic_load_n(&heap->compacting,__ATOMIC_RELAXED)){
+        // moved objects are still reachable through references not yet fixed, both copies are kept in sync
+        ref = gc_object_forward(ref);
+        if(gc_object_forward(obj) != obj){
+            __atomic_store_n(&refs[ref_index],ref,__ATOMIC_RELEASE);
+            obj = gc_object_forward(obj);
+            refs = (gc_object**)(obj+1);
+        }
+    }
+    if(__atomic_load_n(&heap->marking,__ATOMIC_RELAXED)){
+        // snapshot at the beginning barrier, overwritten reference might be the only path to not yet marked object
+        gc_object* old = refs[ref_index];
+        t = gc_thread_find(heap);
+        if(old != null && gc_color_is_silver_or_white(old) && t != null){
+            gc_thread_log(t,old,GC_LOG_SHADE);
+            if(t->log_count >= GC_THREAD_HANDOFF_BATCH){
+                pthread_mutex_lock(&heap->lock);
+                gc_thread_handoff(t);
+                pthread_mutex_unlock(&heap->lock);
+            }
+        }
+        __atomic_store_n(&refs[ref_index],ref,__ATOMIC_RELEASE);
+        // remembered set still has to know about black objects referencing other generations
+        if(ref != null && t != null && gc_color_is_black(obj) && gc_gen_num(ref) != gc_gen_num(obj) && !gc_is_remembered(obj))
+            gc_thread_log(t,obj,GC_LOG_REMEMBER);
+        return;
+    }
+    __atomic_store_n(&refs[ref_index],ref,__ATOMIC_RELEASE);
+    if(ref == null)
+        return;
+    if(!gc_color_is_black(obj)){
+        // part of large object marked by previous increment isn't scanned again, reference stored there is shaded
+        if(gc_object_large(obj) && ref_index < gc_object_prefix_of(obj)->scan)
+            gc_heap_shade_scanned(heap,obj,ref);
+        return;
+    }
+    // attached threads log changes to shared heap lists until next collection
+    t = gc_thread_find(heap);
+    // other threads log object into store buffer if it's enabled, referenced object isn't even looked at
+    if(t == null && heap->store_buffering){
+        gc_heap_store_buffer_add(heap,obj);
+        return;
+    }
+    // if black object now references white object we need to mark it grey again
+    if(gc_color_is_white(ref)){
+        gc_heap_rescan(heap,t,obj);
+        return;
+    }
+    // black object can't reference silver object, mark referenced object grey
+    if(gc_color_is_silver(ref)){
+        if(t == null){
+            gc_list_move(ref,&heap->grey);
+            gc_mark_grey(ref);
+        }else{
+            gc_thread_log(t,ref,GC_LOG_SHADE);
+        }
+    }
+    // remember black object referencing object from other generation
+    if(gc_gen_num(ref) != gc_gen_num(obj)){
+        if(t == null)
+            gc_remset_add(heap,obj);
+        else if(!gc_is_remembered(obj))
+            gc_thread_log(t,obj,GC_LOG_REMEMBER);
+    }
+}
+
+// set object reference to another object
+void gc_set_ref(gc_object* obj, uint32_t ref_index, gc_object* ref){
+    gc_heap_set_ref(&default_heap,obj,ref_index,ref);
+}
+
+// store references into slots one by one as collector might read them meanwhile, overlapping slots are
+// copied backwards like memmove does, null values clear slots
+static inline void gc_refs_store(gc_object** refs, gc_object** values, uint32_t count){
+    if(values == null){
+        for(uint32_t i = 0; i < count; ++i)
+            __atomic_store_n(&refs[i],null,__ATOMIC_RELEASE);
+    }else if(values < refs && values + count > refs){
+        for(uint32_t i = count; i > 0; --i)
+            __atomic_store_n(&refs[i-1],values[i-1],__ATOMIC_RELEASE);
+    }else{
+        for(uint32_t i = 0; i < count; ++i)
+            __atomic_store_n(&refs[i],values[i],__ATOMIC_RELEASE);
     }
 }
 
-#define gc_cycle_check \
-    if(conf.cycle_threshold >= conf.pause_threshold){ \
-        if((get_nanotime() - conf.cycle_time) >= conf.max_pause){ \
-            return gc_cycle_end(); \
-        } \
-        conf.cycle_objects += conf.cycle_threshold; \
-        conf.cycle_threshold = 0; \
+// replace references to objects moved by compaction with references to their new copies
+static inline void gc_refs_forward(gc_object** refs, uint32_t count){
+    for(uint32_t i = 0; i < count; ++i)
+        __atomic_store_n(&refs[i],gc_object_forward(refs[i]),__ATOMIC_RELEASE);
+}
+
+// set consecutive object references with single barrier for all of them
+void gc_heap_set_refs(gc_heap* heap, gc_object* obj, uint32_t start, uint32_t count, gc_object** values){
+    gc_object** refs = ((gc_object**)(obj+1)) + start; // first slot stored into
+    gc_thread* t;
+#ifdef GC_CHECKED
+#ifndef GC_USE_MALLOC
+    gc_check(gc_heap_contains(heap,obj),"gc_set_refs on object not allocated from heap",obj);
+    for(uint32_t i = 0; values != null && i < count; ++i)
+        gc_check(values[i] == null || gc_heap_contains(heap,values[i]),"gc_set_refs to object not allocated from heap",values[i]);
+#endif
+    gc_check(((uint64_t)start) + count <= gc_refs_count(obj),"gc_set_refs index out of bounds",obj);
+    const uint64_t* map;
+    uint32_t refs_count = gc_object_refs(obj,&map);
+    for(uint32_t i = 0; i < count; ++i)
+        gc_check(start+i < refs_count && gc_refs_map_test(map,start+i),"gc_set_refs index isn't reference of class layout",obj);
+#endif
+    if(count == 0)
+        return;
+    bool stored = false;
+    if(__atomic_load_n(&heap->compacting,__ATOMIC_RELAXED)){
+        // moved objects are still reachable through references not yet fixed, both copies are kept in sync
+        if(gc_object_forward(obj) != obj){
+            gc_refs_store(refs,values,count);
+            gc_refs_forward(refs,count);
+            values = refs;
+            obj = gc_object_forward(obj);
+            refs = ((gc_object**)(obj+1)) + start;
+        }
+        gc_refs_store(refs,values,count);
+        gc_refs_forward(refs,count);
+        stored = true;
+    }
+    if(__atomic_load_n(&heap->marking,__ATOMIC_RELAXED)){
+        // snapshot at the beginning barrier, every overwritten reference is logged
+        t = gc_thread_find(heap);
+        if(t != null){
+            for(uint32_t i = 0; i < count; ++i){
+                gc_object* old = refs[i];
+                if(old != null && gc_color_is_silver_or_white(old))
+                    gc_thread_log(t,old,GC_LOG_SHADE);
+            }
+            if(t->log_count >= GC_THREAD_HANDOFF_BATCH){
+                pthread_mutex_lock(&heap->lock);
+                gc_thread_handoff(t);
+                pthread_mutex_unlock(&heap->lock);
+            }
+        }
+        gc_refs_store(refs,values,count);
+        // remembered set still has to know about black objects referencing other generations
+        if(t != null && gc_color_is_black(obj) && !gc_is_remembered(obj)){
+            for(uint32_t i = 0; i < count; ++i){
+                if(refs[i] != null && gc_gen_num(refs[i]) != gc_gen_num(obj)){
+                    gc_thread_log(t,obj,GC_LOG_REMEMBER);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+    if(!stored)
+        gc_refs_store(refs,values,count);
+    if(!gc_color_is_black(obj)){
+        // part of large object marked by previous increment isn't scanned again, references stored there are shaded
+        if(gc_object_large(obj)){
+            uint32_t scan = gc_object_prefix_of(obj)->scan;
+            for(uint32_t i = 0; start + i < scan && i < count; ++i){
+                if(refs[i] != null)
+                    gc_heap_shade_scanned(heap,obj,refs[i]);
+            }
+        }
+        return;
+    }
+    t = gc_thread_find(heap);
+    if(t == null && heap->store_buffering){
+        gc_heap_store_buffer_add(heap,obj);
+        return;
+    }
+    // black object is marked grey again once if any stored reference is white or silver,
+    // it's references are all scanned again then and it's remembered if it has to be
+    bool cross = false;
+    for(uint32_t i = 0; i < count; ++i){
+        gc_object* ref = refs[i];
+        if(ref == null)
+            continue;
+        if(gc_color_is_silver_or_white(ref)){
+            gc_heap_rescan(heap,t,obj);
+            return;
+        }
+        if(gc_gen_num(ref) != gc_gen_num(obj))
+            cross = true;
+    }
+    // remember black object referencing object from other generation
+    if(cross){
+        if(t == null)
+            gc_remset_add(heap,obj);
+        else if(!gc_is_remembered(obj))
+            gc_thread_log(t,obj,GC_LOG_REMEMBER);
     }
+}
+
+// set consecutive object references with single barrier for all of them
+void gc_set_refs(gc_object* obj, uint32_t start, uint32_t count, gc_object** values){
+    gc_heap_set_refs(&default_heap,obj,start,count,values);
+}
+
+// copy references between objects
+void gc_heap_copy_refs(gc_heap* heap, gc_object* dst, uint32_t dst_start, gc_object* src, uint32_t src_start, uint32_t count){
+#ifdef GC_CHECKED
+    gc_check(((uint64_t)src_start) + count <= gc_refs_count(src),"gc_copy_refs source index out of bounds",src);
+#endif
+    gc_heap_set_refs(heap,dst,dst_start,count,((gc_object**)(src+1)) + src_start);
+}
+
+// copy references between objects
+void gc_copy_refs(gc_object* dst, uint32_t dst_start, gc_object* src, uint32_t src_start, uint32_t count){
+    gc_heap_copy_refs(&default_heap,dst,dst_start,src,src_start,count);
+}
+
+// enable or disable store buffer
+void gc_heap_set_store_buffer(gc_heap* heap, bool enabled){
+    // objects logged already are still rescanned at next collection
+    heap->store_buffering = enabled;
+}
+
+// enable or disable store buffer of default heap
+void gc_set_store_buffer(bool enabled){
+    gc_heap_set_store_buffer(&default_heap,enabled);
+}
 
-#define gc_cycle_check_no_return \
-    if(conf.cycle_threshold >= conf.pause_threshold){ \
-        if((get_nanotime() - conf.cycle_time) >= conf.max_pause){ \
-            return; \
-        } \
-        conf.cycle_objects += conf.cycle_threshold; \
-        conf.cycle_threshold = 0; \
+// set size from which objects are allocated in large object space
+bool gc_heap_set_large_threshold(gc_heap* heap, size_t threshold){
+#ifdef GC_USE_MALLOC
+    if(threshold != 0){
+        errno = ENOTSUP;
+        return false;
+    }
+#else
+    if(threshold != 0 && threshold <= GC_POOL_MAX_SIZE){
+        errno = EINVAL;
+        return false;
     }
+    // attached threads allocate large objects from pool under heap lock
+    pthread_mutex_lock(&heap->lock);
+    heap->pool.los_threshold = threshold;
+    pthread_mutex_unlock(&heap->lock);
+#endif
+    return true;
+}
+
+// set size from which objects are allocated in large object space of default heap
+bool gc_set_large_threshold(size_t threshold){
+    return gc_heap_set_large_threshold(&default_heap,threshold);
+}
 
 // end gc cycle
-static inline uint64_t gc_cycle_end(){
-    conf.cycle_objects += conf.cycle_threshold;
-    conf.cycle_duration = get_nanotime() - conf.cycle_time;
-    return conf.cycle_duration;
+static inline uint64_t gc_cycle_end(gc_heap* heap){
+    heap->conf.cycle_duration = gc_pace_end(heap);
+    heap->conf.cycle_objects += heap->conf.cycle_threshold;
+    gc_heap_large_stats(heap);
+    return heap->conf.cycle_duration;
 }
 
-// collect garbage
-uint64_t gc(){
-    // start gc cycle
-    conf.cycle_time = get_nanotime();
-    conf.cycle_threshold = 0;
-    conf.cycle_objects = 0;
-    conf.cycle_collected = 0;
-    conf.cycle_full = false;
-
-    // transparent cleanup phase before cycle
-    while(transparent != null){
-        (transparent->class->gc_finalize)(transparent);
-        gc_object* obj = transparent;
-        transparent = obj->gc_next;
-        free(obj);
-        conf.cycle_threshold += 11;
-        conf.cycle_collected += 1;
+// free transparent objects
+bool gc_heap_cleanup(gc_heap* heap){
+    gc_pace_phase(heap,GC_PACE_CLEANUP);
+    // hand whole list over to background sweeper if it takes it
+    if(heap->transparent != null && heap->sweeper != null && gc_sweeper_submit(heap->sweeper,heap->transparent))
+        heap->transparent = null;
+    while(heap->transparent != null){
+        gc_object* obj = heap->transparent;
+        if(obj->class->gc_finalize != null)
+            (obj->class->gc_finalize)(obj);
+        heap->transparent = obj->gc_next;
+        gc_stats_add(heap->stats.freed_objects[gc_gen_num(obj)],1);
+        gc_stats_add(heap->stats.freed_bytes[gc_gen_num(obj)],gc_object_block_reserved(obj));
+        gc_object_free(heap,obj);
+        heap->conf.cycle_threshold += 1;
+        heap->conf.cycle_collected += 1;
         // check pause threshold
         gc_cycle_check
     }
+    return true;
+}
 
-    // promotion phase
-    uint64_t time_now = get_nanotime();
-    for(uint8_t i = 0; i < conf.gens_count; ++i){
-        conf.gens[i].cycle_refreshed = 0;
-        conf.gens[i].cycle_promoted = 0;
-        gc_object* obj = black[i];
+// age object being refreshed and promote it once it's old enough, it's refreshed as part of new generation
+static inline void gc_heap_tenure(gc_heap* heap, gc_object* obj, uint8_t i){
+    if(i != heap->conf.gens_count-1 && gc_age(obj)+1 >= heap->conf.gens[i].tenure_age){
+        gc_gen_set(obj,(i+1));
+        gc_age_reset(obj);
+        heap->conf.gens[i].cycle_promoted += 1;
+        gc_stats_add(heap->stats.promoted_objects[i],1);
+        gc_stats_add(heap->stats.promoted_bytes[i],gc_object_block_reserved(obj));
+        i += 1;
+        if(i == heap->conf.gens_count-1)
+            heap->tenure_growth += 1;
+    }else if(gc_age(obj) < GC_TENURE_MAX_AGE){
+        gc_age_inc(obj);
+    }
+    heap->conf.gens[i].tenure_refreshed += 1;
+}
+
+// promote and refresh generations
+bool gc_heap_promote(gc_heap* heap){
+    gc_pace_phase(heap,GC_PACE_PROMOTE);
+    // intervals are checked against time phase started at, so generations done already aren't refreshed again
+    // when phase continues in next increment
+    if(!heap->promoting){
+        heap->promoting = true;
+        heap->promote_time = get_nanotime();
+        heap->promote_gen = 0;
+        heap->promote_refresh = false;
+        for(uint8_t i = 0; i < heap->conf.gens_count; ++i){
+            heap->conf.gens[i].cycle_refreshed = 0;
+            heap->conf.gens[i].cycle_promoted = 0;
+        }
+    }
+    uint64_t time_now = heap->promote_time;
+    for(; heap->promote_gen < heap->conf.gens_count; heap->promote_gen++, heap->promote_refresh = false){
+        uint8_t i = heap->promote_gen;
+        gc_object* obj = heap->black[i];
         if(obj != null){
-            // promote generation
-            if(i != (conf.gens_count-1) && time_now - conf.gens[i].promotion_time > conf.gens[i].promotion_interval){
+            // promote generation, objects are promoted one by one on refresh with adaptive tenuring
+            if(!heap->promote_refresh && !heap->tenuring && i != (heap->conf.gens_count-1) &&
+               time_now - heap->conf.gens[i].promotion_time > heap->conf.gens[i].promotion_interval){
+                gc_pace_phase(heap,GC_PACE_PROMOTE);
                 do{
                     gc_gen_set(obj,(i+1));
                     // move to next generation
-                    gc_list_move(obj,&(black[i+1]));
+                    gc_list_move(obj,&(heap->black[i+1]));
+                    // references to objects left in previous generation now cross generations
+                    gc_remset_check(heap,obj);
 
-                    conf.cycle_threshold += 1;
-                    conf.gens[i].cycle_promoted += 1;
+                    heap->conf.cycle_threshold += 1;
+                    heap->conf.gens[i].cycle_promoted += 1;
+                    gc_stats_add(heap->stats.promoted_objects[i],1);
+                    gc_stats_add(heap->stats.promoted_bytes[i],gc_object_block_reserved(obj));
                     // check pause threshold
                     gc_cycle_check
-                    obj = black[i];
+                    obj = heap->black[i];
                 }while(obj != null);
-                conf.gens[i].promotion_time = get_nanotime();
+                heap->conf.gens[i].promotion_time = get_nanotime();
             }
+            heap->promote_refresh = true;
 
             // refresh generation
-            if(time_now - conf.gens[i].refresh_time > conf.gens[i].refresh_interval){
+            if(time_now - heap->conf.gens[i].refresh_time > heap->conf.gens[i].refresh_interval){
+                gc_pace_phase(heap,GC_PACE_REFRESH);
+                // remembered set has to be scanned again for new silver objects
+                if(obj != null)
+                    gc_remset_scan_reset(heap);
+                // oldest objects might die, their slabs get sparse
+                if(obj != null && i == heap->conf.gens_count-1)
+                    heap->compact_due = true;
                 while(obj != null){
+                    if(heap->tenuring)
+                        gc_heap_tenure(heap,obj,i);
                     // if has root references
                     if(gc_root_ref_count(obj) > 0){
                         // mark as grey
-                        gc_list_move(obj,&grey);
+                        gc_list_move(obj,&heap->grey);
                         gc_mark_grey(obj);
                     }else{
                         // mark as silver
-                        gc_list_move(obj,&silver);
+                        gc_list_move(obj,&heap->silver);
                         gc_mark_silver(obj);
                     }
-                    conf.cycle_threshold += 1;
-                    conf.gens[i].cycle_refreshed += 1;
+                    heap->conf.cycle_threshold += 1;
+                    heap->conf.gens[i].cycle_refreshed += 1;
                     // check pause threshold
                     gc_cycle_check
-                    obj = black[i];
+                    obj = heap->black[i];
                 }
-                conf.gens[i].refresh_time = get_nanotime();
+                heap->conf.gens[i].refresh_time = get_nanotime();
             }
         }
     }
+    heap->promoting = false;
+    return true;
+}
 
-    // mark phase
-    while(grey != null){
-        (grey->class->gc_mark_black)(grey);
-        conf.cycle_threshold += 1;
-        // check pause threshold
-        gc_cycle_check
+// remember how far large object was marked when pause time ran out, next increment continues from there
+static inline void gc_heap_mark_suspend(gc_object* obj, uint32_t scanned){
+    gc_object_prefix_of(obj)->scan = scanned;
+}
+
+// shade object referenced by object being marked, returns true if it was white or silver
+static inline bool gc_heap_mark_ref(gc_heap* heap, gc_object* holder, gc_object* ref){
+    // if reference is from different generation holder is remembered once it's black
+    if(gc_gen_num(ref) != gc_gen_num(holder)){
+        if(gc_color_is_black(holder))
+            gc_remset_add(heap,holder);
+        else if(!(__atomic_load_n(&(holder->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_CROSS))
+            gc_flag_set(holder,GC_FLAG_CROSS);
+    }
+    if(!gc_color_is_silver_or_white(ref))
+        return false;
+    // mark object as grey
+    gc_mark_grey(ref);
+    heap->conf.cycle_threshold += 1;
+    if(heap->mark_prefetch == 0){
+        gc_list_move(ref,&heap->grey);
+        return true;
     }
+    // object is moved to grey list once it's list neighbours are prefetched too, oldest one is moved first
+    if(heap->mark_shaded_tail - heap->mark_shaded_head == heap->mark_prefetch)
+        gc_list_move(heap->mark_shaded[heap->mark_shaded_head++ % GC_MARK_PREFETCH_MAX],&heap->grey);
+    __builtin_prefetch(ref->gc_prev,1);
+    __builtin_prefetch(ref->gc_next,1);
+    heap->mark_shaded[heap->mark_shaded_tail++ % GC_MARK_PREFETCH_MAX] = ref;
+    return true;
+}
 
-    // mark silver phase
-    while(silver != null){
-        bool found = false;
-        uint8_t to_gen;
-        uint8_t i = conf.gens_count - 1;
-        while(true){
-            gc_object* obj = black[i];
-            while(obj != null){
-                if((obj->class->gc_contains)(obj,silver)){
-                    found = true;
-                    to_gen = i;
-                    break;
-                }
-                gc_cycle_check
-                obj = obj->gc_next;
+// shade oldest queued reference, returns true if it was white or silver
+static inline bool gc_heap_mark_dequeue(gc_heap* heap){
+    gc_mark_queue* q = &heap->mark_queue;
+    gc_mark_pending* p = &(q->refs[q->head++ % GC_MARK_PREFETCH_MAX]);
+    return gc_heap_mark_ref(heap,p->holder,p->ref);
+}
+
+// queue reference while header of object it points to is prefetched, oldest queued reference is shaded
+// once queue is full, returns true if it was white or silver
+static inline bool gc_heap_mark_enqueue(gc_heap* heap, gc_object* holder, gc_object* ref){
+    gc_mark_queue* q = &heap->mark_queue;
+    if(heap->mark_prefetch == 0)
+        return gc_heap_mark_ref(heap,holder,ref);
+    bool shaded = false;
+    if(q->tail - q->head == heap->mark_prefetch)
+        shaded = gc_heap_mark_dequeue(heap);
+    __builtin_prefetch(ref,1);
+    gc_mark_pending* p = &(q->refs[q->tail++ % GC_MARK_PREFETCH_MAX]);
+    p->ref = ref;
+    p->holder = holder;
+    return shaded;
+}
+
+// shade all queued references and move shaded objects to grey list
+static inline void gc_heap_mark_flush(gc_heap* heap){
+    while(heap->mark_queue.head != heap->mark_queue.tail)
+        gc_heap_mark_dequeue(heap);
+    while(heap->mark_shaded_head != heap->mark_shaded_tail)
+        gc_list_move(heap->mark_shaded[heap->mark_shaded_head++ % GC_MARK_PREFETCH_MAX],&heap->grey);
+}
+
+// gc object mark black
+static inline void gc_heap_mark_black(gc_heap* heap, gc_object* obj){
+
+    gc_object** refs = (gc_object**)(obj+1); // start of refs array
+    const uint64_t* map;
+    uint32_t count = gc_object_refs(obj,&map);
+    bool large = gc_object_large(obj);
+    uint32_t i = 0;
+    // continue where previous increment stopped
+    if(large)
+        i = gc_object_prefix_of(obj)->scan;
+    uint32_t start = i;
+    bool stop = false;
+    uint16_t flags = __atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED);
+    // references of weak object don't keep objects alive
+    if(flags & GC_FLAG_WEAK)
+        count = 0;
+    bool ephemeron = (flags & GC_FLAG_EPHEMERON) != 0;
+
+    // for each ref, mutators might change them during background marking
+    for(; i < count && !stop; ++i){
+        // large object is scanned in chunks with pause check between them
+        if(large && i != start && (i % GC_OBJECT_SCAN_CHUNK) == 0){
+            heap->conf.cycle_threshold += 1;
+            if(heap->conf.cycle_threshold >= heap->pace_next && !gc_pace_check(heap)){
+                stop = true;
+                break;
             }
-            if(found || i == 0)
+        }
+        if(!gc_refs_map_test(map,i)){
+            // rest of bitmap word without references is skipped at once
+            if((map[i >> 6] >> (i & 63)) == 0)
+                i |= 63;
+            continue;
+        }
+        // runs of null references are skipped four at a time
+        if(map == null && (i & 3) == 0 && count - i >= 4 && gc_refs_null4(refs+i)){
+            i += 3;
+            continue;
+        }
+        gc_object* ref = __atomic_load_n(&refs[i],__ATOMIC_ACQUIRE);
+        if(ref == null)
+            continue;
+        // weak table value is marked once it's key is, keys marked later are found by ephemeron phase
+        if(ephemeron && ((i & 1) == 0 || !gc_weak_key_live(__atomic_load_n(&refs[i-1],__ATOMIC_ACQUIRE))))
+            continue;
+        // check pause threshold, small object is scanned again from start
+        if(gc_heap_mark_enqueue(heap,obj,ref) && heap->conf.cycle_threshold >= heap->pace_next && !gc_pace_check(heap))
+            stop = true;
+    }
+    if(stop){
+        // references read so far are shaded before pause ends
+        gc_heap_mark_flush(heap);
+        if(large)
+            gc_heap_mark_suspend(obj,i);
+        return;
+    }
+    if(large && start != 0)
+        gc_object_prefix_of(obj)->scan = 0;
+
+    // object is remembered if references shaded so far point to other generations, queued ones remember it later
+    bool cross = (__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_CROSS) != 0;
+    if(cross)
+        gc_flag_clear(obj,GC_FLAG_CROSS);
+
+    // mark object as black
+    gc_list_move(obj,&(heap->black[gc_gen_num(obj)]));
+    gc_mark_black(obj);                        
+    if(cross)
+        gc_remset_add(heap,obj);
+}
+
+// mark grey objects
+bool gc_heap_mark(gc_heap* heap){
+    gc_pace_phase(heap,GC_PACE_MARK);
+    // weak tables scanned by ephemeron phase so far might have keys marked now, they are scanned again
+    if(heap->grey != null)
+        heap->weak_index = 0;
+    if(heap->marker != null && heap->grey != null && !gc_marker_run(heap->marker))
+        return false;
+    for(;;){
+        if(heap->grey == null){
+            // queued references might still shade objects
+            if(heap->mark_queue.head == heap->mark_queue.tail && heap->mark_shaded_head == heap->mark_shaded_tail)
                 break;
-            --i;
+            gc_heap_mark_flush(heap);
+            continue;
         }
-        if(found){
-            // correct generation and mark as grey
-            gc_gen_set(silver,to_gen);
-            gc_mark_grey(silver);
-            gc_list_move(silver,&grey);
-            conf.cycle_threshold += 1;
-            // run mark grey phase
-            while(grey != null){
-                (grey->class->gc_mark_black)(grey);
-                conf.cycle_threshold += 1;
-                // check pause threshold
-                gc_cycle_check
-            }
-        }else{
-            // mark as white
-            gc_mark_white(silver);
-            gc_list_move(silver,&white);
-            conf.cycle_threshold += 1;
+        // objects of class with layout or default one are marked without calling class
+        if(gc_object_builtin_mark(heap->grey))
+            gc_heap_mark_black(heap,heap->grey);
+        else
+            (heap->grey->class->gc_mark_black)(heap->grey);
+        heap->conf.cycle_threshold += 1;
+        // check pause threshold, queued references are shaded before pause ends
+        if(heap->conf.cycle_threshold >= heap->pace_next && !gc_pace_check(heap)){
+            gc_heap_mark_flush(heap);
+            return false;
         }
+    }
+    return true;
+}
+
+// mark silver objects referenced from remembered objects
+bool gc_heap_mark_remembered(gc_heap* heap){
+    // silver objects referenced from black objects are alive
+    // only remembered black objects can reference objects from refreshed generations
+    if(heap->silver == null || heap->remset_scanned)
+        return true;
+    if(heap->remset_scan == null){
+        // detach remembered set, objects still referencing other generations are remembered again when marked black
+        heap->remset_scan = heap->remset;
+        heap->remset_scan_count = heap->remset_count;
+        heap->remset_scan_index = 0;
+        heap->remset = null;
+        heap->remset_count = heap->remset_size = 0;
+    }
+    gc_pace_phase(heap,GC_PACE_REMEMBERED);
+    while(heap->remset_scan_index < heap->remset_scan_count){
+        gc_object* obj = heap->remset_scan[heap->remset_scan_index++];
+        gc_flag_clear(obj,GC_FLAG_REMEMBERED);
+        // mark as grey so it's references get marked again
+        if(gc_color_is_black(obj)){
+            gc_list_move(obj,&heap->grey);
+            gc_mark_grey(obj);
+        }
+        heap->conf.cycle_threshold += 1;
+        heap->conf.cycle_remembered += 1;
         // check pause threshold
         gc_cycle_check
     }
+    // run mark grey phase
+    if(!gc_heap_mark(heap))
+        return false;
+    free(heap->remset_scan);
+    heap->remset_scan = null;
+    heap->remset_scan_count = heap->remset_scan_index = 0;
+    heap->remset_scanned = true;
+    return true;
+}
 
-
-    // sweep phase
-    if(white != null){
-        // make object transparent
-        gc_list_move_all(&white,&transparent);
-        conf.cycle_threshold += 50;
+// mark rest of silver objects white, they aren't referenced from black objects
+bool gc_heap_whiten_silver(gc_heap* heap){
+    gc_pace_phase(heap,GC_PACE_WHITEN);
+    while(heap->silver != null){
+        // refreshed object died
+        if(heap->tenuring)
+            gc_tenure_died(heap,heap->silver);
+        // mark as white
+        gc_mark_white(heap->silver);
+        gc_list_move(heap->silver,&heap->white);
+        heap->conf.cycle_threshold += 1;
         // check pause threshold
         gc_cycle_check
     }
+    return true;
+}
+
+// rescan stacks of mutator threads for roots, they might have changed since previous increment
+static inline bool gc_heap_scan_roots(gc_heap* heap){
+    gc_heap_scan_stacks(heap,true);
+    return true;
+}
 
-    // transparent cleanup phase after cycle
-    while(transparent != null){
-        (transparent->class->gc_finalize)(transparent);
-        gc_object* obj = transparent;
-        transparent = obj->gc_next;
-        free(obj);
-        conf.cycle_threshold += 11;
-        conf.cycle_collected += 1;
+// make white objects transparent, objects allocated until sweep is done are black so it can be split into increments
+bool gc_heap_sweep(gc_heap* heap){
+    if(!heap->sweeping){
+        // weak references are cleared before garbage is swept, mutators can't read garbage from them meanwhile
+        gc_heap_clear_weak(heap);
+        __atomic_store_n(&heap->sweeping,1,__ATOMIC_RELAXED);
+    }
+    if(heap->white != null)
+        gc_pace_phase(heap,GC_PACE_SWEEP);
+    while(heap->white != null){
+        gc_object* obj = heap->white;
+        // stale stack words and lookups might still find garbage, it mustn't be shaded again or taken as live
+        gc_flag_set(obj,GC_FLAG_GARBAGE);
+        // make object transparent
+        gc_list_move(obj,&heap->transparent);
+        heap->conf.cycle_threshold += 1;
         // check pause threshold
         gc_cycle_check
     }
+    // swept objects are told apart from white objects allocated from now on by their flag, background collector
+    // ends sweep in pause once objects mutators allocated meanwhile are published black
+    if(!heap->background)
+        __atomic_store_n(&heap->sweeping,0,__ATOMIC_RELAXED);
+    return true;
+}
+
+// gc cycle phases in order they run, cycle continues from phase previous increment stopped in
+// transparent cleanup phase before cycle, promotion phase, stack scan phase, mark phase, mark silver phase,
+// ephemeron phase, sweep phase, transparent cleanup phase after cycle and compaction phase
+static bool (*const gc_heap_phases[])(gc_heap* heap) = {
+    gc_heap_cleanup, gc_heap_promote, gc_heap_scan_roots, gc_heap_mark, gc_heap_mark_remembered,
+    gc_heap_mark_ephemerons, gc_heap_whiten_silver, gc_heap_sweep, gc_heap_cleanup, gc_heap_compact
+};
+#define GC_PHASE_SCAN_ROOTS 2
+#define GC_PHASE_MARK 3
+#define GC_PHASE_SWEEP 7
+#define GC_PHASES_COUNT (sizeof(gc_heap_phases)/sizeof(gc_heap_phases[0]))
+
+// run cycle phases starting with the one previous increment stopped in
+static bool gc_heap_run_phases(gc_heap* heap){
+    // objects allocated since sweep started are black, stacks can't reference anything it's freeing
+    if(heap->cycle_phase > GC_PHASE_SCAN_ROOTS && heap->cycle_phase <= GC_PHASE_SWEEP && !heap->sweeping){
+        // stacks might reference other objects than when they were scanned
+        gc_heap_scan_roots(heap);
+        // objects shaded since previous increment by stack scan, roots or barrier have to be marked before sweep
+        if(heap->cycle_phase > GC_PHASE_MARK && heap->grey != null)
+            heap->cycle_phase = GC_PHASE_MARK;
+    }
+    while(heap->cycle_phase < GC_PHASES_COUNT){
+        if(!gc_heap_phases[heap->cycle_phase](heap))
+            return false;
+        heap->cycle_phase += 1;
+    }
+    heap->cycle_phase = 0;
+    return true;
+}
+
+// run gc cycle on heap, all attached threads must be parked
+uint64_t gc_heap_cycle(gc_heap* heap){
+    // start gc cycle
+    heap->conf.cycle_threshold = 0;
+    heap->conf.cycle_objects = 0;
+    heap->conf.cycle_collected = 0;
+    heap->conf.cycle_remembered = 0;
+    heap->conf.cycle_compacted = 0;
+    heap->conf.cycle_overshoot = 0;
+    heap->conf.cycle_checks = 0;
+    heap->conf.cycle_full = false;
+    gc_pace_start(heap);
+
+    // compaction started by background collector is finished before objects are traced again
+    bool done;
+    if(heap->compacting && heap->cycle_phase == 0)
+        done = gc_heap_compact(heap);
+    else
+        done = gc_heap_run_phases(heap);
+    // work done after phases isn't counted for any of them
+    gc_pace_phase(heap,GC_PACE_NONE);
+    if(!done)
+        return gc_cycle_end(heap);
 
     // set cycle full
-    conf.cycle_full = true;
+    heap->conf.cycle_full = true;
+    gc_stats_cycle(heap);
+    gc_trace(gc_trace_cycle(heap));
+    if(heap->tenuring)
+        gc_heap_tenure_adapt(heap);
+#ifndef GC_USE_MALLOC
+    // keep memory freed by this cycle for objects allocated until the next one
+    gc_pool_trim(&heap->pool);
+#endif
 
-    return gc_cycle_end();
+    return gc_cycle_end(heap);
 }
 
-// gc object mark black
-void gc_object_mark_black(gc_object* obj){
+// collect garbage
+uint64_t gc_heap_collect(gc_heap* heap){
+    // background collector does the work, caller just waits for it
+    if(heap->collector)
+        return gc_heap_collect_background(heap);
 
-    gc_object** refs = (gc_object**)(obj+1); // start of refs array
+    // stop the world, wait for all other attached threads to park
+    if(!gc_heap_stop_world(heap,gc_thread_find(heap)))
+        return 0;
+    gc_heap_flush_threads(heap);
+    gc_heap_apply_store_buffer(heap);
 
-    // for each ref
-    for(uint16_t i = 0; i < obj->refs_count; ++i){
-        if(refs[i] != null && gc_color_is_silver_or_white(refs[i])){
-            // mark object as grey
-            gc_list_move(refs[i],&grey);
-            gc_mark_grey(refs[i]);                        
-            conf.cycle_threshold += 1;
-            // check pause threshold
-            gc_cycle_check_no_return
-        }
-    }
+    // object class callbacks need to know which heap is being collected
+    gc_heap* prev_heap = collecting_heap;
+    collecting_heap = heap;
+    uint64_t duration = gc_heap_cycle(heap);
+    collecting_heap = prev_heap;
 
-    // mark object as black
-    gc_list_move(obj,&(black[gc_gen_num(obj)]));
-    gc_mark_black(obj);                        
+    gc_heap_resume_world(heap);
+    return duration;
+}
+
+// collect garbage
+uint64_t gc(){
+    return gc_heap_collect(&default_heap);
+}
+
+// gc object mark black
+void gc_object_mark_black(gc_object* obj){
+    if(local_mark_worker != null){
+        gc_mark_worker_mark_black(local_mark_worker,obj);
+        return;
+    }
+    gc_heap_mark_black(collecting_heap,obj);
 }
 
 // this checks if object contains reference object
 bool gc_object_contains(gc_object* obj, gc_object* ref){
-    conf.cycle_threshold += 1;
+    if(collecting_heap != null)
+        collecting_heap->conf.cycle_threshold += 1;
     gc_object** refs = (gc_object**)(obj+1); // start of refs array
-    for(uint16_t i = 0; i < obj->refs_count; ++i){
-        if(refs[i] == ref)
+    const uint64_t* map;
+    uint32_t count = gc_object_refs(obj,&map);
+    for(uint32_t i = 0; i < count; ++i){
+        if(gc_refs_map_test(map,i) && refs[i] == ref)
             return true;
     }
     return false;
 }
 
+// number of object references
+uint32_t gc_object_refs_count(gc_object* obj){
+    return gc_refs_count(obj);
+}
+
 // this method is called on object before it's freed
 void gc_object_finalize(gc_object* obj){
     // do nothing for finalize
@@ -412,7 +1188,7 @@ void gc_object_finalize_debug(gc_object* obj){
 }
 
 
-inline void gc_print_object_list(gc_object** list){
+static inline void gc_print_object_list(gc_object** list){
     printf("[%p (%p)]: ",list,*list);
     gc_object* obj = *list;
     uint32_t i = 0;
@@ -425,23 +1201,28 @@ inline void gc_print_object_list(gc_object** list){
 }
 
 // print inner gc memory layout
-void gc_print(){
+void gc_heap_print(gc_heap* heap){
     printf("WHITE\n");
-    gc_print_object_list(&white);
+    gc_print_object_list(&heap->white);
 
     printf("SILVER\n");
-    gc_print_object_list(&silver);
+    gc_print_object_list(&heap->silver);
 
     printf("GREY\n");
-    gc_print_object_list(&grey);
+    gc_print_object_list(&heap->grey);
 
     printf("BLACK\n");
-    for(uint8_t i = 0; i < conf.gens_count; ++i){
+    for(uint8_t i = 0; i < heap->conf.gens_count; ++i){
         printf("G%d",i);
-        gc_print_object_list(&black[i]);
+        gc_print_object_list(&heap->black[i]);
     }
 }
 
+// print inner gc memory layout
+void gc_print(){
+    gc_heap_print(&default_heap);
+}
+
 void gc_print_object(gc_object* obj){
     char* color;
     switch(gc_color(obj)){
@@ -461,48 +1242,85 @@ void gc_print_object(gc_object* obj){
     printf("%p[roots: %d color: %s gen: %d]\n",obj,gc_root_ref_count(obj),color,gc_gen_num(obj));
 }
 
+// get current gc configuration
+gc_config* gc_heap_get_config(gc_heap* heap){
+    return &heap->conf;
+}
+
+// get default heap used by global gc functions
+gc_heap* gc_get_heap(){
+    return &default_heap;
+}
+
 // get current gc configuration
 gc_config* gc_get_config(){
-    return &conf;
+    return gc_heap_get_config(&default_heap);
 }
 
-// check if object is managed by gc
-bool gc_contains(gc_object* obj){
-    // check white
-    gc_object* o = white;
+#ifdef GC_USE_MALLOC
+// find object in list which memory contains address
+static inline gc_object* gc_list_lookup(gc_object* o, void* p){
     while(o != null){
-        if(o == obj)
-            return true;
+        char* block = (char*)gc_object_block(o);
+        if((char*)p >= block && (char*)p < block + gc_object_block_size(o))
+            return o;
         o = o->gc_next;
     }
+    return null;
+}
+#endif
 
-    // check silver
-    o = silver;
-    while(o != null){
-        if(o == obj)
-            return true;
-        o = o->gc_next;
-    }
+// check if object lookup found is garbage, swept objects are flagged and while sweep is in progress white and
+// silver objects it didn't get to yet are garbage too since everything allocated meanwhile is black
+static inline bool gc_heap_garbage(gc_heap* heap, gc_object* o){
+    return (__atomic_load_n(&(o->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_GARBAGE) ||
+           (__atomic_load_n(&heap->sweeping,__ATOMIC_RELAXED) && gc_color_is_silver_or_white(o));
+}
 
-    // check grey
-    o = grey;
-    while(o != null){
-        if(o == obj)
-            return true;
-        o = o->gc_next;
-    }
-    
-    // check black
-    for(uint8_t i = 0; i < conf.gens_count; ++i){
-        o = black[i];
-        while(o != null){
-            if(o == obj)
-                return true;
-            o = o->gc_next;
-        }
+// find object which memory contains address, null if there is none
+gc_object* gc_heap_lookup(gc_heap* heap, void* p){
+#ifdef GC_USE_MALLOC
+    // objects allocated with malloc aren't indexed, search every list
+    gc_object* o;
+    if((o = gc_list_lookup(heap->white,p)) != null ||
+       (o = gc_list_lookup(heap->silver,p)) != null ||
+       (o = gc_list_lookup(heap->grey,p)) != null)
+        return gc_heap_garbage(heap,o) ? null : o;
+    for(uint8_t i = 0; i < heap->conf.gens_count; ++i){
+        if((o = gc_list_lookup(heap->black[i],p)) != null)
+            return o;
     }
+    return null;
+#else
+    // pool page map finds allocated block, address might still point past object into slot padding
+    bool small;
+    void* block = gc_pool_lookup(&heap->pool,p,&small);
+    if(block == null)
+        return null;
+    // only large objects don't fit into single page slabs, their header follows prefix
+    gc_object* o = small ? (gc_object*)block : (gc_object*)(((gc_object_prefix*)block)+1);
+    if((char*)p >= ((char*)block) + gc_object_block_size(o))
+        return null;
+    // transparent objects are garbage waiting to be freed
+    if(gc_heap_garbage(heap,o))
+        return null;
+    return o;
+#endif
+}
 
-    return false;
+// find object which memory contains address on default heap
+gc_object* gc_lookup(void* p){
+    return gc_heap_lookup(&default_heap,p);
+}
+
+// check if object is managed by gc
+bool gc_heap_contains(gc_heap* heap, gc_object* obj){
+    return obj != null && gc_heap_lookup(heap,obj) == obj;
+}
+
+// check if object is managed by gc
+bool gc_contains(gc_object* obj){
+    return gc_heap_contains(&default_heap,obj);
 }
 
 // get current time in nano seconds
@@ -0,0 +1,305 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <time.h>
+
+// let mutators run between pauses of one cycle step that didn't fit into pause time
+static void gc_collector_yield(gc_heap* heap){
+    struct timespec t;
+    t.tv_sec = heap->conf.max_pause / 1000000000ull;
+    t.tv_nsec = heap->conf.max_pause % 1000000000ull;
+    nanosleep(&t,null);
+}
+
+// stop mutators and flush their allocations and logs
+static void gc_collector_pause_start(gc_heap* heap){
+    // only background collector stops the world while it's running
+    gc_heap_stop_world(heap,null);
+    gc_heap_flush_threads(heap);
+    gc_heap_apply_store_buffer(heap);
+    gc_pace_start(heap);
+}
+
+// resume mutators, returns pause duration
+static uint64_t gc_collector_pause_end(gc_heap* heap){
+    uint64_t duration = gc_pace_end(heap);
+    heap->conf.cycle_objects += heap->conf.cycle_threshold;
+    heap->conf.cycle_threshold = 0;
+    gc_heap_resume_world(heap);
+    return duration;
+}
+
+// mark concurrently with mutators until grey objects run out
+static void gc_collector_mark(gc_heap* heap){
+    heap->background = true;
+    do{
+        // shade objects mutators logged so far
+        gc_heap_apply_handoff(heap);
+        gc_heap_mark(heap);
+        gc_heap_mark_remembered(heap);
+    }while(heap->grey != null);
+    // time of concurrent phases ends here, pause starting next doesn't belong to them
+    gc_pace_phase(heap,GC_PACE_NONE);
+    heap->background = false;
+}
+
+// clear weak references to garbage and make it transparent while mutators run, they allocate black objects meanwhile
+static void gc_collector_sweep(gc_heap* heap){
+    heap->background = true;
+    gc_heap_clear_weak(heap);
+    // silver objects left aren't referenced either
+    gc_heap_whiten_silver(heap);
+    gc_heap_sweep(heap);
+    // time of concurrent phases ends here, pause starting next doesn't belong to them
+    gc_pace_phase(heap,GC_PACE_NONE);
+    heap->background = false;
+}
+
+// compact oldest generation in pauses, returns longest one
+static uint64_t gc_collector_compact(gc_heap* heap){
+    uint64_t pause, longest_pause = 0;
+    // collector thread is the only one starting compaction
+    if(!heap->compacting && !(heap->compaction && heap->compact_due))
+        return 0;
+    for(;;){
+        gc_collector_pause_start(heap);
+        bool done = gc_heap_compact(heap);
+        pause = gc_collector_pause_end(heap);
+        longest_pause = pause > longest_pause ? pause : longest_pause;
+        if(done)
+            return longest_pause;
+        gc_collector_yield(heap);
+    }
+}
+
+// run background cycle
+static void gc_collector_cycle(gc_heap* heap){
+    uint64_t pause = 0, longest_pause = 0;
+    heap->conf.cycle_threshold = 0;
+    heap->conf.cycle_objects = 0;
+    heap->conf.cycle_collected = 0;
+    heap->conf.cycle_remembered = 0;
+    heap->conf.cycle_compacted = 0;
+    heap->conf.cycle_overshoot = 0;
+    heap->conf.cycle_checks = 0;
+
+    // compaction started by stop the world collection is finished before snapshot is taken
+    longest_pause = gc_collector_compact(heap);
+
+    // initial pause, promote and refresh generations then take snapshot by starting to log overwritten references
+    for(;;){
+        gc_collector_pause_start(heap);
+        bool done = gc_heap_cleanup(heap) && gc_heap_promote(heap);
+        if(done){
+            // objects referenced from stacks are part of snapshot
+            gc_heap_scan_stacks(heap,false);
+            __atomic_store_n(&heap->marking,1,__ATOMIC_RELAXED);
+        }
+        pause = gc_collector_pause_end(heap);
+        longest_pause = pause > longest_pause ? pause : longest_pause;
+        if(done)
+            break;
+        gc_collector_yield(heap);
+    }
+
+    // mark objects reachable at the time of snapshot while mutators run
+    gc_collector_mark(heap);
+
+    // final pause, mark objects logged since then, objects allocated meanwhile are black already
+    for(;;){
+        gc_collector_pause_start(heap);
+        bool done = gc_heap_mark(heap) && gc_heap_mark_remembered(heap) && gc_heap_mark_ephemerons(heap);
+        if(done){
+            // snapshot is marked, white and silver objects are garbage, objects allocated from now on are black
+            // until sweep is done so it doesn't need mutators stopped
+            __atomic_store_n(&heap->sweeping,1,__ATOMIC_RELAXED);
+            __atomic_store_n(&heap->marking,0,__ATOMIC_RELAXED);
+#ifndef GC_USE_MALLOC
+            gc_pool_trim(&heap->pool);
+#endif
+        }
+        pause = gc_collector_pause_end(heap);
+        longest_pause = pause > longest_pause ? pause : longest_pause;
+        if(done)
+            break;
+        // too much left to mark during pause, continue concurrently
+        gc_collector_mark(heap);
+    }
+
+    // mutators can't reach garbage and lookups don't find it while sweep is in progress
+    gc_collector_sweep(heap);
+
+    // background sweeper frees garbage without pausing mutators
+    if(heap->transparent != null && heap->sweeper != null && gc_sweeper_submit(heap->sweeper,heap->transparent))
+        heap->transparent = null;
+
+    // sweep ends in pause once objects allocated during it are published black, garbage is flagged already,
+    // garbage sweeper didn't take is freed in pauses, finalizers and memory pool need mutators stopped
+    do{
+        gc_collector_pause_start(heap);
+        __atomic_store_n(&heap->sweeping,0,__ATOMIC_RELAXED);
+        gc_heap_cleanup(heap);
+        pause = gc_collector_pause_end(heap);
+        longest_pause = pause > longest_pause ? pause : longest_pause;
+        if(heap->transparent != null)
+            gc_collector_yield(heap);
+    }while(heap->transparent != null);
+
+    // objects are moved and references to them fixed in pauses, same as garbage is freed
+    pause = gc_collector_compact(heap);
+    longest_pause = pause > longest_pause ? pause : longest_pause;
+
+    pthread_mutex_lock(&heap->lock);
+    heap->conf.cycle_duration = longest_pause;
+    heap->conf.cycle_full = true;
+    gc_heap_large_stats(heap);
+    gc_stats_cycle(heap);
+    gc_trace(gc_trace_cycle(heap));
+    // background cycle went through every phase, increment of stop the world one left has nothing to continue
+    heap->cycle_phase = 0;
+    if(heap->tenuring)
+        gc_heap_tenure_adapt(heap);
+    heap->cycle_completed = heap->cycle_started;
+    pthread_cond_broadcast(&heap->cycle_cond);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// background collector thread
+static void* gc_collector_thread(void* arg){
+    gc_heap* heap = (gc_heap*)arg;
+    // object class callbacks need to know which heap is being collected
+    collecting_heap = heap;
+    pthread_mutex_lock(&heap->lock);
+    while(!heap->collector_shutdown){
+        // heap dump is taken between cycles while lists aren't changed concurrently
+        if(heap->dump_requested){
+            pthread_mutex_unlock(&heap->lock);
+            gc_heap_stop_world(heap,null);
+            heap->dump_error = gc_heap_dump_fork(heap,heap->dump_fd) ? 0 : errno;
+            heap->dump_requested = false;
+            pthread_cond_broadcast(&heap->cycle_cond);
+            gc_heap_resume_world(heap);
+            pthread_mutex_lock(&heap->lock);
+            continue;
+        }
+        if(!heap->cycle_requested){
+            if(heap->collector_interval == 0){
+                pthread_cond_wait(&heap->collector_cond,&heap->lock);
+            }else{
+                // start cycle on our own once interval passes
+                struct timespec t;
+                clock_gettime(CLOCK_REALTIME,&t);
+                uint64_t nanos = t.tv_nsec + heap->collector_interval;
+                t.tv_sec += nanos / 1000000000ull;
+                t.tv_nsec = nanos % 1000000000ull;
+                if(pthread_cond_timedwait(&heap->collector_cond,&heap->lock,&t) == ETIMEDOUT)
+                    heap->cycle_requested = true;
+            }
+            continue;
+        }
+        heap->cycle_requested = false;
+        heap->cycle_started += 1;
+        heap->conf.cycle_full = false;
+        pthread_mutex_unlock(&heap->lock);
+        gc_collector_cycle(heap);
+        pthread_mutex_lock(&heap->lock);
+    }
+    pthread_mutex_unlock(&heap->lock);
+    return null;
+}
+
+// run background cycle and wait for it to complete
+uint64_t gc_heap_collect_background(gc_heap* heap){
+    uint64_t start = get_nanotime();
+    gc_thread* t = gc_thread_find(heap);
+    if(t != null)
+        gc_thread_save_stack_here(t);
+    pthread_mutex_lock(&heap->lock);
+    // waiting thread doesn't touch heap, collector doesn't have to wait for it at safepoints
+    bool park = t != null && !t->safe_region;
+    if(park){
+        heap->threads_parked += 1;
+        pthread_cond_signal(&heap->parked_cond);
+    }
+    // cycle running already took it's snapshot, wait for the next one
+    uint64_t cycle = heap->cycle_started + 1;
+    heap->cycle_requested = true;
+    pthread_cond_signal(&heap->collector_cond);
+    while(heap->cycle_completed < cycle && heap->collector)
+        pthread_cond_wait(&heap->cycle_cond,&heap->lock);
+    if(park){
+        while(heap->safepoint)
+            pthread_cond_wait(&heap->resume_cond,&heap->lock);
+        heap->threads_parked -= 1;
+    }
+    pthread_mutex_unlock(&heap->lock);
+    return get_nanotime() - start;
+}
+
+// stop background collector thread
+void gc_heap_stop_collector(gc_heap* heap){
+    pthread_mutex_lock(&heap->lock);
+    heap->collector_shutdown = true;
+    pthread_cond_signal(&heap->collector_cond);
+    pthread_mutex_unlock(&heap->lock);
+    // collector finishes cycle in progress before exiting
+    pthread_join(heap->collector_thread,null);
+    pthread_mutex_lock(&heap->lock);
+    heap->collector = false;
+    heap->collector_shutdown = false;
+    heap->cycle_requested = false;
+    pthread_cond_broadcast(&heap->cycle_cond);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// enable or disable background collector, interval is time between cycles started automatically, 0 to start them by request only
+bool gc_heap_set_concurrent(gc_heap* heap, bool enabled, uint64_t interval){
+    if(heap->collector)
+        gc_heap_stop_collector(heap);
+    if(!enabled)
+        return true;
+    heap->collector_interval = interval;
+    if(pthread_create(&heap->collector_thread,null,&gc_collector_thread,heap) != 0){
+        errno = EAGAIN;
+        return false;
+    }
+    heap->collector = true;
+    return true;
+}
+
+// enable or disable background collector of default heap
+bool gc_set_concurrent(bool enabled, uint64_t interval){
+    return gc_heap_set_concurrent(gc_get_heap(),enabled,interval);
+}
+
+#ifdef __cplusplus
+}
+#endif
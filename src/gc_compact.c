@@ -0,0 +1,267 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <string.h>
+
+// list fixed by given step of fix phase, black lists are followed by white and grey ones
+static inline gc_object** gc_compact_fix_list(gc_heap* heap, uint8_t step){
+    if(step < heap->conf.gens_count)
+        return &(heap->black[step]);
+    return step == heap->conf.gens_count ? &heap->white : &heap->grey;
+}
+
+#ifndef GC_USE_MALLOC
+
+// check if object is old, not a root and lives in slab being evacuated
+static inline bool gc_compact_movable(gc_heap* heap, gc_object* obj){
+    return !(__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_FORWARDED) &&
+           gc_pool_evacuating(obj,gc_object_block_size(obj)) &&
+           gc_gen_num(obj) == heap->conf.gens_count-1 && gc_root_ref_count(obj) == 0;
+}
+
+// move object to dense slab, old copy forwards to new one until no reference points to it
+static gc_object* gc_compact_move(gc_heap* heap, gc_object* obj){
+    size_t size = gc_object_block_size(obj);
+    uint64_t bytes = heap->pool.slabs_bytes;
+    char* block = (char*)gc_pool_alloc(&heap->pool,size);
+    if(block == null)
+        return obj;
+    heap->compact_taken += heap->pool.slabs_bytes - bytes;
+    // large objects in spans are moved together with their prefix
+    memcpy(block,gc_object_block(obj),size);
+    gc_object* copy = (gc_object*)(block + ((char*)obj - (char*)gc_object_block(obj)));
+    // new copy takes old one's place in it's list
+    *(copy->gc_prev) = copy;
+    if(copy->gc_next != null)
+        copy->gc_next->gc_prev = &(copy->gc_next);
+    obj->gc_prev = (gc_object**)copy;
+    obj->gc_next = heap->forwarded;
+    heap->forwarded = obj;
+    gc_flag_set(obj,GC_FLAG_FORWARDED);
+    return copy;
+}
+
+// queue movable children of object, first reference is moved first
+static void gc_compact_push_children(gc_heap* heap, gc_object* obj){
+    gc_object** refs = (gc_object**)(obj+1); // start of refs array
+    const uint64_t* map;
+    for(uint32_t i = gc_object_refs(obj,&map); i > 0; --i){
+        if(!gc_refs_map_test(map,i-1))
+            continue;
+        gc_object* ref = refs[i-1];
+        if(ref == null || !gc_compact_movable(heap,ref))
+            continue;
+        if(heap->compact_stack_count == heap->compact_stack_size){
+            heap->compact_stack_size = heap->compact_stack_size == 0 ? 256 : heap->compact_stack_size*2;
+            heap->compact_stack = (gc_object**)realloc(heap->compact_stack,sizeof(gc_object*)*heap->compact_stack_size);
+        }
+        heap->compact_stack[heap->compact_stack_count++] = ref;
+    }
+}
+
+// move oldest generation objects out of sparse slabs in reference traversal order
+static bool gc_heap_compact_evacuate(gc_heap* heap){
+    uint8_t last = heap->conf.gens_count-1;
+    gc_pace_phase(heap,GC_PACE_EVACUATE);
+    for(;;){
+        // children of moved objects are moved right after them
+        while(heap->compact_stack_count > 0){
+            gc_object* obj = heap->compact_stack[--heap->compact_stack_count];
+            if(gc_compact_movable(heap,obj))
+                gc_compact_push_children(heap,gc_compact_move(heap,obj));
+            heap->conf.cycle_threshold += 1;
+            // check pause threshold
+            gc_cycle_check
+        }
+        // objects are taken off oldest generation list as they are visited, mutators might move them to grey list meanwhile
+        gc_object* obj = heap->black[last];
+        if(obj == null)
+            return true;
+        if(gc_compact_movable(heap,obj))
+            obj = gc_compact_move(heap,obj);
+        gc_list_move(obj,&(heap->compact_done[last]));
+        gc_compact_push_children(heap,obj);
+        heap->conf.cycle_threshold += 1;
+        // check pause threshold
+        gc_cycle_check
+    }
+}
+
+// fix references of every object, remembered set and weak objects entries to point to new copies
+static bool gc_heap_compact_fix(gc_heap* heap){
+    gc_pace_phase(heap,GC_PACE_FIX);
+    // objects allocated while objects were moved are white, mutators might move not yet fixed objects
+    // to grey list meanwhile, so it goes last
+    while(heap->compact_gen <= heap->conf.gens_count+1){
+        gc_object** list = gc_compact_fix_list(heap,heap->compact_gen);
+        while(*list != null){
+            gc_object* obj = *list;
+            gc_object** refs = (gc_object**)(obj+1); // start of refs array
+            const uint64_t* map;
+            uint32_t count = gc_object_refs(obj,&map);
+            for(uint32_t i = 0; i < count; ++i){
+                if(gc_refs_map_test(map,i))
+                    refs[i] = gc_object_forward(refs[i]);
+            }
+            gc_list_move(obj,&(heap->compact_done[heap->compact_gen]));
+            heap->conf.cycle_threshold += 1;
+            // check pause threshold
+            gc_cycle_check
+        }
+        heap->compact_gen += 1;
+    }
+    while(heap->compact_remset_index < heap->remset_count){
+        heap->remset[heap->compact_remset_index] = gc_object_forward(heap->remset[heap->compact_remset_index]);
+        heap->compact_remset_index += 1;
+        heap->conf.cycle_threshold += 1;
+        // check pause threshold
+        gc_cycle_check
+    }
+    while(heap->compact_weak_index < heap->weak_count){
+        heap->weak[heap->compact_weak_index] = gc_object_forward(heap->weak[heap->compact_weak_index]);
+        heap->compact_weak_index += 1;
+        heap->conf.cycle_threshold += 1;
+        // check pause threshold
+        gc_cycle_check
+    }
+    // fixed objects are put back to their lists
+    for(uint8_t i = 0; i <= heap->conf.gens_count+1; ++i){
+        if(heap->compact_done[i] != null)
+            gc_list_move_all(&(heap->compact_done[i]),gc_compact_fix_list(heap,i));
+    }
+    return true;
+}
+
+// free old copies of moved objects
+static bool gc_heap_compact_free_copies(gc_heap* heap){
+    gc_pace_phase(heap,GC_PACE_FREE);
+    while(heap->forwarded != null){
+        gc_object* obj = heap->forwarded;
+        heap->forwarded = obj->gc_next;
+        uint64_t bytes = heap->pool.slabs_bytes;
+        gc_pool_free(&heap->pool,gc_object_block(obj),gc_object_block_size(obj));
+        heap->compact_released += bytes - heap->pool.slabs_bytes;
+        heap->conf.cycle_threshold += 1;
+        // check pause threshold
+        gc_cycle_check
+    }
+    return true;
+}
+
+#endif
+
+// compact oldest generation
+bool gc_heap_compact(gc_heap* heap){
+#ifndef GC_USE_MALLOC
+    if(heap->compacting == GC_COMPACT_NONE){
+        // objects die in oldest generation only when it's refreshed
+        if(!heap->compaction || !heap->compact_due || heap->conservative)
+            return true;
+        heap->compact_due = false;
+        if(gc_pool_evacuate_begin(&heap->pool,GC_COMPACT_MIN_SLABS) == 0)
+            return true;
+        heap->compact_taken = heap->compact_released = 0;
+        __atomic_store_n(&heap->compacting,GC_COMPACT_EVACUATE,__ATOMIC_RELAXED);
+    }
+    if(heap->compacting == GC_COMPACT_EVACUATE){
+        if(!gc_heap_compact_evacuate(heap))
+            return false;
+        // visited objects go back to oldest generation, now every object has to be fixed
+        if(heap->compact_done[heap->conf.gens_count-1] != null)
+            gc_list_move_all(&(heap->compact_done[heap->conf.gens_count-1]),&(heap->black[heap->conf.gens_count-1]));
+        heap->compact_gen = 0;
+        heap->compact_remset_index = 0;
+        heap->compact_weak_index = 0;
+        heap->compacting = GC_COMPACT_FIX;
+    }
+    if(heap->compacting == GC_COMPACT_FIX){
+        if(!gc_heap_compact_fix(heap))
+            return false;
+        heap->compacting = GC_COMPACT_FREE;
+    }
+    if(!gc_heap_compact_free_copies(heap))
+        return false;
+    // objects left in sparse slabs are allocated around again
+    gc_pool_evacuate_end(&heap->pool);
+    if(heap->compact_released > heap->compact_taken){
+        heap->conf.cycle_compacted = heap->compact_released - heap->compact_taken;
+        gc_stats_add(heap->stats.compacted_bytes,heap->conf.cycle_compacted);
+    }
+    __atomic_store_n(&heap->compacting,GC_COMPACT_NONE,__ATOMIC_RELAXED);
+#endif
+    return true;
+}
+
+// free compaction state of destroyed heap
+void gc_heap_compact_free(gc_heap* heap){
+    if(heap->compact_done != null){
+        for(uint8_t i = 0; i <= heap->conf.gens_count+1; ++i){
+            if(heap->compact_done[i] != null)
+                gc_list_move_all(&(heap->compact_done[i]),gc_compact_fix_list(heap,i));
+        }
+        free(heap->compact_done);
+        heap->compact_done = null;
+    }
+    // old copies are memory of pool only, they are gone with it
+    heap->forwarded = null;
+    free(heap->compact_stack);
+    heap->compact_stack = null;
+    heap->compact_stack_count = heap->compact_stack_size = 0;
+}
+
+// enable or disable compaction of oldest generation
+bool gc_heap_set_compaction(gc_heap* heap, bool enabled){
+#ifdef GC_USE_MALLOC
+    if(enabled){
+        errno = ENOTSUP;
+        return false;
+    }
+#else
+    if(enabled && heap->compact_done == null){
+        heap->compact_done = (gc_object**)calloc(heap->conf.gens_count+2,sizeof(gc_object*));
+        if(heap->compact_done == null){
+            errno = ENOMEM;
+            return false;
+        }
+    }
+#endif
+    // compaction in progress is still finished
+    heap->compaction = enabled;
+    return true;
+}
+
+// enable or disable compaction of oldest generation of default heap
+bool gc_set_compaction(bool enabled){
+    return gc_heap_set_compaction(gc_get_heap(),enabled);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,241 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// buffered writer of dump process, it only writes to file descriptor so it's safe in child of threaded process
+typedef struct {
+    int fd;
+    char* buf;
+    size_t count;
+    int error; // errno of first failed write, nothing is written after it
+    uint64_t objects; // number of object records written
+} gc_dump_writer;
+
+// write out buffered bytes
+static void gc_dump_flush(gc_dump_writer* w){
+    size_t done = 0;
+    while(done < w->count && w->error == 0){
+        ssize_t n = write(w->fd,w->buf+done,w->count-done);
+        if(n > 0)
+            done += n;
+        else if(n == 0 || errno != EINTR)
+            w->error = n == 0 ? EIO : errno;
+    }
+    w->count = 0;
+}
+
+// buffer bytes, buffer is written out once it's full
+static void gc_dump_write(gc_dump_writer* w, const void* p, size_t size){
+    while(size > 0){
+        size_t n = GC_DUMP_BUFFER_SIZE - w->count;
+        n = n < size ? n : size;
+        memcpy(w->buf+w->count,p,n);
+        w->count += n;
+        p = ((const char*)p) + n;
+        size -= n;
+        if(w->count == GC_DUMP_BUFFER_SIZE)
+            gc_dump_flush(w);
+    }
+}
+
+// write record of every object in list, references to moved objects are written as their new copies
+static void gc_dump_list(gc_heap* heap, gc_dump_writer* w, gc_object* list){
+    for(gc_object* obj = list; obj != null && w->error == 0; obj = obj->gc_next){
+        gc_object** refs = (gc_object**)(obj+1); // start of refs array
+        const uint64_t* map;
+        uint32_t count = gc_object_refs(obj,&map);
+        gc_dump_object rec;
+        memset(&rec,0,sizeof(rec));
+        rec.kind = GC_DUMP_OBJECT;
+        rec.gen = gc_gen_num(obj);
+        rec.color = gc_color(obj);
+        rec.flags = (obj->gc_flags & GC_FLAG_WEAK ? GC_DUMP_WEAK : 0) | (obj->gc_flags & GC_FLAG_EPHEMERON ? GC_DUMP_WEAK_TABLE : 0);
+        rec.roots = gc_root_ref_count(obj);
+        rec.address = (uintptr_t)obj;
+        rec.class = (uintptr_t)obj->class;
+        rec.size = gc_object_block_reserved(obj);
+        for(uint32_t i = 0; i < count; ++i){
+            if(gc_refs_map_test(map,i) && refs[i] != null)
+                rec.refs_count += 1;
+        }
+        gc_dump_write(w,&rec,sizeof(rec));
+        for(uint32_t i = 0; i < count; ++i){
+            if(!gc_refs_map_test(map,i) || refs[i] == null)
+                continue;
+            // only compaction leaves references to old copies, other references might point to freed garbage
+            uint64_t ref = (uintptr_t)(heap->compacting ? gc_object_forward(refs[i]) : refs[i]);
+            gc_dump_write(w,&ref,sizeof(ref));
+        }
+        w->objects += 1;
+    }
+}
+
+// write snapshot of heap, runs in forked process
+static void gc_dump_heap(gc_heap* heap, gc_dump_writer* w){
+    gc_dump_header header;
+    memset(&header,0,sizeof(header));
+    strcpy(header.magic,GC_DUMP_MAGIC);
+    header.version = GC_DUMP_VERSION;
+    header.gens_count = heap->conf.gens_count;
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME,&t);
+    header.time = ((uint64_t)t.tv_sec)*1000000000ull + t.tv_nsec;
+    gc_dump_write(w,&header,sizeof(header));
+    // transparent objects are garbage being freed, old copies of moved objects aren't listed either
+    // white objects sweep didn't get to yet are garbage as well
+    if(!heap->sweeping)
+        gc_dump_list(heap,w,heap->white);
+    gc_dump_list(heap,w,heap->silver);
+    gc_dump_list(heap,w,heap->grey);
+    for(uint8_t i = 0; i < heap->conf.gens_count; ++i)
+        gc_dump_list(heap,w,heap->black[i]);
+    gc_dump_list(heap,w,heap->allocated);
+    if(heap->compact_done != null){
+        for(uint8_t i = 0; i <= heap->conf.gens_count+1; ++i)
+            gc_dump_list(heap,w,heap->compact_done[i]);
+    }
+    // objects attached threads didn't publish yet
+    for(gc_thread* t = heap->threads; t != null; t = t->next)
+        gc_dump_list(heap,w,t->white);
+    gc_dump_end end;
+    memset(&end,0,sizeof(end));
+    end.kind = GC_DUMP_END;
+    end.objects = w->objects;
+    gc_dump_write(w,&end,sizeof(end));
+    gc_dump_flush(w);
+}
+
+// fork process writing snapshot of heap to file descriptor, world has to be stopped
+bool gc_heap_dump_fork(gc_heap* heap, int fd){
+    // child of threaded process shouldn't allocate, it gets buffer allocated before fork
+    char* buf = (char*)malloc(GC_DUMP_BUFFER_SIZE);
+    if(buf == null){
+        errno = ENOMEM;
+        return false;
+    }
+    pid_t pid = fork();
+    if(pid == 0){
+        gc_dump_writer w = {fd, buf, 0, 0, 0};
+        gc_dump_heap(heap,&w);
+        _exit(w.error);
+    }
+    int error = errno;
+    free(buf);
+    if(pid < 0){
+        errno = error;
+        return false;
+    }
+    heap->dump_pid = pid;
+    return true;
+}
+
+// dump heap, background collector takes dump between cycles while caller waits
+bool gc_heap_dump(gc_heap* heap, int fd){
+    if(heap->collector){
+        // waiting thread doesn't touch heap, collector doesn't have to wait for it
+        gc_heap_safe_region_enter(heap);
+        pthread_mutex_lock(&heap->lock);
+        bool busy = heap->dump_pid != 0 || heap->dump_requested;
+        if(!busy){
+            heap->dump_fd = fd;
+            heap->dump_error = 0;
+            heap->dump_requested = true;
+            pthread_cond_signal(&heap->collector_cond);
+            while(heap->dump_requested && heap->collector)
+                pthread_cond_wait(&heap->cycle_cond,&heap->lock);
+        }
+        // collector stopped before it got to dump
+        int error = busy ? EBUSY : heap->dump_requested ? EAGAIN : heap->dump_error;
+        heap->dump_requested = false;
+        pthread_mutex_unlock(&heap->lock);
+        gc_heap_safe_region_leave(heap);
+        if(error != 0){
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+    // stop the world, other thread might be collecting
+    while(!gc_heap_stop_world(heap,gc_thread_find(heap)));
+    if(heap->dump_pid != 0){
+        gc_heap_resume_world(heap);
+        errno = EBUSY;
+        return false;
+    }
+    bool done = gc_heap_dump_fork(heap,fd);
+    int error = errno;
+    gc_heap_resume_world(heap);
+    errno = error;
+    return done;
+}
+
+// dump default heap
+bool gc_dump(int fd){
+    return gc_heap_dump(gc_get_heap(),fd);
+}
+
+// wait until last dump of heap is written
+bool gc_heap_dump_wait(gc_heap* heap){
+    pthread_mutex_lock(&heap->lock);
+    pid_t pid = heap->dump_pid;
+    pthread_mutex_unlock(&heap->lock);
+    if(pid == 0){
+        errno = ECHILD;
+        return false;
+    }
+    gc_heap_safe_region_enter(heap);
+    int status;
+    pid_t waited;
+    while((waited = waitpid(pid,&status,0)) < 0 && errno == EINTR);
+    // dump process exits with errno of failed write, killed one didn't write everything either
+    int error = waited < 0 ? errno : !WIFEXITED(status) ? EIO : WEXITSTATUS(status);
+    gc_heap_safe_region_leave(heap);
+    pthread_mutex_lock(&heap->lock);
+    heap->dump_pid = 0;
+    pthread_mutex_unlock(&heap->lock);
+    if(error != 0){
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+// wait until last dump of default heap is written
+bool gc_dump_wait(){
+    return gc_heap_dump_wait(gc_get_heap());
+}
+
+#ifdef __cplusplus
+}
+#endif
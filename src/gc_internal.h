@@ -0,0 +1,728 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef GC_INTERNAL_H
+#define GC_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc.h"
+#include "gc_pool.h"
+#include <malloc.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/types.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef GC_CHECKED
+#include <stdio.h>
+#include <stdlib.h>
+
+// abort on invalid argument, pointer checks are cheap with pool page map
+#define gc_check(cond,msg,p) \
+    if(!(cond)){ \
+        fprintf(stderr,"simplegc: %s: %p\n",msg,(void*)(p)); \
+        abort(); \
+    }
+#endif
+
+#define WHITE 0
+#define GREY  1
+#define BLACK 2
+#define SILVER 3
+
+// number of objects attached thread allocates before publishing them to heap white list
+#define GC_THREAD_PUBLISH_BATCH 256
+// number of operations attached thread logs during background marking before handing them to collector
+#define GC_THREAD_HANDOFF_BATCH 256
+
+// bytes of parking function frame saved for conservative stack scan
+#define GC_THREAD_FRAME_SIZE 1024
+
+// number of sparse slabs needed for old generation compaction to start
+#define GC_COMPACT_MIN_SLABS 16
+
+// old generation compaction phases
+#define GC_COMPACT_NONE 0 // not compacting
+#define GC_COMPACT_EVACUATE 1 // moving objects out of sparse slabs
+#define GC_COMPACT_FIX 2 // fixing references to moved objects
+#define GC_COMPACT_FREE 3 // freeing old copies of moved objects
+
+// adaptive tenuring
+#define GC_TENURE_MAX_AGE 15 // highest tenure age
+#define GC_TENURE_INITIAL_AGE 2 // tenure age generations start with
+#define GC_TENURE_RANGE 8 // adapted refresh interval stays within this many times of initial one
+#define GC_TENURE_MIN_SAMPLE 64 // refreshed objects needed to adapt generation
+#define GC_TENURE_HIGH_SURVIVAL 90 // survival rate in percent above which generation is refreshed less often
+#define GC_TENURE_LOW_SURVIVAL 50 // survival rate in percent below which generation is refreshed more often
+
+// pause scheduler
+#define GC_PACE_RATE_SHIFT 8 // fractional bits of measured time per unit of work
+#define GC_PACE_RATE_WEIGHT 4 // new sample weighs 1/GC_PACE_RATE_WEIGHT of measured time per unit
+#define GC_PACE_MAX_INTERVAL (1u << 24) // most units of work done between pause checks
+#define GC_CLOCK_CALIBRATION 10000000ull // nanoseconds time stamp counter is measured for
+
+// pause scheduler phases, time per unit of work is measured for each
+#define GC_PACE_NONE 0 // outside of phases
+#define GC_PACE_CLEANUP 1 // freeing transparent objects
+#define GC_PACE_PROMOTE 2 // promoting generations
+#define GC_PACE_MARK 3 // marking grey objects
+#define GC_PACE_REMEMBERED 4 // scanning remembered set
+#define GC_PACE_WHITEN 5 // marking silver objects white
+#define GC_PACE_SWEEP 6 // making white objects transparent
+#define GC_PACE_EVACUATE 7 // moving objects out of sparse slabs
+#define GC_PACE_FIX 8 // fixing references to moved objects
+#define GC_PACE_FREE 9 // freeing old copies of moved objects
+#define GC_PACE_WEAK 10 // clearing weak references to garbage
+#define GC_PACE_REFRESH 11 // refreshing generations
+#define GC_PACE_PHASES 12
+
+// tracing
+#define GC_TRACE_EVENTS 65536 // default number of events ring holds
+#define GC_TRACE_BEGIN 'B' // phase or pause began
+#define GC_TRACE_END 'E' // phase or pause ended
+#define GC_TRACE_INSTANT 'i' // full cycle completed
+#define GC_TRACE_PAUSE GC_PACE_PHASES // event name of pause, phases are named by their pause scheduler phase
+#define GC_TRACE_CYCLE (GC_PACE_PHASES+1) // event name of full cycle
+
+// heap dump
+#define GC_DUMP_BUFFER_SIZE (1 << 20) // bytes dump process buffers before writing them
+
+// mark prefetching
+#define GC_MARK_PREFETCH 8 // default number of references queued while headers of objects they point to are prefetched
+#define GC_MARK_PREFETCH_MAX 32 // size of mark queue, power of 2
+
+// mutator log entry tags, kept in low bits of logged object pointer
+#define GC_LOG_SHADE 0 // mark object grey if it's white or silver
+#define GC_LOG_RESCAN 1 // mark object grey if it's black
+#define GC_LOG_REMEMBER 2 // add object to remembered set if it's black
+#define GC_LOG_WEAK 3 // add weak object to heap weak objects
+#define GC_LOG_TAG_MASK ((uintptr_t)3)
+
+// parallel marker and it's workers
+typedef struct gc_marker_t gc_marker;
+typedef struct gc_mark_worker_t gc_mark_worker;
+
+// background sweeper
+typedef struct gc_sweeper_t gc_sweeper;
+
+// reference read by mark loop, it's shaded once header of object it points to is prefetched
+typedef struct {
+    gc_object* ref;
+    gc_object* holder; // object reference was read from
+} gc_mark_pending;
+
+// ring of references read by mark loop and not shaded yet
+typedef struct {
+    gc_mark_pending refs[GC_MARK_PREFETCH_MAX];
+    uint32_t head;
+    uint32_t tail;
+} gc_mark_queue;
+
+// cumulative statistics, read by any thread without lock
+// counters are written by collecting thread unless noted otherwise, each by one thread at a time
+typedef struct {
+    uint64_t cycles; // number of full cycles
+    uint64_t pauses; // number of pauses
+    uint64_t pause_time; // total pause time
+    uint64_t pause_max; // longest pause
+    uint64_t pause_histogram[GC_STATS_PAUSE_BUCKETS]; // number of pauses by duration
+    uint64_t phase_time[GC_PACE_PHASES]; // time spent in each pause scheduler phase
+    uint64_t phase_start; // time current phase started at
+    uint64_t compacted_bytes; // pool memory reclaimed by compaction
+    uint64_t rate_bytes; // bytes allocated until last full cycle
+    uint64_t rate_time; // time of last full cycle
+    uint64_t allocation_rate; // bytes allocated per second between last two full cycles
+    // written by thread allocating from heap while it's not attached
+    uint64_t allocated_objects;
+    uint64_t allocated_bytes;
+    // written by attached threads publishing their objects, heap lock held
+    uint64_t published_objects;
+    uint64_t published_bytes;
+    // generation holds objects that entered it minus those promoted out of it and freed
+    uint64_t promoted_objects[GC_STATS_GENS];
+    uint64_t promoted_bytes[GC_STATS_GENS];
+    uint64_t freed_objects[GC_STATS_GENS];
+    uint64_t freed_bytes[GC_STATS_GENS];
+    // written by sweeper thread
+    uint64_t swept_objects[GC_STATS_GENS];
+    uint64_t swept_bytes[GC_STATS_GENS];
+} gc_heap_stats;
+
+// add to statistics counter, store is atomic so readers never see it torn
+#define gc_stats_add(counter,value) __atomic_store_n(&(counter),(counter)+(value),__ATOMIC_RELAXED)
+
+// mutator thread attached to heap
+typedef struct gc_thread_t {
+    gc_heap* heap; // heap thread is attached to
+    struct gc_thread_t* next; // next thread attached to same heap
+    struct gc_thread_t* local_next; // next attachment of the same thread to other heap
+    // objects allocated by thread not yet published to heap white list
+    gc_object* white;
+    gc_object* white_tail;
+    uint32_t white_count;
+    uint64_t white_bytes;
+    // operations on shared heap lists deferred until next collection
+    uintptr_t* log;
+    uint32_t log_count;
+    uint32_t log_size;
+    bool safe_region; // thread is inside safe region
+    // stack and registers saved when thread stopped touching heap, read by conservative stack scan
+    char* stack_base; // highest stack address
+    char* stack_top; // lowest stack address in use by thread's callers
+    ucontext_t registers;
+    char frame[GC_THREAD_FRAME_SIZE]; // copy of parking function frame
+    uint32_t frame_size;
+#ifndef GC_USE_MALLOC
+    gc_pool_slab* slabs[GC_POOL_CLASSES]; // pool slabs owned by thread
+#endif
+} gc_thread;
+
+// gc heap
+struct gc_heap_t {
+    // gc configuration
+    gc_config conf;
+    // gc list variables
+    gc_object* transparent;
+    gc_object* white;
+    gc_object* silver;
+    gc_object* grey;
+    gc_object** black;
+    // remembered set of black objects that might reference objects from other generations
+    gc_object** remset;
+    uint32_t remset_count;
+    uint32_t remset_size;
+    // remembered set detached for scanning during mark silver phase
+    gc_object** remset_scan;
+    uint32_t remset_scan_count;
+    uint32_t remset_scan_index;
+    // remembered set was fully scanned for current silver objects
+    bool remset_scanned;
+    // weak objects and weak tables, their references to garbage are cleared before it's swept
+    gc_object** weak;
+    uint32_t weak_count;
+    uint32_t weak_size;
+    uint32_t weak_index; // weak objects scanned so far by ephemeron phase
+    bool weak_shaded; // ephemeron phase shaded values during current scan
+    // incremental cycle state, kept between increments so sliced cycle always makes progress
+    uint8_t cycle_phase; // phase previous increment stopped in
+    bool promoting; // promotion phase is in progress
+    uint8_t promote_gen; // generation being promoted or refreshed
+    bool promote_refresh; // promotion of promote_gen is done, it's being refreshed
+    uint64_t promote_time; // time promotion phase started at
+#ifndef GC_USE_MALLOC
+    // gc object memory pool
+    gc_pool pool;
+    // pool slabs owned by heap, objects are allocated from them while no thread is attached
+    gc_pool_slab* slabs[GC_POOL_CLASSES];
+#endif
+    // attached mutator threads
+    pthread_mutex_t lock; // protects threads list, memory pool and heap lists while threads are attached
+    pthread_cond_t parked_cond; // signaled when thread parks at safepoint or enters safe region
+    pthread_cond_t resume_cond; // signaled when collection is done and parked threads can resume
+    gc_thread* threads; // attached threads list
+    uint32_t threads_count; // number of attached threads
+    uint32_t threads_parked; // number of threads parked at safepoint or inside safe region
+    int safepoint; // collection in progress, attached threads should park at safepoint
+    // operations logged by detached threads or handed to collector during background marking
+    uintptr_t* log;
+    uint32_t log_count;
+    uint32_t log_size;
+    // store buffer, black objects stored into by threads not attached to heap are rescanned at next collection
+    bool store_buffering;
+    gc_object** store_buffer;
+    uint32_t store_buffer_count;
+    uint32_t store_buffer_size;
+    // parallel marker, null when marking on collecting thread only
+    gc_marker* marker;
+    // mark prefetching
+    uint32_t mark_prefetch; // number of references read ahead of shading them, 0 shades them right away
+    gc_mark_queue mark_queue; // references read by collecting thread, empty between increments
+    // objects shaded by collecting thread while their list neighbours are prefetched, moved to grey list after
+    gc_object* mark_shaded[GC_MARK_PREFETCH_MAX];
+    uint32_t mark_shaded_head;
+    uint32_t mark_shaded_tail;
+    // background collector
+    bool collector; // background collector thread is running
+    bool collector_shutdown; // background collector thread should exit
+    pthread_t collector_thread;
+    pthread_cond_t collector_cond; // signaled when cycle is requested or collector should exit
+    pthread_cond_t cycle_cond; // signaled when background cycle completes
+    uint64_t collector_interval; // nanoseconds between automatically started cycles, 0 if started only by request
+    bool cycle_requested; // collection was requested
+    uint64_t cycle_started; // number of started background cycles
+    uint64_t cycle_completed; // number of completed background cycles
+    int marking; // background marking in progress, barrier logs overwritten references
+    int sweeping; // sweep in progress, objects are allocated black so white and silver ones are garbage
+    bool background; // collector runs concurrently with mutators, pause time doesn't apply
+    // objects allocated black during background marking or sweep, moved to first generation at next pause
+    gc_object* allocated;
+    gc_object* allocated_tail;
+    // background sweeper, null when garbage is freed by collecting thread
+    gc_sweeper* sweeper;
+    bool conservative; // thread stacks and registers are scanned for roots
+    // old generation compaction
+    bool compaction; // oldest generation is compacted after full cycles that refreshed it
+    bool compact_due; // oldest generation was refreshed since last compaction
+    int compacting; // compaction phase in progress, barrier forwards references to moved objects
+    gc_object** compact_stack; // objects to move next, children are moved right after their parents
+    uint32_t compact_stack_count;
+    uint32_t compact_stack_size;
+    gc_object** compact_done; // objects already visited by current phase per black list followed by white and grey
+    uint8_t compact_gen; // list being fixed
+    uint32_t compact_remset_index; // remembered set entries fixed so far
+    uint32_t compact_weak_index; // weak objects entries fixed so far
+    gc_object* forwarded; // old copies of moved objects
+    uint64_t compact_taken; // bytes of slabs taken for moved objects
+    uint64_t compact_released; // bytes of slabs emptied by compaction
+    // adaptive tenuring
+    bool tenuring; // objects are promoted by age and generations are tuned after full cycles
+    uint64_t tenure_max_growth; // oldest generation growth limit in objects per second
+    uint64_t tenure_time; // time of last adaptation
+    int64_t tenure_growth; // oldest generation growth in objects since last adaptation
+    // pause scheduler
+    uint8_t pace_phase; // phase work is counted for
+    uint32_t pace_next; // cycle_threshold at which pause time is checked next
+    uint32_t pace_units; // cycle_threshold at last time sample
+    uint64_t pace_time; // time of last sample
+    uint64_t pace_coarse; // coarse clock time of pause start
+    uint64_t pace_rate[GC_PACE_PHASES]; // measured time per unit of work of each phase, fixed point
+    // telemetry
+    gc_heap_stats stats;
+    // heap dump
+    pid_t dump_pid; // process writing last dump, 0 once it was waited for
+    bool dump_requested; // background collector should take dump between cycles
+    int dump_fd; // file descriptor requested dump is written to
+    int dump_error; // errno of dump background collector failed to take, 0 if it succeeded
+#ifdef GC_TRACE
+    // units of work done by cycle when current phase and pause began
+    uint64_t trace_phase_work;
+    uint64_t trace_pause_work;
+#endif
+};
+
+// attachments of current thread to heaps
+extern __thread gc_thread* local_threads;
+
+// heap being collected by current thread, used by object class callbacks
+extern __thread gc_heap* collecting_heap;
+
+// mark worker of current thread while marking in parallel
+extern __thread gc_mark_worker* local_mark_worker;
+
+// run gc cycle on heap, all attached threads must be parked
+uint64_t gc_heap_cycle(gc_heap* heap);
+
+// gc cycle phases, each returns false if pause time ran out before phase was done
+bool gc_heap_cleanup(gc_heap* heap); // free transparent objects
+bool gc_heap_promote(gc_heap* heap); // promote and refresh generations
+bool gc_heap_mark(gc_heap* heap); // mark grey objects
+bool gc_heap_mark_remembered(gc_heap* heap); // mark silver objects referenced from remembered objects
+bool gc_heap_whiten_silver(gc_heap* heap); // mark rest of silver objects white
+bool gc_heap_sweep(gc_heap* heap); // make white objects transparent
+
+// stop the world, returns with heap lock held once all other attached threads are parked
+// returns false without lock if other thread stopped the world already, after waiting for it to resume
+bool gc_heap_stop_world(gc_heap* heap, gc_thread* self);
+
+// resume parked threads and release heap lock
+void gc_heap_resume_world(gc_heap* heap);
+
+// park attached thread until collection is done
+void gc_thread_park(gc_thread* t);
+
+// allocate memory for object from thread owned pool slabs
+gc_object* gc_thread_allocate(gc_thread* t, uint32_t refs_count);
+
+// publish objects allocated by thread to heap white list, heap lock must be held
+void gc_thread_publish(gc_thread* t);
+
+// hand logged operations over to heap log, heap lock must be held
+void gc_thread_handoff(gc_thread* t);
+
+// publish objects and apply logs of all attached threads, all attached threads must be parked
+void gc_heap_flush_threads(gc_heap* heap);
+
+// rescan black objects logged into store buffer since previous collection
+void gc_heap_apply_store_buffer(gc_heap* heap);
+
+// mark values of weak table pairs which keys were marked after their table
+bool gc_heap_mark_ephemerons(gc_heap* heap);
+
+// clear weak references to silver and white objects, weak objects that are garbage themselves are forgotten
+void gc_heap_clear_weak(gc_heap* heap);
+
+// apply operations handed over to heap log
+void gc_heap_apply_handoff(gc_heap* heap);
+
+// run background cycle and wait for it to complete
+uint64_t gc_heap_collect_background(gc_heap* heap);
+
+// stop background collector thread
+void gc_heap_stop_collector(gc_heap* heap);
+
+// mark all grey objects in parallel, returns false if pause time ran out
+bool gc_marker_run(gc_marker* m);
+
+// stop helper workers and free marker
+void gc_marker_destroy(gc_marker* m);
+
+// get highest address of current thread stack
+char* gc_stack_base();
+
+// save registers and end of stack of thread that stops touching heap, top is stack pointer of caller's caller
+void gc_thread_save_stack(gc_thread* t, char* top);
+
+// save stack for conservative scan in function attached thread parks or waits in
+#define gc_thread_save_stack_here(t) \
+    if((t)->heap->conservative) \
+        gc_thread_save_stack(t,((char*)__builtin_frame_address(0)) + 2*sizeof(void*))
+
+// shade objects referenced from stacks and registers of mutator threads, self scans current thread too
+void gc_heap_scan_stacks(gc_heap* heap, bool self);
+
+// compact oldest generation, returns false if pause time ran out before compaction was done
+bool gc_heap_compact(gc_heap* heap);
+
+// free compaction state of destroyed heap, objects it holds are put back to heap lists
+void gc_heap_compact_free(gc_heap* heap);
+
+// tune refresh intervals and tenure ages by survival rates since last full cycle
+void gc_heap_tenure_adapt(gc_heap* heap);
+
+// get current time in nanoseconds from time source selected for pause checks
+uint64_t gc_clock_now();
+
+// start pause, time is measured from now
+void gc_pace_start(gc_heap* heap);
+
+// end pause, returns it's duration
+uint64_t gc_pace_end(gc_heap* heap);
+
+// count following units of work for given phase and measure time per unit of previous one
+void gc_pace_switch(gc_heap* heap, uint8_t phase);
+
+// check pause time, false if it ran out or next unit of work wouldn't fit into it anymore
+bool gc_pace_check(gc_heap* heap);
+
+// number of units of work of current phase expected to fit into given time
+uint32_t gc_pace_interval(gc_heap* heap, uint64_t time);
+
+// time elapsed since pause start, given number of units of current phase were done since last sample
+uint64_t gc_pace_elapsed(gc_heap* heap, uint32_t units);
+
+// add time since current phase started to it's stats, next phase starts now
+void gc_stats_phase_end(gc_heap* heap, uint64_t now);
+
+// count pause of given duration into stats
+void gc_stats_pause(gc_heap* heap, uint64_t duration);
+
+// count full cycle into stats and measure allocation rate since previous one
+void gc_stats_cycle(gc_heap* heap);
+
+// fork process writing snapshot of heap to file descriptor, world has to be stopped
+// returns false and sets errno if process can't be forked
+bool gc_heap_dump_fork(gc_heap* heap, int fd);
+
+#ifdef GC_TRACE
+// tracing enabled
+extern int gc_trace_enabled;
+
+// trace end of current phase and beginning of given one
+void gc_trace_phase(gc_heap* heap, uint8_t phase);
+
+// trace beginning of pause
+void gc_trace_pause_begin(gc_heap* heap);
+
+// trace end of pause together with phase it ended in
+void gc_trace_pause_end(gc_heap* heap);
+
+// trace completion of full cycle
+void gc_trace_cycle(gc_heap* heap);
+
+// run trace point if tracing is enabled, costs single load and branch otherwise
+#define gc_trace(point) \
+    do{ \
+        if(__atomic_load_n(&gc_trace_enabled,__ATOMIC_RELAXED)) \
+            point; \
+    }while(0)
+#else
+#define gc_trace(point) do{}while(0)
+#endif
+
+// queue detached transparent list for sweeping, returns false if queue is full and policy is to sweep inline
+bool gc_sweeper_submit(gc_sweeper* s, gc_object* list);
+
+// sweep queued lists, stop sweeper thread and free it
+void gc_sweeper_destroy(gc_sweeper* s);
+
+// mark grey object black on worker thread, object stays in it's current list until run ends
+void gc_mark_worker_mark_black(gc_mark_worker* w, gc_object* obj);
+
+// find current thread attachment to heap, null if not attached
+static inline gc_thread* gc_thread_find(gc_heap* heap){
+    gc_thread* t = local_threads;
+    while(t != null && t->heap != heap)
+        t = t->local_next;
+    return t;
+}
+
+// park at safepoint if collection was requested
+static inline void gc_thread_poll(gc_thread* t){
+    if(__atomic_load_n(&t->heap->safepoint,__ATOMIC_ACQUIRE))
+        gc_thread_park(t);
+}
+
+// count following units of work for given phase
+static inline void gc_pace_phase(gc_heap* heap, uint8_t phase){
+    if(heap->pace_phase != phase)
+        gc_pace_switch(heap,phase);
+}
+
+// check pause time once scheduler expects enough of it passed, returns false from phase when it ran out
+#define gc_cycle_check \
+    if(heap->conf.cycle_threshold >= heap->pace_next){ \
+        if(!gc_pace_check(heap)){ \
+            return false; \
+        } \
+    }
+
+#define gc_cycle_check_no_return \
+    if(heap->conf.cycle_threshold >= heap->pace_next){ \
+        if(!gc_pace_check(heap)){ \
+            return; \
+        } \
+    }
+
+// large object, it's memory block starts with prefix followed by header, large objects are exactly those
+// not fitting into single page pool slabs so pool lookup knows which blocks have prefix
+typedef struct {
+    uint32_t refs_count; // number of references
+    uint32_t scan; // number of references marked by increment that ran out of pause time before finishing object
+} gc_object_prefix;
+#define GC_OBJECT_LARGE_REFS ((GC_POOL_MAX_SIZE - sizeof(gc_object))/sizeof(gc_object*) + 1)
+#define gc_object_large(o) ((o)->refs_count >= GC_OBJECT_LARGE_REFS)
+#define gc_object_prefix_of(o) (((gc_object_prefix*)(o)) - 1)
+// number of references
+#define gc_refs_count(o) ((o)->refs_count != GC_REFS_LARGE ? (uint32_t)(o)->refs_count : gc_object_prefix_of(o)->refs_count)
+// number of references large object is scanned by at once, pause time is checked between chunks
+#define GC_OBJECT_SCAN_CHUNK 64
+
+// size of gc object memory block with given number of references
+#define gc_object_size(refs_count) (sizeof(gc_object) + ((size_t)(refs_count))*sizeof(gc_object*) + \
+                                    ((refs_count) >= GC_OBJECT_LARGE_REFS ? sizeof(gc_object_prefix) : 0))
+// start and size of object memory block
+#define gc_object_block(o) (gc_object_large(o) ? (void*)gc_object_prefix_of(o) : (void*)(o))
+#define gc_object_block_size(o) gc_object_size(gc_refs_count(o))
+// bytes reserved for object memory block with given number of references, size class rounding included
+#ifdef GC_USE_MALLOC
+#define gc_object_reserved(refs_count) gc_object_size(refs_count)
+#else
+#define gc_object_reserved(refs_count) gc_pool_reserved(gc_object_size(refs_count))
+#endif
+#define gc_object_block_reserved(o) gc_object_reserved(gc_refs_count(o))
+
+// gc mark
+#define gc_set_mark(o,r,gi) o->gc_mark = (r << 8) | gi
+// generation part
+#define gc_mark_load(o) __atomic_load_n(&(o->gc_mark),__ATOMIC_RELAXED)
+#define gc_gen_part(o) (gc_mark_load(o) & 0xFF)
+#define gc_gen_num(o) (gc_mark_load(o) & 0x3F)
+#define gc_gen_set(o,g) gc_set_mark(o,gc_root_ref_count(o), gc_color_bit(o) | (g & 0x3F))
+// color bits
+#define gc_color_bit(o) (gc_mark_load(o) & 0xC0)
+#define gc_color(o) (gc_gen_part(o) >> 6)
+#define gc_color_is_white(o) (gc_color_bit(o) == 0x00)
+#define gc_color_is_grey(o) (gc_color_bit(o) == 0x40)
+#define gc_color_is_black(o) (gc_color_bit(o) == 0x80)
+#define gc_color_is_silver(o) (gc_color_bit(o) == 0xC0)
+#define gc_color_is_silver_or_white(o) (gc_color_is_silver(o) || gc_color_is_white(o))
+#define gc_mark_white(o) gc_mark_color(o,0x00)
+#define gc_mark_grey(o) gc_mark_color(o,0x40)
+#define gc_mark_black(o) gc_mark_color(o,0x80)
+#define gc_mark_silver(o) gc_mark_color(o,0xC0)
+// root reference count
+#define gc_root_ref_count(o) (gc_mark_load(o) >> 8)
+#define gc_inc_root_ref_count(o) gc_set_mark(o,(gc_root_ref_count(o)+1),gc_gen_part(o))
+#define gc_dec_root_ref_count(o) gc_set_mark(o,(gc_root_ref_count(o)-1),gc_gen_part(o))
+// gc flags
+#define GC_FLAG_REMEMBERED 0x0001
+#define GC_FLAG_LOGGED 0x0002
+#define GC_FLAG_GARBAGE 0x0004 // swept and waiting to be freed, stale stack words and lookups might still find it
+#define GC_FLAG_FORWARDED 0x0008 // old copy of object moved by compaction, gc_prev points to new copy
+#define GC_FLAG_CROSS 0x0010 // grey object references other generations, it's remembered once it's black
+#define GC_FLAG_LAYOUT 0x0020 // object allocated with class layout, only words set in class refs bitmap are references
+#define GC_FLAG_WEAK 0x0040 // weak object, it's references aren't marked
+#define GC_FLAG_EPHEMERON 0x0080 // weak table, value of key value pair is marked only once key is marked
+#define gc_is_remembered(o) (__atomic_load_n(&(o->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_REMEMBERED)
+#define gc_flag_set(o,f) __atomic_fetch_or(&(o->gc_flags),f,__ATOMIC_RELAXED)
+#define gc_flag_clear(o,f) __atomic_fetch_and(&(o->gc_flags),(uint16_t)~(f),__ATOMIC_RELAXED)
+// object age, number of refreshes it survived in it's generation, kept in high byte of gc flags
+#define GC_FLAG_AGE_SHIFT 8
+#define gc_age(o) (__atomic_load_n(&(o->gc_flags),__ATOMIC_RELAXED) >> GC_FLAG_AGE_SHIFT)
+#define gc_age_inc(o) __atomic_fetch_add(&(o->gc_flags),1 << GC_FLAG_AGE_SHIFT,__ATOMIC_RELAXED)
+#define gc_age_reset(o) gc_flag_clear(o,0xFF << GC_FLAG_AGE_SHIFT)
+
+// number of words following object header scanned for references, map is set to bitmap of words holding
+// references or null if all of them do
+static inline uint32_t gc_object_refs(gc_object* o, const uint64_t** map){
+    *map = null;
+    if(!(__atomic_load_n(&(o->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_LAYOUT))
+        return gc_refs_count(o);
+    *map = o->class->refs;
+    return *map != null ? gc_refs_count(o) : 0;
+}
+// check if word of object holds reference
+#define gc_refs_map_test(map,i) ((map) == null || (((map)[(i) >> 6] >> ((i) & 63)) & 1))
+
+// check if four references are all null, vector instructions test them at once
+static inline bool gc_refs_null4(gc_object** refs){
+#if defined(__AVX2__)
+    __m256i v = _mm256_loadu_si256((const __m256i*)refs);
+    return _mm256_testz_si256(v,v);
+#elif defined(__SSE2__)
+    __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i*)refs),_mm_loadu_si128((const __m128i*)(refs+2)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v,_mm_setzero_si128())) == 0xFFFF;
+#else
+    return ((uintptr_t)refs[0] | (uintptr_t)refs[1] | (uintptr_t)refs[2] | (uintptr_t)refs[3]) == 0;
+#endif
+}
+
+// check if object is marked by collector's own loop, it's class has layout or marks it with gc_object_mark_black
+// weak objects are always marked by collector
+static inline bool gc_object_builtin_mark(gc_object* o){
+    return (__atomic_load_n(&(o->gc_flags),__ATOMIC_RELAXED) & (GC_FLAG_LAYOUT | GC_FLAG_WEAK | GC_FLAG_EPHEMERON)) ||
+           o->class->gc_mark_black == &gc_object_mark_black;
+}
+
+// check if weak table key keeps it's value alive, it's marked already or it's generation isn't refreshed
+static inline bool gc_weak_key_live(gc_object* key){
+    return key != null && !gc_color_is_silver_or_white(key);
+}
+
+// new copy of object if it was moved by compaction
+static inline gc_object* gc_object_forward(gc_object* o){
+    if(o != null && (__atomic_load_n(&(o->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_FORWARDED))
+        return (gc_object*)o->gc_prev;
+    return o;
+}
+
+// set color bits of gc mark, other threads might change root ref count at the same time
+static inline void gc_mark_color(gc_object* o, uint32_t color){
+    uint32_t mark = __atomic_load_n(&(o->gc_mark),__ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&(o->gc_mark),&mark,(mark & 0xFFFFFF3F) | color,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+}
+
+// log operation on shared heap lists to be done at next collection
+static inline void gc_thread_log(gc_thread* t, gc_object* obj, uintptr_t tag){
+    if(t->log_count == t->log_size){
+        t->log_size = t->log_size == 0 ? 256 : t->log_size*2;
+        t->log = (uintptr_t*)realloc(t->log,sizeof(uintptr_t)*t->log_size);
+    }
+    t->log[t->log_count++] = ((uintptr_t)obj) | tag;
+}
+
+// add black object to remembered set
+static inline void gc_remset_add(gc_heap* heap, gc_object* obj){
+    if(gc_is_remembered(obj))
+        return;
+    if(heap->remset_count == heap->remset_size){
+        heap->remset_size = heap->remset_size == 0 ? 1024 : heap->remset_size*2;
+        heap->remset = (gc_object**)realloc(heap->remset,sizeof(gc_object*)*heap->remset_size);
+    }
+    gc_flag_set(obj,GC_FLAG_REMEMBERED);
+    heap->remset[heap->remset_count++] = obj;
+}
+
+// add weak object to heap weak objects
+static inline void gc_weak_add(gc_heap* heap, gc_object* obj){
+    if(heap->weak_count == heap->weak_size){
+        heap->weak_size = heap->weak_size == 0 ? 256 : heap->weak_size*2;
+        heap->weak = (gc_object**)realloc(heap->weak,sizeof(gc_object*)*heap->weak_size);
+    }
+    heap->weak[heap->weak_count++] = obj;
+}
+
+// record large object space occupancy in cycle stats, other threads might be freeing large objects meanwhile
+static inline void gc_heap_large_stats(gc_heap* heap){
+#ifndef GC_USE_MALLOC
+    heap->conf.cycle_large_bytes = __atomic_load_n(&heap->pool.los_bytes,__ATOMIC_RELAXED);
+    heap->conf.cycle_large_objects = (uint32_t)__atomic_load_n(&heap->pool.los_count,__ATOMIC_RELAXED);
+#endif
+}
+
+// count refreshed object found dead for adaptive tenuring
+static inline void gc_tenure_died(gc_heap* heap, gc_object* obj){
+    uint8_t gen = gc_gen_num(obj);
+    heap->conf.gens[gen].tenure_died += 1;
+    if(gen == heap->conf.gens_count-1)
+        heap->tenure_growth -= 1;
+}
+
+// add object to list
+static inline void gc_list_add(gc_object** list, gc_object* obj){
+    obj->gc_next = *list;
+    if(obj->gc_next != null)
+        obj->gc_next->gc_prev = &(obj->gc_next);
+    obj->gc_prev = list;
+    *list = obj;
+}
+
+// remove object from current list
+static inline void gc_list_remove(gc_object* obj){
+    *(obj->gc_prev) = obj->gc_next;
+    if(obj->gc_next != null)
+        obj->gc_next->gc_prev = obj->gc_prev;
+}
+
+// move object to list
+static inline void gc_list_move(gc_object* obj, gc_object** list){
+    gc_list_remove(obj);
+    gc_list_add(list,obj);
+}
+
+// move all objects from list to list
+static inline void gc_list_move_all(gc_object** from, gc_object** to){
+    if(*to != null){
+        gc_object* obj = *from;
+        while(obj->gc_next != null)
+            obj = obj->gc_next;
+        obj->gc_next = *to;
+        (*to)->gc_prev = &(obj->gc_next);
+    }
+    *to = *from;
+    (*to)->gc_prev = to;
+    *from = null;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,570 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+// initial number of entries in worker grey deque
+#define GC_MARK_DEQUE_SIZE 1024
+// number of objects worker takes from heap grey list at once
+#define GC_MARK_GREY_BATCH 64
+// number of references of large object worker scans before pushing rest of it back to it's deque
+#define GC_MARK_SCAN_LIMIT 1024
+
+// grey deque buffer, size is power of 2
+typedef struct gc_mark_buffer_t {
+    int64_t size;
+    struct gc_mark_buffer_t* prev; // smaller buffer replaced by this one, thieves might still read it
+    gc_object* data[];
+} gc_mark_buffer;
+
+// mark worker, drains its own grey deque and steals from other workers when it's empty
+struct gc_mark_worker_t {
+    gc_marker* marker;
+    uint32_t index;
+    pthread_t thread;
+    // work stealing grey deque, owner pushes and takes at bottom, thieves steal from top
+    int64_t top;
+    int64_t bottom;
+    gc_mark_buffer* buffer;
+    // objects marked grey by this worker, they are still linked into white or silver list
+    gc_object** shaded;
+    uint32_t shaded_count;
+    uint32_t shaded_size;
+    // black objects referencing other generations
+    gc_object** remembered;
+    uint32_t remembered_count;
+    uint32_t remembered_size;
+    uint64_t work; // number of objects checked during current run
+    gc_mark_queue queue; // references read and not shaded yet
+};
+
+// parallel marker
+struct gc_marker_t {
+    gc_heap* heap;
+    gc_mark_worker* workers;
+    uint32_t workers_count;
+    // heap grey list isn't changed during run, workers take objects from it in batches
+    pthread_mutex_t grey_lock;
+    gc_object* grey_next; // first heap grey object not taken by any worker
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond; // signaled when new run starts
+    pthread_cond_t done_cond; // signaled when helper worker finishes run
+    uint32_t run; // current run number
+    uint32_t running; // number of helper workers still running
+    bool shutdown; // helper workers should exit
+    int idle; // number of workers that ran out of grey objects
+    int stop; // pause time ran out, all workers should stop
+};
+
+// mark worker of current thread while marking in parallel
+__thread gc_mark_worker* local_mark_worker = null;
+
+// grey deque
+
+static gc_mark_buffer* gc_mark_buffer_new(int64_t size, gc_mark_buffer* prev){
+    gc_mark_buffer* b = (gc_mark_buffer*)malloc(sizeof(gc_mark_buffer) + sizeof(gc_object*)*size);
+    if(b == null)
+        return null;
+    b->size = size;
+    b->prev = prev;
+    return b;
+}
+
+static inline gc_object* gc_mark_buffer_get(gc_mark_buffer* b, int64_t i){
+    return __atomic_load_n(&(b->data[i & (b->size-1)]),__ATOMIC_RELAXED);
+}
+
+static inline void gc_mark_buffer_put(gc_mark_buffer* b, int64_t i, gc_object* obj){
+    __atomic_store_n(&(b->data[i & (b->size-1)]),obj,__ATOMIC_RELAXED);
+}
+
+// push grey object at bottom, called by owner only
+static bool gc_mark_push(gc_mark_worker* w, gc_object* obj){
+    int64_t b = __atomic_load_n(&w->bottom,__ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&w->top,__ATOMIC_ACQUIRE);
+    gc_mark_buffer* buf = __atomic_load_n(&w->buffer,__ATOMIC_RELAXED);
+    if(b - t >= buf->size){
+        // deque is full, grow it keeping old buffer alive until the end of run
+        gc_mark_buffer* nbuf = gc_mark_buffer_new(buf->size*2,buf);
+        if(nbuf == null)
+            return false;
+        for(int64_t i = t; i < b; ++i)
+            gc_mark_buffer_put(nbuf,i,gc_mark_buffer_get(buf,i));
+        __atomic_store_n(&w->buffer,nbuf,__ATOMIC_RELEASE);
+        buf = nbuf;
+    }
+    gc_mark_buffer_put(buf,b,obj);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&w->bottom,b+1,__ATOMIC_RELAXED);
+    return true;
+}
+
+// take grey object from bottom, called by owner only
+static gc_object* gc_mark_take(gc_mark_worker* w){
+    int64_t b = __atomic_load_n(&w->bottom,__ATOMIC_RELAXED) - 1;
+    gc_mark_buffer* buf = __atomic_load_n(&w->buffer,__ATOMIC_RELAXED);
+    __atomic_store_n(&w->bottom,b,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&w->top,__ATOMIC_RELAXED);
+    if(t > b){
+        // deque is empty
+        __atomic_store_n(&w->bottom,b+1,__ATOMIC_RELAXED);
+        return null;
+    }
+    gc_object* obj = gc_mark_buffer_get(buf,b);
+    if(t == b){
+        // last object, race with thieves for it
+        if(!__atomic_compare_exchange_n(&w->top,&t,t+1,false,__ATOMIC_SEQ_CST,__ATOMIC_RELAXED))
+            obj = null;
+        __atomic_store_n(&w->bottom,b+1,__ATOMIC_RELAXED);
+    }
+    return obj;
+}
+
+// steal grey object from top of other worker deque
+static gc_object* gc_mark_steal(gc_mark_worker* w){
+    int64_t t = __atomic_load_n(&w->top,__ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&w->bottom,__ATOMIC_ACQUIRE);
+    if(t >= b)
+        return null;
+    gc_mark_buffer* buf = __atomic_load_n(&w->buffer,__ATOMIC_ACQUIRE);
+    gc_object* obj = gc_mark_buffer_get(buf,t);
+    if(!__atomic_compare_exchange_n(&w->top,&t,t+1,false,__ATOMIC_SEQ_CST,__ATOMIC_RELAXED))
+        return null;
+    return obj;
+}
+
+// check if worker deque has grey objects
+static inline bool gc_mark_has_work(gc_mark_worker* w){
+    return __atomic_load_n(&w->top,__ATOMIC_ACQUIRE) < __atomic_load_n(&w->bottom,__ATOMIC_ACQUIRE);
+}
+
+// append object to worker array
+static inline void gc_mark_array_add(gc_object*** array, uint32_t* count, uint32_t* size, gc_object* obj){
+    if(*count == *size){
+        *size = *size == 0 ? 1024 : (*size)*2;
+        *array = (gc_object**)realloc(*array,sizeof(gc_object*)*(*size));
+    }
+    (*array)[(*count)++] = obj;
+}
+
+// mark object grey if it's white or silver, only one worker succeeds
+static inline bool gc_mark_shade(gc_object* obj){
+    uint32_t mark = __atomic_load_n(&(obj->gc_mark),__ATOMIC_RELAXED);
+    while((mark & 0xC0) == 0x00 || (mark & 0xC0) == 0xC0){
+        if(__atomic_compare_exchange_n(&(obj->gc_mark),&mark,(mark & 0xFFFFFF3F) | 0x40,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+// shade object referenced by object marked on worker
+static inline void gc_mark_worker_ref(gc_mark_worker* w, gc_object* holder, gc_object* ref){
+    uint32_t mark = __atomic_load_n(&(holder->gc_mark),__ATOMIC_RELAXED);
+    // if reference is from different generation holder is remembered once it's black, only this worker marks it
+    if((__atomic_load_n(&(ref->gc_mark),__ATOMIC_RELAXED) & 0x3F) != (mark & 0x3F)){
+        if((mark & 0xC0) == 0x80){
+            if(!gc_is_remembered(holder))
+                gc_mark_array_add(&w->remembered,&w->remembered_count,&w->remembered_size,holder);
+        }else if(!(__atomic_load_n(&(holder->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_CROSS)){
+            gc_flag_set(holder,GC_FLAG_CROSS);
+        }
+    }
+    if(gc_mark_shade(ref)){
+        gc_mark_array_add(&w->shaded,&w->shaded_count,&w->shaded_size,ref);
+        // no memory for deque, stop run so shaded object is moved to grey list
+        if(!gc_mark_push(w,ref))
+            __atomic_store_n(&w->marker->stop,1,__ATOMIC_RELAXED);
+        w->work += 1;
+    }
+}
+
+// shade oldest reference queued by worker
+static inline void gc_mark_worker_dequeue(gc_mark_worker* w){
+    gc_mark_pending* p = &(w->queue.refs[w->queue.head++ % GC_MARK_PREFETCH_MAX]);
+    gc_mark_worker_ref(w,p->holder,p->ref);
+}
+
+// queue reference while header of object it points to is prefetched, oldest queued reference is shaded
+// once queue is full
+static inline void gc_mark_worker_enqueue(gc_mark_worker* w, uint32_t prefetch, gc_object* holder, gc_object* ref){
+    if(prefetch == 0){
+        gc_mark_worker_ref(w,holder,ref);
+        return;
+    }
+    if(w->queue.tail - w->queue.head == prefetch)
+        gc_mark_worker_dequeue(w);
+    __builtin_prefetch(ref,1);
+    gc_mark_pending* p = &(w->queue.refs[w->queue.tail++ % GC_MARK_PREFETCH_MAX]);
+    p->ref = ref;
+    p->holder = holder;
+}
+
+// shade all references queued by worker
+static inline void gc_mark_worker_flush(gc_mark_worker* w){
+    while(w->queue.head != w->queue.tail)
+        gc_mark_worker_dequeue(w);
+}
+
+// mark grey object black on worker thread, object stays in it's current list until run ends
+void gc_mark_worker_mark_black(gc_mark_worker* w, gc_object* obj){
+    gc_object** refs = (gc_object**)(obj+1); // start of refs array
+    const uint64_t* map;
+    uint32_t count = gc_object_refs(obj,&map);
+    uint32_t prefetch = w->marker->heap->mark_prefetch;
+    bool large = gc_object_large(obj);
+    uint32_t i = 0;
+    // continue where previous run or worker stopped
+    if(large)
+        i = gc_object_prefix_of(obj)->scan;
+    uint32_t start = i;
+    uint16_t flags = __atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED);
+    // references of weak object don't keep objects alive
+    if(flags & GC_FLAG_WEAK)
+        count = 0;
+    bool ephemeron = (flags & GC_FLAG_EPHEMERON) != 0;
+
+    // for each ref
+    for(; i < count; ++i){
+        // large object is scanned in chunks, rest of it is pushed back so other workers can steal it
+        if(large && i != start && (i % GC_MARK_SCAN_LIMIT) == 0){
+            // references read so far are shaded before other worker can take object
+            gc_mark_worker_flush(w);
+            gc_object_prefix_of(obj)->scan = i;
+            if(!gc_mark_push(w,obj))
+                __atomic_store_n(&w->marker->stop,1,__ATOMIC_RELAXED);
+            w->work += 1;
+            return;
+        }
+        if(!gc_refs_map_test(map,i)){
+            // rest of bitmap word without references is skipped at once
+            if((map[i >> 6] >> (i & 63)) == 0)
+                i |= 63;
+            continue;
+        }
+        // runs of null references are skipped four at a time
+        if(map == null && (i & 3) == 0 && count - i >= 4 && gc_refs_null4(refs+i)){
+            i += 3;
+            continue;
+        }
+        gc_object* ref = __atomic_load_n(&refs[i],__ATOMIC_ACQUIRE);
+        if(ref == null)
+            continue;
+        // weak table value is marked once it's key is, keys marked later are found by ephemeron phase
+        if(ephemeron && ((i & 1) == 0 || !gc_weak_key_live(__atomic_load_n(&refs[i-1],__ATOMIC_ACQUIRE))))
+            continue;
+        gc_mark_worker_enqueue(w,prefetch,obj,ref);
+    }
+    if(large && start != 0)
+        gc_object_prefix_of(obj)->scan = 0;
+
+    // object is remembered if references shaded so far point to other generations, queued ones remember it later
+    bool cross = (__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_CROSS) != 0;
+    if(cross)
+        gc_flag_clear(obj,GC_FLAG_CROSS);
+
+    // only this worker owns grey object, others just read it's mark
+    gc_mark_black(obj);
+    if(cross && !gc_is_remembered(obj))
+        gc_mark_array_add(&w->remembered,&w->remembered_count,&w->remembered_size,obj);
+}
+
+// take batch of objects from heap grey list into worker deque
+static bool gc_mark_take_grey(gc_mark_worker* w){
+    gc_marker* m = w->marker;
+    if(__atomic_load_n(&m->grey_next,__ATOMIC_RELAXED) == null)
+        return false;
+    uint32_t taken = 0;
+    pthread_mutex_lock(&m->grey_lock);
+    gc_object* obj = m->grey_next;
+    while(obj != null && taken < GC_MARK_GREY_BATCH && gc_mark_push(w,obj)){
+        obj = obj->gc_next;
+        taken += 1;
+    }
+    __atomic_store_n(&m->grey_next,obj,__ATOMIC_RELAXED);
+    pthread_mutex_unlock(&m->grey_lock);
+    return taken > 0;
+}
+
+// find grey object in other workers deques
+static gc_object* gc_mark_steal_any(gc_mark_worker* w){
+    gc_marker* m = w->marker;
+    for(uint32_t i = 1; i < m->workers_count; ++i){
+        gc_object* obj = gc_mark_steal(&m->workers[(w->index + i) % m->workers_count]);
+        if(obj != null)
+            return obj;
+    }
+    return null;
+}
+
+// drain grey objects until there are none left in all deques or pause time runs out
+static void gc_mark_worker_run(gc_mark_worker* w){
+    gc_marker* m = w->marker;
+    gc_heap* heap = m->heap;
+    uint64_t checked = 0;
+    // workers share pause time, each checks it after it's part of work scheduler expects to fit into half of it
+    uint32_t interval = heap->pace_next > heap->conf.cycle_threshold ? heap->pace_next - heap->conf.cycle_threshold : 1;
+    interval = interval/m->workers_count > 0 ? interval/m->workers_count : 1;
+    local_mark_worker = w;
+    while(!__atomic_load_n(&m->stop,__ATOMIC_RELAXED)){
+        gc_object* obj = gc_mark_take(w);
+        if(obj == null && gc_mark_take_grey(w))
+            continue;
+        if(obj == null)
+            obj = gc_mark_steal_any(w);
+        // queued references might shade more objects
+        if(obj == null && w->queue.head != w->queue.tail){
+            gc_mark_worker_flush(w);
+            continue;
+        }
+        if(obj == null){
+            // out of work, done when every worker is out of work
+            __atomic_add_fetch(&m->idle,1,__ATOMIC_SEQ_CST);
+            bool found = false;
+            while(!found){
+                if(__atomic_load_n(&m->idle,__ATOMIC_SEQ_CST) == (int)m->workers_count || __atomic_load_n(&m->stop,__ATOMIC_RELAXED))
+                    break;
+                found = __atomic_load_n(&m->grey_next,__ATOMIC_RELAXED) != null;
+                for(uint32_t i = 0; i < m->workers_count && !found; ++i)
+                    found = gc_mark_has_work(&m->workers[i]);
+                // let workers with grey objects run if there are more workers than cores
+                if(!found)
+                    sched_yield();
+            }
+            if(!found)
+                break;
+            __atomic_sub_fetch(&m->idle,1,__ATOMIC_SEQ_CST);
+            continue;
+        }
+        // objects of class with layout or default one are marked without calling class
+        if(gc_object_builtin_mark(obj))
+            gc_mark_worker_mark_black(w,obj);
+        else
+            (obj->class->gc_mark_black)(obj);
+        w->work += 1;
+        // check pause time
+        if(w->work - checked >= interval){
+            checked = w->work;
+            if(!heap->background){
+                uint64_t elapsed = gc_pace_elapsed(heap,heap->conf.cycle_threshold - heap->pace_units + w->work*m->workers_count);
+                uint64_t unit = heap->pace_rate[GC_PACE_MARK] >> GC_PACE_RATE_SHIFT;
+                if(elapsed >= heap->conf.max_pause || heap->conf.max_pause - elapsed <= unit)
+                    __atomic_store_n(&m->stop,1,__ATOMIC_RELAXED);
+                else
+                    interval = gc_pace_interval(heap,(heap->conf.max_pause - elapsed)/2)/m->workers_count + 1;
+            }
+        }
+    }
+    // references read before run stopped are shaded, they are moved to grey list with other shaded objects
+    gc_mark_worker_flush(w);
+    local_mark_worker = null;
+}
+
+// helper worker thread
+static void* gc_mark_worker_thread(void* arg){
+    gc_mark_worker* w = (gc_mark_worker*)arg;
+    gc_marker* m = w->marker;
+    uint32_t run = 0;
+    pthread_mutex_lock(&m->lock);
+    for(;;){
+        while(m->run == run && !m->shutdown)
+            pthread_cond_wait(&m->start_cond,&m->lock);
+        if(m->shutdown)
+            break;
+        run = m->run;
+        pthread_mutex_unlock(&m->lock);
+        gc_mark_worker_run(w);
+        pthread_mutex_lock(&m->lock);
+        if(--m->running == 0)
+            pthread_cond_signal(&m->done_cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return null;
+}
+
+// move objects marked by workers to their color lists
+static void gc_mark_relink(gc_heap* heap, gc_marker* m){
+    // objects taken from grey list are black now unless run stopped before reaching them
+    gc_object* obj = heap->grey;
+    while(obj != m->grey_next){
+        gc_object* next = obj->gc_next;
+        if(gc_color_is_black(obj))
+            gc_list_move(obj,&(heap->black[gc_gen_num(obj)]));
+        obj = next;
+    }
+    for(uint32_t i = 0; i < m->workers_count; ++i){
+        gc_mark_worker* w = &m->workers[i];
+        // shaded objects are still in white or silver list
+        for(uint32_t j = 0; j < w->shaded_count; ++j){
+            obj = w->shaded[j];
+            if(gc_color_is_black(obj))
+                gc_list_move(obj,&(heap->black[gc_gen_num(obj)]));
+            else
+                gc_list_move(obj,&heap->grey);
+        }
+        for(uint32_t j = 0; j < w->remembered_count; ++j)
+            gc_remset_add(heap,w->remembered[j]);
+        heap->conf.cycle_threshold += w->work;
+        // free old deque buffers and reset deque
+        gc_mark_buffer* buf = w->buffer->prev;
+        while(buf != null){
+            gc_mark_buffer* prev = buf->prev;
+            free(buf);
+            buf = prev;
+        }
+        w->buffer->prev = null;
+        w->top = w->bottom = 0;
+        w->shaded_count = w->remembered_count = 0;
+        w->work = 0;
+    }
+}
+
+// mark all grey objects in parallel, returns false if pause time ran out
+bool gc_marker_run(gc_marker* m){
+    gc_heap* heap = m->heap;
+    m->grey_next = heap->grey;
+    m->idle = 0;
+    m->stop = 0;
+
+    // wake helper workers and mark on this thread as well
+    pthread_mutex_lock(&m->lock);
+    m->run += 1;
+    m->running = m->workers_count - 1;
+    pthread_cond_broadcast(&m->start_cond);
+    pthread_mutex_unlock(&m->lock);
+    gc_mark_worker_run(&m->workers[0]);
+    pthread_mutex_lock(&m->lock);
+    while(m->running > 0)
+        pthread_cond_wait(&m->done_cond,&m->lock);
+    pthread_mutex_unlock(&m->lock);
+
+    gc_mark_relink(heap,m);
+    return heap->grey == null;
+}
+
+// stop helper workers and free marker
+void gc_marker_destroy(gc_marker* m){
+    pthread_mutex_lock(&m->lock);
+    m->shutdown = true;
+    pthread_cond_broadcast(&m->start_cond);
+    pthread_mutex_unlock(&m->lock);
+    for(uint32_t i = 1; i < m->workers_count; ++i)
+        pthread_join(m->workers[i].thread,null);
+    for(uint32_t i = 0; i < m->workers_count; ++i){
+        free(m->workers[i].buffer);
+        free(m->workers[i].shaded);
+        free(m->workers[i].remembered);
+    }
+    pthread_mutex_destroy(&m->grey_lock);
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->start_cond);
+    pthread_cond_destroy(&m->done_cond);
+    free(m->workers);
+    free(m);
+}
+
+// create marker with given number of workers including collecting thread
+static gc_marker* gc_marker_create(gc_heap* heap, uint32_t count){
+    gc_marker* m = (gc_marker*)calloc(1,sizeof(gc_marker));
+    if(m == null)
+        return null;
+    m->heap = heap;
+    m->workers = (gc_mark_worker*)calloc(count,sizeof(gc_mark_worker));
+    if(m->workers == null){
+        free(m);
+        return null;
+    }
+    pthread_mutex_init(&m->grey_lock,null);
+    pthread_mutex_init(&m->lock,null);
+    pthread_cond_init(&m->start_cond,null);
+    pthread_cond_init(&m->done_cond,null);
+    for(uint32_t i = 0; i < count; ++i){
+        gc_mark_worker* w = &m->workers[i];
+        w->marker = m;
+        w->index = i;
+        w->buffer = gc_mark_buffer_new(GC_MARK_DEQUE_SIZE,null);
+        if(w->buffer == null){
+            gc_marker_destroy(m);
+            return null;
+        }
+        m->workers_count = i + 1;
+        // first worker is collecting thread itself
+        if(i > 0 && pthread_create(&w->thread,null,&gc_mark_worker_thread,w) != 0){
+            free(w->buffer);
+            m->workers_count = i;
+            gc_marker_destroy(m);
+            return null;
+        }
+    }
+    return m;
+}
+
+// set number of threads marking heap in parallel, 0 or 1 marks on collecting thread only
+bool gc_heap_set_mark_threads(gc_heap* heap, uint32_t count){
+    if(heap->marker != null){
+        gc_marker_destroy(heap->marker);
+        heap->marker = null;
+    }
+    if(count <= 1)
+        return true;
+    heap->marker = gc_marker_create(heap,count);
+    if(heap->marker == null){
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
+}
+
+// set number of threads marking default heap in parallel
+bool gc_set_mark_threads(uint32_t count){
+    return gc_heap_set_mark_threads(gc_get_heap(),count);
+}
+
+// set number of references marking reads ahead of shading them
+bool gc_heap_set_mark_prefetch(gc_heap* heap, uint32_t distance){
+    if(distance > GC_MARK_PREFETCH_MAX){
+        errno = EINVAL;
+        return false;
+    }
+    heap->mark_prefetch = distance;
+    return true;
+}
+
+// set number of references marking of default heap reads ahead of shading them
+bool gc_set_mark_prefetch(uint32_t distance){
+    return gc_heap_set_mark_prefetch(gc_get_heap(),distance);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,243 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+// time source of pause checks
+static int gc_clock = GC_CLOCK_MONOTONIC;
+// coarse clock tick in nanoseconds
+static uint64_t gc_clock_resolution;
+
+#if defined(__x86_64__)
+// time stamp counter calibration, nanoseconds are base_ns + (ticks since base_tsc)*mult >> 32
+static uint64_t gc_clock_base_tsc;
+static uint64_t gc_clock_base_ns;
+static uint64_t gc_clock_mult;
+#endif
+
+// get current time in nanoseconds from selected time source
+uint64_t gc_clock_now(){
+    switch(__atomic_load_n(&gc_clock,__ATOMIC_ACQUIRE)){
+#if defined(__x86_64__)
+    case GC_CLOCK_TSC:
+        return gc_clock_base_ns + (uint64_t)((((unsigned __int128)(__rdtsc() - gc_clock_base_tsc))*gc_clock_mult) >> 32);
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+    case GC_CLOCK_COARSE:{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &t);
+        return (((uint64_t)t.tv_sec)*1000000000) + ((uint64_t)t.tv_nsec);
+    }
+#endif
+    default:
+        return get_nanotime();
+    }
+}
+
+// check if selected clock ticks too rarely to measure time per unit of work
+static inline bool gc_clock_coarse(){
+    return __atomic_load_n(&gc_clock,__ATOMIC_RELAXED) == GC_CLOCK_COARSE;
+}
+
+// get precise current time, coarse clock is replaced by monotonic one which is read few times per pause only
+static inline uint64_t gc_clock_precise(){
+    return gc_clock_coarse() ? get_nanotime() : gc_clock_now();
+}
+
+// select time source of pause checks
+bool gc_set_clock(gc_clock_source source){
+    switch(source){
+    case GC_CLOCK_MONOTONIC:
+        break;
+    case GC_CLOCK_COARSE:{
+#ifdef CLOCK_MONOTONIC_COARSE
+        struct timespec t;
+        if(clock_getres(CLOCK_MONOTONIC_COARSE,&t) != 0)
+            return false;
+        gc_clock_resolution = (((uint64_t)t.tv_sec)*1000000000) + ((uint64_t)t.tv_nsec);
+        break;
+#else
+        errno = ENOTSUP;
+        return false;
+#endif
+    }
+    case GC_CLOCK_TSC:{
+#if defined(__x86_64__)
+        // only invariant counter ticks at constant rate regardless of frequency scaling and sleep states
+        unsigned int eax, ebx, ecx, edx;
+        if(!__get_cpuid(0x80000007,&eax,&ebx,&ecx,&edx) || !(edx & (1 << 8))){
+            errno = ENOTSUP;
+            return false;
+        }
+        // measure counter rate against monotonic clock
+        uint64_t ns = get_nanotime(), tsc = __rdtsc(), end_ns, end_tsc;
+        do{
+            end_ns = get_nanotime();
+            end_tsc = __rdtsc();
+        }while(end_ns - ns < GC_CLOCK_CALIBRATION);
+        gc_clock_mult = ((end_ns - ns) << 32)/(end_tsc - tsc);
+        gc_clock_base_tsc = end_tsc;
+        gc_clock_base_ns = end_ns;
+        break;
+#else
+        errno = ENOTSUP;
+        return false;
+#endif
+    }
+    default:
+        errno = EINVAL;
+        return false;
+    }
+    __atomic_store_n(&gc_clock,(int)source,__ATOMIC_RELEASE);
+    return true;
+}
+
+// number of units of current phase expected to fit into given time
+uint32_t gc_pace_interval(gc_heap* heap, uint64_t time){
+    uint64_t rate = heap->pace_rate[heap->pace_phase];
+    // phase wasn't measured yet
+    if(rate == 0)
+        return heap->conf.pause_threshold > 0 ? heap->conf.pause_threshold : 1;
+    if(time > (UINT64_MAX >> GC_PACE_RATE_SHIFT))
+        return GC_PACE_MAX_INTERVAL;
+    uint64_t units = (time << GC_PACE_RATE_SHIFT)/rate;
+    if(units == 0)
+        return 1;
+    return units > GC_PACE_MAX_INTERVAL ? GC_PACE_MAX_INTERVAL : (uint32_t)units;
+}
+
+// time elapsed since pause start, given number of units of current phase were done since last sample
+uint64_t gc_pace_elapsed(gc_heap* heap, uint32_t units){
+    if(!gc_clock_coarse()){
+        uint64_t now = gc_clock_now();
+        return now > heap->conf.cycle_time ? now - heap->conf.cycle_time : 0;
+    }
+    // coarse clock only bounds time from below, estimate is used while it's higher
+    uint64_t elapsed = heap->pace_time - heap->conf.cycle_time +
+                       ((((uint64_t)units)*heap->pace_rate[heap->pace_phase]) >> GC_PACE_RATE_SHIFT);
+    uint64_t coarse = gc_clock_now() - heap->pace_coarse;
+    if(coarse > gc_clock_resolution && coarse - gc_clock_resolution > elapsed)
+        elapsed = coarse - gc_clock_resolution;
+    return elapsed;
+}
+
+// measure time per unit of current phase since last sample, returns time elapsed since pause start
+static uint64_t gc_pace_sample(gc_heap* heap){
+    uint64_t now = gc_clock_precise();
+    uint32_t units = heap->conf.cycle_threshold - heap->pace_units;
+    if(units > 0 && now > heap->pace_time){
+        uint64_t rate = ((now - heap->pace_time) << GC_PACE_RATE_SHIFT)/units;
+        uint64_t* r = &(heap->pace_rate[heap->pace_phase]);
+        *r = *r == 0 ? rate : (*r*(GC_PACE_RATE_WEIGHT-1) + rate)/GC_PACE_RATE_WEIGHT;
+    }
+    heap->pace_time = now;
+    heap->pace_units = heap->conf.cycle_threshold;
+    return now > heap->conf.cycle_time ? now - heap->conf.cycle_time : 0;
+}
+
+// start pause, time is measured from now
+void gc_pace_start(gc_heap* heap){
+    heap->conf.cycle_time = gc_clock_precise();
+    if(gc_clock_coarse())
+        heap->pace_coarse = gc_clock_now();
+    heap->pace_time = heap->conf.cycle_time;
+    heap->pace_units = heap->conf.cycle_threshold;
+    heap->pace_phase = GC_PACE_NONE;
+    heap->pace_next = heap->conf.cycle_threshold + gc_pace_interval(heap,heap->conf.max_pause/2);
+    heap->stats.phase_start = heap->conf.cycle_time;
+    gc_trace(gc_trace_pause_begin(heap));
+}
+
+// count following units of work for given phase
+void gc_pace_switch(gc_heap* heap, uint8_t phase){
+    gc_stats_phase_end(heap,gc_clock_precise());
+    gc_trace(gc_trace_phase(heap,phase));
+    if(heap->background){
+        // work done concurrently with mutators isn't measured
+        heap->pace_phase = phase;
+        heap->pace_units = heap->conf.cycle_threshold;
+        return;
+    }
+    // time since last sample belongs to previous phase
+    uint64_t elapsed;
+    if(heap->conf.cycle_threshold != heap->pace_units)
+        elapsed = gc_pace_sample(heap);
+    else
+        elapsed = heap->pace_time - heap->conf.cycle_time;
+    heap->pace_phase = phase;
+    uint64_t remaining = elapsed < heap->conf.max_pause ? heap->conf.max_pause - elapsed : 0;
+    heap->pace_next = heap->conf.cycle_threshold + gc_pace_interval(heap,remaining/2);
+}
+
+// check pause time, false if it ran out or next unit wouldn't fit into it anymore
+bool gc_pace_check(gc_heap* heap){
+    if(!heap->background){
+        heap->conf.cycle_checks += 1;
+        // time per unit is measured only with clock precise enough
+        uint64_t elapsed = gc_clock_coarse() ? gc_pace_elapsed(heap,heap->conf.cycle_threshold - heap->pace_units) :
+                                               gc_pace_sample(heap);
+        uint64_t unit = heap->pace_rate[heap->pace_phase] >> GC_PACE_RATE_SHIFT;
+        if(elapsed >= heap->conf.max_pause || heap->conf.max_pause - elapsed <= unit)
+            return false;
+        // check again once half of remaining time is expected to pass
+        heap->conf.cycle_objects += heap->conf.cycle_threshold;
+        // units not sampled yet are kept for next sample
+        heap->pace_units -= heap->conf.cycle_threshold;
+        heap->conf.cycle_threshold = 0;
+        heap->pace_next = gc_pace_interval(heap,(heap->conf.max_pause - elapsed)/2);
+    }else{
+        heap->conf.cycle_objects += heap->conf.cycle_threshold;
+        heap->conf.cycle_threshold = 0;
+        heap->pace_units = 0;
+        heap->pace_next = heap->conf.pause_threshold;
+    }
+    return true;
+}
+
+// end pause, returns it's duration
+uint64_t gc_pace_end(gc_heap* heap){
+    uint64_t duration = gc_pace_sample(heap);
+    gc_stats_phase_end(heap,heap->pace_time);
+    gc_stats_pause(heap,duration);
+    gc_trace(gc_trace_pause_end(heap));
+    heap->pace_phase = GC_PACE_NONE;
+    if(duration > heap->conf.max_pause && duration - heap->conf.max_pause > heap->conf.cycle_overshoot)
+        heap->conf.cycle_overshoot = duration - heap->conf.max_pause;
+    return duration;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,581 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc.h"
+#include "gc_pool.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// slot sizes of span size classes, number of slots per span halves about every four classes
+static const uint32_t gc_pool_span_sizes[GC_POOL_SPAN_CLASSES] = {
+    GC_POOL_SPAN_SLOT(63), GC_POOL_SPAN_SLOT(56), GC_POOL_SPAN_SLOT(51), GC_POOL_SPAN_SLOT(42),
+    GC_POOL_SPAN_SLOT(36), GC_POOL_SPAN_SLOT(31), GC_POOL_SPAN_SLOT(25), GC_POOL_SPAN_SLOT(21),
+    GC_POOL_SPAN_SLOT(18), GC_POOL_SPAN_SLOT(15), GC_POOL_SPAN_SLOT(12), GC_POOL_SPAN_SLOT(10),
+    GC_POOL_SPAN_SLOT(9), GC_POOL_SPAN_SLOT(8), GC_POOL_SPAN_SLOT(7), GC_POOL_SPAN_SLOT(6),
+    GC_POOL_SPAN_SLOT(5), GC_POOL_SPAN_SLOT(4)
+};
+
+// span size class of allocation size
+static inline uint16_t gc_pool_span_class_index(size_t size){
+    uint16_t i = 0;
+    while(gc_pool_span_sizes[i] < size)
+        ++i;
+    return GC_POOL_CLASSES + i;
+}
+
+// number of bytes reserved for block of span size class
+size_t gc_pool_span_reserved(size_t size){
+    return gc_pool_span_sizes[gc_pool_span_class_index(size) - GC_POOL_CLASSES];
+}
+
+// check if slab is span
+#define gc_pool_slab_is_span(slab) ((slab)->class_index >= GC_POOL_CLASSES)
+
+// initialize pool
+void gc_pool_init(gc_pool* pool){
+    memset(pool,0,sizeof(gc_pool));
+    pool->cache_limit = GC_POOL_CACHED_SLABS;
+    pool->los_threshold = GC_POOL_LOS_THRESHOLD;
+}
+
+// return all pool memory to the system
+void gc_pool_destroy(gc_pool* pool){
+    for(uint32_t i = 0; i < pool->chunks_count; ++i)
+        munmap(pool->chunks[i],GC_POOL_SLAB_SIZE*GC_POOL_CHUNK_SLABS);
+    free(pool->chunks);
+    free(pool->released);
+    free(pool->spans_released);
+    if(pool->map != null){
+        for(uint32_t i = 0; i < (1 << GC_POOL_MAP_ROOT_BITS); ++i)
+            free(pool->map[i]);
+        free(pool->map);
+    }
+    memset(pool,0,sizeof(gc_pool));
+}
+
+// set page map entries of address range, only pool owner adds entries so missing root and leaves are
+// created without synchronization while other threads might be reading them
+static bool gc_pool_map_set(gc_pool* pool, void* start, size_t size, uintptr_t entry){
+    if(pool->map == null){
+        uintptr_t** map = (uintptr_t**)calloc(1 << GC_POOL_MAP_ROOT_BITS,sizeof(uintptr_t*));
+        if(map == null)
+            return false;
+        __atomic_store_n(&pool->map,map,__ATOMIC_RELEASE);
+    }
+    uintptr_t first = (uintptr_t)start >> GC_POOL_SLAB_SHIFT;
+    uintptr_t last = ((uintptr_t)start + size - 1) >> GC_POOL_SLAB_SHIFT;
+    for(uintptr_t page = first; page <= last; ++page){
+        uintptr_t** root = &(pool->map[page >> GC_POOL_MAP_LEAF_BITS]);
+        if(*root == null){
+            uintptr_t* leaf = (uintptr_t*)calloc(1 << GC_POOL_MAP_LEAF_BITS,sizeof(uintptr_t));
+            if(leaf == null)
+                return false;
+            __atomic_store_n(root,leaf,__ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&((*root)[page & ((1 << GC_POOL_MAP_LEAF_BITS)-1)]),entry,__ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+// page map entry of page address is in, 0 if it isn't pool memory
+static inline uintptr_t gc_pool_map_get(gc_pool* pool, uintptr_t address){
+    uintptr_t** map = __atomic_load_n(&pool->map,__ATOMIC_ACQUIRE);
+    if(map == null || (address >> GC_POOL_MAP_ADDRESS_BITS) != 0)
+        return 0;
+    uintptr_t page = address >> GC_POOL_SLAB_SHIFT;
+    uintptr_t* leaf = __atomic_load_n(&map[page >> GC_POOL_MAP_LEAF_BITS],__ATOMIC_ACQUIRE);
+    if(leaf == null)
+        return 0;
+    return __atomic_load_n(&leaf[page & ((1 << GC_POOL_MAP_LEAF_BITS)-1)],__ATOMIC_ACQUIRE);
+}
+
+// allocate large block on pages of it's own so it can be found from page map
+// blocks from threshold up are mapped separately, so they never fragment malloc arenas
+static void* gc_pool_alloc_large(gc_pool* pool, size_t size){
+    bool mapped = pool->los_threshold != 0 && size >= pool->los_threshold;
+    size = (size + GC_POOL_SLAB_SIZE - 1) & ~((size_t)GC_POOL_SLAB_SIZE-1);
+    void* p;
+    if(mapped){
+        // mmap returns page aligned memory, slab size is page size
+        p = mmap(null,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if(p == MAP_FAILED)
+            return null;
+    }else if(posix_memalign(&p,GC_POOL_SLAB_SIZE,size) != 0){
+        return null;
+    }
+    if(!gc_pool_map_set(pool,p,size,((uintptr_t)p) | (mapped ? GC_POOL_MAP_MAPPED : 0))){
+        if(mapped)
+            munmap(p,size);
+        else
+            free(p);
+        return null;
+    }
+    if(mapped){
+        __atomic_add_fetch(&pool->los_bytes,size,__ATOMIC_RELAXED);
+        __atomic_add_fetch(&pool->los_count,1,__ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+// free large block, it's pages have leaves in page map already so any thread can do this
+// page map entries are cleared first, pool owner might map the same address range again right after
+static void gc_pool_free_large(gc_pool* pool, void* p, size_t size){
+    size = (size + GC_POOL_SLAB_SIZE - 1) & ~((size_t)GC_POOL_SLAB_SIZE-1);
+    bool mapped = (gc_pool_map_get(pool,(uintptr_t)p) & GC_POOL_MAP_MAPPED) != 0;
+    gc_pool_map_set(pool,p,size,0);
+    if(!mapped){
+        free(p);
+        return;
+    }
+    // memory goes back to the system as soon as object dies
+    munmap(p,size);
+    __atomic_sub_fetch(&pool->los_bytes,size,__ATOMIC_RELAXED);
+    __atomic_sub_fetch(&pool->los_count,1,__ATOMIC_RELAXED);
+}
+
+// map new chunk from the system aligned to slab or span size with page map entry of its pages
+static char* gc_pool_map_chunk(gc_pool* pool, size_t align, uintptr_t entry){
+    // mmap returns page aligned memory, so slabs need extra alignment only when larger than a page
+    size_t chunk_size = GC_POOL_SLAB_SIZE*GC_POOL_CHUNK_SLABS;
+    char* chunk = (char*)mmap(null,chunk_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(chunk == MAP_FAILED)
+        return null;
+    if(((uintptr_t)chunk & (align-1)) != 0){
+        // remap with enough room to align chunk
+        munmap(chunk,chunk_size);
+        chunk = (char*)mmap(null,chunk_size+align,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if(chunk == MAP_FAILED)
+            return null;
+        size_t head = align - ((uintptr_t)chunk & (align-1));
+        munmap(chunk,head);
+        munmap(chunk+head+chunk_size,align-head);
+        chunk += head;
+    }
+    if(!gc_pool_map_set(pool,chunk,chunk_size,entry)){
+        munmap(chunk,chunk_size);
+        return null;
+    }
+    // remember chunk so it can be unmapped on destroy
+    if(pool->chunks_count == pool->chunks_size){
+        pool->chunks_size = pool->chunks_size == 0 ? 16 : pool->chunks_size*2;
+        pool->chunks = (void**)realloc(pool->chunks,sizeof(void*)*pool->chunks_size);
+    }
+    pool->chunks[pool->chunks_count++] = chunk;
+    return chunk;
+}
+
+// map new chunk of slabs and put them into empty cache
+static bool gc_pool_map_slabs(gc_pool* pool){
+    char* chunk = gc_pool_map_chunk(pool,GC_POOL_SLAB_SIZE,GC_POOL_MAP_SLAB);
+    if(chunk == null)
+        return false;
+    for(uint32_t i = 0; i < GC_POOL_CHUNK_SLABS; ++i){
+        gc_pool_slab* slab = (gc_pool_slab*)(chunk + i*GC_POOL_SLAB_SIZE);
+        slab->next = pool->empty;
+        pool->empty = slab;
+    }
+    pool->empty_count += GC_POOL_CHUNK_SLABS;
+    return true;
+}
+
+// map new chunk of spans and put them into empty span cache
+static bool gc_pool_map_spans(gc_pool* pool){
+    char* chunk = gc_pool_map_chunk(pool,GC_POOL_SPAN_SIZE,GC_POOL_MAP_SPAN);
+    if(chunk == null)
+        return false;
+    uint32_t count = GC_POOL_SLAB_SIZE*GC_POOL_CHUNK_SLABS/GC_POOL_SPAN_SIZE;
+    for(uint32_t i = 0; i < count; ++i){
+        gc_pool_slab* span = (gc_pool_slab*)(chunk + i*GC_POOL_SPAN_SIZE);
+        span->next = pool->spans_empty;
+        pool->spans_empty = span;
+    }
+    pool->spans_empty_count += count;
+    return true;
+}
+
+// add slab to size class partial list
+static inline void gc_pool_partial_add(gc_pool* pool, gc_pool_slab* slab){
+    gc_pool_slab** list = &(pool->partial[slab->class_index]);
+    slab->prev = null;
+    slab->next = *list;
+    if(slab->next != null)
+        slab->next->prev = slab;
+    *list = slab;
+    slab->partial = true;
+}
+
+// remove slab from size class partial list
+static inline void gc_pool_partial_remove(gc_pool* pool, gc_pool_slab* slab){
+    if(slab->prev != null)
+        slab->prev->next = slab->next;
+    else
+        pool->partial[slab->class_index] = slab->next;
+    if(slab->next != null)
+        slab->next->prev = slab->prev;
+    slab->partial = false;
+}
+
+// take empty single page slab
+static gc_pool_slab* gc_pool_slab_take_empty(gc_pool* pool){
+    gc_pool_slab* slab;
+    if(pool->empty != null){
+        // reuse cached slab
+        slab = pool->empty;
+        pool->empty = slab->next;
+        pool->empty_count -= 1;
+    }else if(pool->released_count > 0){
+        // reuse slab which memory was given back to the system
+        slab = (gc_pool_slab*)pool->released[--pool->released_count];
+    }else{
+        if(!gc_pool_map_slabs(pool))
+            return null;
+        slab = pool->empty;
+        pool->empty = slab->next;
+        pool->empty_count -= 1;
+    }
+    pool->slabs_taken += 1;
+    return slab;
+}
+
+// take empty span
+static gc_pool_slab* gc_pool_span_take_empty(gc_pool* pool){
+    gc_pool_slab* span;
+    if(pool->spans_empty != null){
+        span = pool->spans_empty;
+        pool->spans_empty = span->next;
+        pool->spans_empty_count -= 1;
+    }else if(pool->spans_released_count > 0){
+        span = (gc_pool_slab*)pool->spans_released[--pool->spans_released_count];
+    }else{
+        if(!gc_pool_map_spans(pool))
+            return null;
+        span = pool->spans_empty;
+        pool->spans_empty = span->next;
+        pool->spans_empty_count -= 1;
+    }
+    return span;
+}
+
+// take empty slab or span and initialize it for size class
+static gc_pool_slab* gc_pool_slab_new(gc_pool* pool, uint16_t class_index){
+    bool span = class_index >= GC_POOL_CLASSES;
+    gc_pool_slab* slab = span ? gc_pool_span_take_empty(pool) : gc_pool_slab_take_empty(pool);
+    if(slab == null)
+        return null;
+
+    size_t slab_size = span ? GC_POOL_SPAN_SIZE : GC_POOL_SLAB_SIZE;
+    slab->free = null;
+    slab->bump = ((char*)slab) + GC_POOL_SLAB_HEADER;
+    slab->size = span ? gc_pool_span_sizes[class_index - GC_POOL_CLASSES] : class_index*GC_POOL_ALIGN;
+    slab->live = 0;
+    slab->capacity = (slab_size - GC_POOL_SLAB_HEADER) / slab->size;
+    slab->class_index = class_index;
+    slab->owned = false;
+    slab->evacuating = false;
+    slab->used_shift = span ? GC_POOL_SPAN_USED_SHIFT : GC_POOL_MIN_SHIFT;
+    slab->deferred = null;
+    memset(slab->used,0,sizeof(slab->used));
+    gc_pool_partial_add(pool,slab);
+    pool->slabs_bytes += slab_size;
+    return slab;
+}
+
+// remember empty slab or span which memory was given back to the system
+static inline void gc_pool_released_add(void*** released, uint32_t* count, uint32_t* size, void* slab){
+    if(*count == *size){
+        *size = *size == 0 ? 64 : *size*2;
+        *released = (void**)realloc(*released,sizeof(void*)*(*size));
+    }
+    (*released)[(*count)++] = slab;
+}
+
+// give empty slab memory back to the system
+static void gc_pool_slab_discard(gc_pool* pool, gc_pool_slab* slab){
+    // address range stays reserved inside its chunk so it's remembered outside of the slab
+    if(gc_pool_slab_is_span(slab)){
+        madvise(slab,GC_POOL_SPAN_SIZE,MADV_DONTNEED);
+        gc_pool_released_add(&pool->spans_released,&pool->spans_released_count,&pool->spans_released_size,slab);
+        return;
+    }
+    madvise(slab,GC_POOL_SLAB_SIZE,MADV_DONTNEED);
+    gc_pool_released_add(&pool->released,&pool->released_count,&pool->released_size,slab);
+}
+
+// remove slab from evacuated slabs list
+static inline void gc_pool_evacuating_remove(gc_pool* pool, gc_pool_slab* slab){
+    if(slab->prev != null)
+        slab->prev->next = slab->next;
+    else
+        pool->evacuating = slab->next;
+    if(slab->next != null)
+        slab->next->prev = slab->prev;
+    slab->evacuating = false;
+}
+
+// release slab that has no live slots left
+static void gc_pool_slab_release(gc_pool* pool, gc_pool_slab* slab){
+    if(slab->partial)
+        gc_pool_partial_remove(pool,slab);
+    if(slab->evacuating)
+        gc_pool_evacuating_remove(pool,slab);
+    if(gc_pool_slab_is_span(slab)){
+        pool->slabs_bytes -= GC_POOL_SPAN_SIZE;
+        if(pool->spans_empty_count < GC_POOL_CACHED_SPANS){
+            slab->next = pool->spans_empty;
+            pool->spans_empty = slab;
+            pool->spans_empty_count += 1;
+            return;
+        }
+        gc_pool_slab_discard(pool,slab);
+        return;
+    }
+    pool->slabs_bytes -= GC_POOL_SLAB_SIZE;
+    if(pool->empty_count < pool->cache_limit){
+        // keep slab cached for reuse
+        slab->next = pool->empty;
+        pool->empty = slab;
+        pool->empty_count += 1;
+        return;
+    }
+    // enough empty slabs are cached already
+    gc_pool_slab_discard(pool,slab);
+}
+
+// adapt empty slab cache to number of slabs taken into use since last trim
+void gc_pool_trim(gc_pool* pool){
+    pool->cache_limit = pool->slabs_taken > GC_POOL_CACHED_SLABS ? pool->slabs_taken : GC_POOL_CACHED_SLABS;
+    pool->slabs_taken = 0;
+    while(pool->empty_count > pool->cache_limit){
+        gc_pool_slab* slab = pool->empty;
+        pool->empty = slab->next;
+        pool->empty_count -= 1;
+        gc_pool_slab_discard(pool,slab);
+    }
+}
+
+// allocate memory block of given size
+void* gc_pool_alloc(gc_pool* pool, size_t size){
+    if(size > GC_POOL_SPAN_MAX_SIZE)
+        return gc_pool_alloc_large(pool,size);
+    if(size < GC_POOL_MIN_SIZE)
+        size = GC_POOL_MIN_SIZE;
+    if(__atomic_load_n(&pool->remote,__ATOMIC_RELAXED) != null)
+        gc_pool_collect_remote(pool);
+
+    uint16_t class_index = size > GC_POOL_MAX_SIZE ? gc_pool_span_class_index(size) : gc_pool_class_index(size);
+    gc_pool_slab* slab = pool->partial[class_index];
+    if(slab == null){
+        slab = gc_pool_slab_new(pool,class_index);
+        if(slab == null)
+            return null;
+    }
+
+    // take released slot first, otherwise bump into never used space
+    void* p = gc_pool_slab_alloc(slab);
+
+    // slab is full, nothing more to allocate from it
+    if(slab->live == slab->capacity)
+        gc_pool_partial_remove(pool,slab);
+
+    return p;
+}
+
+// release slot back to it's slab
+static inline void gc_pool_slab_free(gc_pool* pool, gc_pool_slab* slab, void* p){
+    *((void**)p) = slab->free;
+    slab->free = p;
+    slab->live -= 1;
+    gc_pool_slab_set_used(slab,p,false);
+
+    // owning thread keeps allocating from it
+    if(slab->owned)
+        return;
+
+    // whole slab is free, release it at once
+    if(slab->live == 0){
+        gc_pool_slab_release(pool,slab);
+        return;
+    }
+
+    // slab has free slots again
+    if(!slab->partial && !slab->evacuating)
+        gc_pool_partial_add(pool,slab);
+}
+
+// release memory block of given size
+void gc_pool_free(gc_pool* pool, void* p, size_t size){
+    if(size > GC_POOL_SPAN_MAX_SIZE){
+        gc_pool_free_large(pool,p,size);
+        return;
+    }
+    gc_pool_slab_free(pool,gc_pool_slab_of_size(p,size),p);
+}
+
+// release memory block of given size from other thread than pool owner, pool owner takes it back later
+void gc_pool_free_remote(gc_pool* pool, void* p, size_t size){
+    if(size > GC_POOL_SPAN_MAX_SIZE){
+        gc_pool_free_large(pool,p,size);
+        return;
+    }
+    // slab header isn't touched, pool owner might release slab as soon as slot is pushed
+    void* head = __atomic_load_n(&pool->remote,__ATOMIC_RELAXED);
+    do{
+        *((void**)p) = head;
+    }while(!__atomic_compare_exchange_n(&pool->remote,&head,p,true,__ATOMIC_RELEASE,__ATOMIC_RELAXED));
+}
+
+// take back slots released by other threads, slots of owned slabs are kept until slab is returned
+void gc_pool_collect_remote(gc_pool* pool){
+    void* p = __atomic_exchange_n(&pool->remote,null,__ATOMIC_ACQUIRE);
+    while(p != null){
+        void* next = *((void**)p);
+        // size of slot isn't known here, page map tells if it's inside span
+        gc_pool_slab* slab = gc_pool_map_get(pool,(uintptr_t)p) == GC_POOL_MAP_SPAN ? gc_pool_span_of(p) : gc_pool_slab_of(p);
+        if(slab->owned){
+            // owning thread allocates from slab without lock
+            *((void**)p) = slab->deferred;
+            slab->deferred = p;
+        }else{
+            gc_pool_slab_free(pool,slab,p);
+        }
+        p = next;
+    }
+}
+
+// find start of allocated block containing address, null if address isn't inside any
+// slots released by other threads count as allocated until pool owner takes them back
+void* gc_pool_lookup(gc_pool* pool, void* p, bool* small){
+    uintptr_t address = (uintptr_t)p;
+    uintptr_t entry = gc_pool_map_get(pool,address);
+    *small = entry == GC_POOL_MAP_SLAB;
+    if(entry != GC_POOL_MAP_SLAB && entry != GC_POOL_MAP_SPAN)
+        return (void*)(entry & ~GC_POOL_MAP_MAPPED);
+    // find slot address points into and check that it's allocated
+    gc_pool_slab* slab = entry == GC_POOL_MAP_SLAB ? gc_pool_slab_of(address) : gc_pool_span_of(address);
+    uintptr_t first = (uintptr_t)slab + GC_POOL_SLAB_HEADER;
+    // slab memory given back to the system reads as zeros
+    if(slab->size == 0 || address < first)
+        return null;
+    uintptr_t index = (address - first) / slab->size;
+    if(index >= slab->capacity)
+        return null;
+    uintptr_t start = first + index*slab->size;
+    uint32_t bit = (uint32_t)((start - (uintptr_t)slab) >> slab->used_shift);
+    if((__atomic_load_n(&(slab->used[bit >> 6]),__ATOMIC_RELAXED) & (((uint64_t)1) << (bit & 63))) == 0)
+        return null;
+    return (void*)start;
+}
+
+// number of slabs of size class at most half full, moving objects out of single one doesn't free anything
+static inline uint32_t gc_pool_sparse_count(gc_pool* pool, uint32_t class_index){
+    uint32_t count = 0;
+    for(gc_pool_slab* slab = pool->partial[class_index]; slab != null; slab = slab->next){
+        if(slab->live <= slab->capacity/2)
+            count += 1;
+    }
+    return count < 2 ? 0 : count;
+}
+
+// take sparse slabs out of allocation so their live slots can be moved elsewhere
+uint32_t gc_pool_evacuate_begin(gc_pool* pool, uint32_t min_slabs){
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < GC_POOL_ALL_CLASSES; ++i)
+        count += gc_pool_sparse_count(pool,i);
+    if(count == 0 || count < min_slabs)
+        return 0;
+    for(uint32_t i = 0; i < GC_POOL_ALL_CLASSES; ++i){
+        if(gc_pool_sparse_count(pool,i) == 0)
+            continue;
+        gc_pool_slab* slab = pool->partial[i];
+        while(slab != null){
+            gc_pool_slab* next = slab->next;
+            if(slab->live <= slab->capacity/2){
+                // evacuated slabs are linked the same way as partial ones
+                gc_pool_partial_remove(pool,slab);
+                slab->evacuating = true;
+                slab->prev = null;
+                slab->next = pool->evacuating;
+                if(slab->next != null)
+                    slab->next->prev = slab;
+                pool->evacuating = slab;
+            }
+            slab = next;
+        }
+    }
+    return count;
+}
+
+// give slabs that weren't emptied by compaction back to allocation
+void gc_pool_evacuate_end(gc_pool* pool){
+    while(pool->evacuating != null){
+        gc_pool_slab* slab = pool->evacuating;
+        gc_pool_evacuating_remove(pool,slab);
+        gc_pool_partial_add(pool,slab);
+    }
+}
+
+// take slab with free slots of size class for exclusive allocation
+gc_pool_slab* gc_pool_take_slab(gc_pool* pool, uint16_t class_index){
+    if(class_index < gc_pool_class_index(GC_POOL_MIN_SIZE))
+        class_index = gc_pool_class_index(GC_POOL_MIN_SIZE);
+    if(__atomic_load_n(&pool->remote,__ATOMIC_RELAXED) != null)
+        gc_pool_collect_remote(pool);
+    gc_pool_slab* slab = pool->partial[class_index];
+    if(slab == null){
+        slab = gc_pool_slab_new(pool,class_index);
+        if(slab == null)
+            return null;
+    }
+    gc_pool_partial_remove(pool,slab);
+    slab->owned = true;
+    return slab;
+}
+
+// give owned slab back to the pool
+void gc_pool_return_slab(gc_pool* pool, gc_pool_slab* slab){
+    // slots released by other threads meanwhile
+    while(slab->deferred != null){
+        void* p = slab->deferred;
+        slab->deferred = *((void**)p);
+        *((void**)p) = slab->free;
+        slab->free = p;
+        slab->live -= 1;
+        gc_pool_slab_set_used(slab,p,false);
+    }
+    slab->owned = false;
+    if(slab->live == 0)
+        gc_pool_slab_release(pool,slab);
+    else if(slab->live < slab->capacity)
+        gc_pool_partial_add(pool,slab);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef GC_POOL_H
+#define GC_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// slab size in bytes, slabs are aligned to their size
+#define GC_POOL_SLAB_SHIFT 12
+#define GC_POOL_SLAB_SIZE (1 << GC_POOL_SLAB_SHIFT)
+// number of slabs mapped from the system at once
+#define GC_POOL_CHUNK_SLABS 64
+// minimum number of empty slabs kept for reuse instead of being returned to the system
+#define GC_POOL_CACHED_SLABS 64
+// slot size granularity
+#define GC_POOL_ALIGN 8
+// smallest slot size, gc object header doesn't fit into less anyway
+#define GC_POOL_MIN_SHIFT 5
+#define GC_POOL_MIN_SIZE (1 << GC_POOL_MIN_SHIFT)
+// allocations larger than this don't fit into single page slabs and are taken from spans
+#define GC_POOL_MAX_SIZE 1024
+// span, slab of several pages for allocations larger than GC_POOL_MAX_SIZE, spans are aligned to their size
+#define GC_POOL_SPAN_SHIFT 16
+#define GC_POOL_SPAN_SIZE (1 << GC_POOL_SPAN_SHIFT)
+// number of span size classes, their slots split span evenly into 63 down to 4 slots
+#define GC_POOL_SPAN_CLASSES 18
+// minimum number of empty spans kept for reuse instead of being returned to the system
+#define GC_POOL_CACHED_SPANS 4
+// span slots are larger than 1024 bytes, so used bit per 1024 bytes is enough
+#define GC_POOL_SPAN_USED_SHIFT 10
+// default size from which large blocks are mapped into regions of their own instead of coming from malloc
+#define GC_POOL_LOS_THRESHOLD (128*1024)
+// number of single page slab size classes
+#define GC_POOL_CLASSES (GC_POOL_MAX_SIZE/GC_POOL_ALIGN + 1)
+// number of size classes, span classes follow single page slab ones
+#define GC_POOL_ALL_CLASSES (GC_POOL_CLASSES + GC_POOL_SPAN_CLASSES)
+// size class of allocation size
+#define gc_pool_class_index(size) (((size) + GC_POOL_ALIGN - 1) / GC_POOL_ALIGN)
+// get slab from pointer to any of its slots
+#define gc_pool_slab_of(p) ((gc_pool_slab*)((uintptr_t)(p) & ~((uintptr_t)GC_POOL_SLAB_SIZE-1)))
+// get span from pointer to any of its slots
+#define gc_pool_span_of(p) ((gc_pool_slab*)((uintptr_t)(p) & ~((uintptr_t)GC_POOL_SPAN_SIZE-1)))
+
+// page map, two level radix index of pool memory with slab sized pages
+// covers 48 bit address space, root and leaves are allocated lazily and zero filled pages of leaves
+// are never touched unless pool memory is mapped there
+#define GC_POOL_MAP_ADDRESS_BITS 48
+#define GC_POOL_MAP_LEAF_BITS 18
+#define GC_POOL_MAP_ROOT_BITS (GC_POOL_MAP_ADDRESS_BITS - GC_POOL_MAP_LEAF_BITS - GC_POOL_SLAB_SHIFT)
+// page map entry of slab page, other non zero entries are start addresses of large blocks
+#define GC_POOL_MAP_SLAB ((uintptr_t)1)
+// set in page map entries of large block with mmap region of it's own
+#define GC_POOL_MAP_MAPPED ((uintptr_t)2)
+// page map entry of span page
+#define GC_POOL_MAP_SPAN ((uintptr_t)4)
+
+// slab, lives at the start of its own GC_POOL_SLAB_SIZE aligned memory block, or GC_POOL_SPAN_SIZE one for spans
+typedef struct gc_pool_slab_t {
+    struct gc_pool_slab_t* next; // next slab in size class partial list or in empty cache
+    struct gc_pool_slab_t* prev; // previous slab in size class partial list
+    void* free; // free list of released slots
+    char* bump; // first never used slot
+    uint32_t size; // slot size
+    uint32_t live; // number of allocated slots
+    uint32_t capacity; // total number of slots
+    uint16_t class_index; // size class this slab belongs to
+    bool partial; // slab is linked into size class partial list
+    bool owned; // slab is owned by a thread allocating from it, it's never released while owned
+    bool evacuating; // slab is being emptied by compaction, nothing is allocated from it meanwhile
+    uint8_t used_shift; // used bit granularity, GC_POOL_MIN_SHIFT for slabs and GC_POOL_SPAN_USED_SHIFT for spans
+    void* deferred; // slots released by other threads while slab was owned, still count as live
+    // bit per 1 << used_shift bytes of slab, set where allocated slot starts
+    uint64_t used[GC_POOL_SLAB_SIZE/GC_POOL_MIN_SIZE/64];
+} gc_pool_slab;
+
+// offset of first slot in slab, keeps slots cache line aligned
+#define GC_POOL_SLAB_HEADER ((sizeof(gc_pool_slab) + 63) & ~((size_t)63))
+// slot size of span holding given number of slots
+#define GC_POOL_SPAN_SLOT(slots) (((GC_POOL_SPAN_SIZE - GC_POOL_SLAB_HEADER)/(slots)) & ~((size_t)GC_POOL_ALIGN-1))
+// largest span slot, larger allocations get page aligned blocks of their own
+#define GC_POOL_SPAN_MAX_SIZE GC_POOL_SPAN_SLOT(4)
+
+// pool allocator
+typedef struct {
+    gc_pool_slab* partial[GC_POOL_ALL_CLASSES]; // slabs with free slots per size class
+    gc_pool_slab* empty; // cached empty slabs
+    uint32_t empty_count; // number of cached empty slabs
+    // number of empty slabs kept cached, as many as were taken into use between trims so memory
+    // of short lived objects is reused by next allocations instead of going back to the system
+    uint32_t cache_limit;
+    uint32_t slabs_taken; // slabs taken into use since last trim
+    void** released; // empty slabs which memory was given back to the system
+    uint32_t released_count;
+    uint32_t released_size;
+    gc_pool_slab* spans_empty; // cached empty spans
+    uint32_t spans_empty_count; // number of cached empty spans
+    void** spans_released; // empty spans which memory was given back to the system
+    uint32_t spans_released_count;
+    uint32_t spans_released_size;
+    void** chunks; // memory chunks mapped from the system
+    uint32_t chunks_count;
+    uint32_t chunks_size;
+    uint64_t slabs_bytes; // bytes of slabs and spans holding live objects
+    void* remote; // slots released by other threads than pool owner
+    gc_pool_slab* evacuating; // sparse slabs being emptied by compaction
+    uintptr_t** map; // page map root
+    // large object space, blocks of at least threshold size are mapped into regions of their own and unmapped
+    // as soon as they are freed, 0 threshold takes every large block from malloc
+    size_t los_threshold;
+    uint64_t los_bytes; // bytes mapped by large object space, other threads freeing blocks change it too
+    uint64_t los_count; // number of blocks in large object space
+} gc_pool;
+
+// initialize pool
+void gc_pool_init(gc_pool* pool);
+
+// return all pool memory to the system
+void gc_pool_destroy(gc_pool* pool);
+
+// allocate memory block of given size
+void* gc_pool_alloc(gc_pool* pool, size_t size);
+
+// release memory block of given size
+void gc_pool_free(gc_pool* pool, void* p, size_t size);
+
+// release memory block of given size from other thread than pool owner, pool owner takes it back later
+void gc_pool_free_remote(gc_pool* pool, void* p, size_t size);
+
+// take back slots released by other threads, slots of owned slabs are kept until slab is returned
+void gc_pool_collect_remote(gc_pool* pool);
+
+// find start of allocated block containing address, null if address isn't inside any
+// slots released by other threads count as allocated until pool owner takes them back
+// small is set to whether block is slot of single page slab
+void* gc_pool_lookup(gc_pool* pool, void* p, bool* small);
+
+// number of bytes reserved for block of span size class
+size_t gc_pool_span_reserved(size_t size);
+
+// number of bytes pool reserves for block of given size
+static inline size_t gc_pool_reserved(size_t size){
+    if(size <= GC_POOL_MAX_SIZE)
+        return size < GC_POOL_MIN_SIZE ? GC_POOL_MIN_SIZE : (size + GC_POOL_ALIGN - 1) & ~((size_t)GC_POOL_ALIGN-1);
+    if(size <= GC_POOL_SPAN_MAX_SIZE)
+        return gc_pool_span_reserved(size);
+    return (size + GC_POOL_SLAB_SIZE - 1) & ~((size_t)GC_POOL_SLAB_SIZE-1);
+}
+
+// get slab or span of pool allocated block of given size
+static inline gc_pool_slab* gc_pool_slab_of_size(void* p, size_t size){
+    return size <= GC_POOL_MAX_SIZE ? gc_pool_slab_of(p) : gc_pool_span_of(p);
+}
+
+// adapt empty slab cache to number of slabs taken into use since last trim
+// and give memory of cached slabs above it back to the system
+void gc_pool_trim(gc_pool* pool);
+
+// take slab with free slots of size class for exclusive allocation
+gc_pool_slab* gc_pool_take_slab(gc_pool* pool, uint16_t class_index);
+
+// give owned slab back to the pool
+void gc_pool_return_slab(gc_pool* pool, gc_pool_slab* slab);
+
+// take sparse slabs out of allocation so their live slots can be moved elsewhere
+// only size classes with at least two slabs at most half full are taken, returns number of slabs taken
+// or 0 without taking any if there are less than min_slabs of them
+uint32_t gc_pool_evacuate_begin(gc_pool* pool, uint32_t min_slabs);
+
+// give slabs that weren't emptied by compaction back to allocation
+void gc_pool_evacuate_end(gc_pool* pool);
+
+// check if slot of pool allocated block is inside slab or span being evacuated
+static inline bool gc_pool_evacuating(void* p, size_t size){
+    return size <= GC_POOL_SPAN_MAX_SIZE && gc_pool_slab_of_size(p,size)->evacuating;
+}
+
+// set or clear used bit of slot, only pool or slab owner changes it but lookups read it from any thread
+static inline void gc_pool_slab_set_used(gc_pool_slab* slab, void* p, bool used){
+    uint32_t bit = (uint32_t)(((uintptr_t)p - (uintptr_t)slab) >> slab->used_shift);
+    uint64_t* word = &(slab->used[bit >> 6]);
+    uint64_t mask = ((uint64_t)1) << (bit & 63);
+    uint64_t v = __atomic_load_n(word,__ATOMIC_RELAXED);
+    __atomic_store_n(word,used ? (v | mask) : (v & ~mask),__ATOMIC_RELAXED);
+}
+
+// allocate slot from owned slab, returns null if slab is full
+static inline void* gc_pool_slab_alloc(gc_pool_slab* slab){
+    if(slab->live == slab->capacity)
+        return NULL;
+    void* p = slab->free;
+    if(p != NULL){
+        slab->free = *((void**)p);
+    }else{
+        p = slab->bump;
+        slab->bump += slab->size;
+    }
+    slab->live += 1;
+    gc_pool_slab_set_used(slab,p,true);
+    return p;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// pthread_getattr_np
+#define _GNU_SOURCE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <pthread.h>
+
+// stack base of current thread, found once per thread
+static __thread char* local_stack_base = null;
+
+// get highest address of current thread stack
+char* gc_stack_base(){
+    if(local_stack_base == null){
+        pthread_attr_t attr;
+        void* addr;
+        size_t size;
+        if(pthread_getattr_np(pthread_self(),&attr) != 0)
+            return null;
+        pthread_attr_getstack(&attr,&addr,&size);
+        pthread_attr_destroy(&attr);
+        local_stack_base = ((char*)addr) + size;
+    }
+    return local_stack_base;
+}
+
+// get stack pointer of caller, everything below it is reused by calls caller makes next
+__attribute__((noinline)) static char* gc_stack_pointer(){
+    return ((char*)__builtin_frame_address(0)) + 2*sizeof(void*);
+}
+
+// shade objects pointed to by words of memory range, words might point inside objects
+__attribute__((no_sanitize_address,no_sanitize_thread))
+static void gc_stack_scan_range(gc_heap* heap, char* start, char* end){
+    void** p = (void**)(((uintptr_t)start + sizeof(void*) - 1) & ~((uintptr_t)sizeof(void*) - 1));
+    for(; (char*)(p+1) <= end; ++p){
+        // garbage not yet freed is pointed to only by stale words, lookup doesn't find it
+        gc_object* obj = gc_heap_lookup(heap,*p);
+        if(obj == null)
+            continue;
+        if(gc_color_is_silver_or_white(obj)){
+            gc_list_move(obj,&heap->grey);
+            gc_mark_grey(obj);
+        }
+    }
+}
+
+// save registers and end of stack of thread that stops touching heap, top is stack pointer of caller's caller
+// caller's frame is copied since it might hold callee saved registers of it's caller and gets reused
+__attribute__((noinline,no_sanitize_address,no_sanitize_thread))
+void gc_thread_save_stack(gc_thread* t, char* top){
+    getcontext(&(t->registers));
+    char* bottom = gc_stack_pointer();
+    if(top - bottom > GC_THREAD_FRAME_SIZE)
+        bottom = top - GC_THREAD_FRAME_SIZE;
+    t->frame_size = (uint32_t)(top - bottom);
+    for(uint32_t i = 0; i < t->frame_size; ++i)
+        t->frame[i] = bottom[i];
+    t->stack_top = top;
+}
+
+// shade objects referenced from stack and registers of current thread
+__attribute__((noinline))
+static void gc_stack_scan_self(gc_heap* heap){
+    ucontext_t registers;
+    getcontext(&registers);
+    gc_stack_scan_range(heap,(char*)&registers,((char*)&registers) + sizeof(ucontext_t));
+    char* base = gc_stack_base();
+    if(base != null)
+        gc_stack_scan_range(heap,gc_stack_pointer(),base);
+}
+
+// shade objects referenced from stacks and registers of mutator threads, self scans current thread too
+void gc_heap_scan_stacks(gc_heap* heap, bool self){
+    if(!heap->conservative)
+        return;
+    gc_thread* current = null;
+    if(self){
+        current = gc_thread_find(heap);
+        gc_stack_scan_self(heap);
+    }
+    // other attached threads are parked, their stacks don't change until they resume
+    for(gc_thread* t = heap->threads; t != null; t = t->next){
+        if(t == current || t->stack_top == null || t->stack_base == null)
+            continue;
+        gc_stack_scan_range(heap,(char*)&(t->registers),((char*)&(t->registers)) + sizeof(ucontext_t));
+        gc_stack_scan_range(heap,t->frame,t->frame + t->frame_size);
+        gc_stack_scan_range(heap,t->stack_top,t->stack_base);
+    }
+}
+
+// enable or disable conservative scanning of thread stacks for roots
+void gc_heap_set_conservative(gc_heap* heap, bool enabled){
+    heap->conservative = enabled;
+}
+
+// enable or disable conservative scanning of thread stacks for roots on default heap
+void gc_set_conservative(bool enabled){
+    gc_heap_set_conservative(gc_get_heap(),enabled);
+}
+
+#ifdef __cplusplus
+}
+#endif
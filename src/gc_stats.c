@@ -0,0 +1,216 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// stats phase each pause scheduler phase counts into, time outside of phases isn't counted
+static const uint8_t gc_stats_phase_of[GC_PACE_PHASES] = {
+    [GC_PACE_NONE] = GC_STATS_PHASES,
+    [GC_PACE_CLEANUP] = GC_STATS_TRANSPARENT,
+    [GC_PACE_PROMOTE] = GC_STATS_PROMOTION,
+    [GC_PACE_MARK] = GC_STATS_MARK,
+    [GC_PACE_REMEMBERED] = GC_STATS_MARK_SILVER,
+    [GC_PACE_WHITEN] = GC_STATS_WHITEN,
+    [GC_PACE_SWEEP] = GC_STATS_SWEEP,
+    [GC_PACE_EVACUATE] = GC_STATS_COMPACT,
+    [GC_PACE_FIX] = GC_STATS_COMPACT,
+    [GC_PACE_FREE] = GC_STATS_COMPACT,
+    [GC_PACE_WEAK] = GC_STATS_WEAK,
+    [GC_PACE_REFRESH] = GC_STATS_REFRESH
+};
+
+// phase names used in json
+static const char* const gc_stats_phase_names[GC_STATS_PHASES] = {
+    "transparent", "promotion", "refresh", "mark", "mark_silver", "whiten", "weak", "sweep", "compact"
+};
+
+// histogram bucket of pause duration, durations below 4 nanoseconds get bucket each,
+// every power of two above is split into four buckets
+static inline uint32_t gc_stats_pause_bucket(uint64_t duration){
+    if(duration < 4)
+        return (uint32_t)duration;
+    uint32_t log = 63 - __builtin_clzll(duration);
+    return (log-1)*4 + (uint32_t)((duration >> (log-2)) & 3);
+}
+
+// exclusive upper bound of pause durations counted in histogram bucket
+uint64_t gc_stats_pause_limit(uint32_t bucket){
+    bucket += 1;
+    if(bucket >= GC_STATS_PAUSE_BUCKETS)
+        return UINT64_MAX;
+    if(bucket < 4)
+        return bucket;
+    return ((uint64_t)(4 + bucket%4)) << (bucket/4 - 1);
+}
+
+// add time since current phase started to it's stats, next phase starts now
+void gc_stats_phase_end(gc_heap* heap, uint64_t now){
+    uint8_t phase = gc_stats_phase_of[heap->pace_phase];
+    if(phase != GC_STATS_PHASES && now > heap->stats.phase_start)
+        gc_stats_add(heap->stats.phase_time[heap->pace_phase],now - heap->stats.phase_start);
+    heap->stats.phase_start = now;
+}
+
+// count pause of given duration into stats
+void gc_stats_pause(gc_heap* heap, uint64_t duration){
+    gc_heap_stats* s = &heap->stats;
+    gc_stats_add(s->pauses,1);
+    gc_stats_add(s->pause_time,duration);
+    gc_stats_add(s->pause_histogram[gc_stats_pause_bucket(duration)],1);
+    if(duration > s->pause_max)
+        __atomic_store_n(&s->pause_max,duration,__ATOMIC_RELAXED);
+}
+
+// count full cycle into stats and measure allocation rate since previous one
+void gc_stats_cycle(gc_heap* heap){
+    gc_heap_stats* s = &heap->stats;
+    uint64_t now = get_nanotime();
+    uint64_t bytes = __atomic_load_n(&s->allocated_bytes,__ATOMIC_RELAXED) +
+                     __atomic_load_n(&s->published_bytes,__ATOMIC_RELAXED);
+    if(now > s->rate_time)
+        __atomic_store_n(&s->allocation_rate,(uint64_t)(((double)(bytes - s->rate_bytes))*1000000000.0/(now - s->rate_time)),
+                         __ATOMIC_RELAXED);
+    s->rate_bytes = bytes;
+    s->rate_time = now;
+    gc_stats_add(s->cycles,1);
+}
+
+// upper bound of histogram bucket pause with given rank falls into, longest pause bounds it too
+static uint64_t gc_stats_percentile(const gc_stats* stats, uint64_t count, uint32_t percent){
+    uint64_t rank = (count*percent + 99)/100, seen = 0;
+    for(uint32_t i = 0; i < GC_STATS_PAUSE_BUCKETS; ++i){
+        seen += stats->pause_histogram[i];
+        if(seen >= rank && seen > 0){
+            uint64_t limit = gc_stats_pause_limit(i) - 1;
+            return limit < stats->pause_max ? limit : stats->pause_max;
+        }
+    }
+    return stats->pause_max;
+}
+
+// read counter written by other thread
+#define gc_stats_load(counter) __atomic_load_n(&(counter),__ATOMIC_RELAXED)
+
+// get heap statistics
+void gc_heap_get_stats(gc_heap* heap, gc_stats* stats){
+    gc_heap_stats* s = &heap->stats;
+    memset(stats,0,sizeof(gc_stats));
+    stats->cycles = gc_stats_load(s->cycles);
+    stats->pauses = gc_stats_load(s->pauses);
+    stats->pause_time = gc_stats_load(s->pause_time);
+    stats->pause_max = gc_stats_load(s->pause_max);
+    uint64_t counted = 0;
+    for(uint32_t i = 0; i < GC_STATS_PAUSE_BUCKETS; ++i){
+        stats->pause_histogram[i] = gc_stats_load(s->pause_histogram[i]);
+        counted += stats->pause_histogram[i];
+    }
+    stats->pause_p50 = gc_stats_percentile(stats,counted,50);
+    stats->pause_p99 = gc_stats_percentile(stats,counted,99);
+    for(uint32_t i = 0; i < GC_PACE_PHASES; ++i){
+        if(gc_stats_phase_of[i] != GC_STATS_PHASES)
+            stats->phase_time[gc_stats_phase_of[i]] += gc_stats_load(s->phase_time[i]);
+    }
+    stats->allocated_objects = gc_stats_load(s->allocated_objects) + gc_stats_load(s->published_objects);
+    stats->allocated_bytes = gc_stats_load(s->allocated_bytes) + gc_stats_load(s->published_bytes);
+    stats->allocation_rate = gc_stats_load(s->allocation_rate);
+    stats->compacted_bytes = gc_stats_load(s->compacted_bytes);
+    stats->gens_count = heap->conf.gens_count;
+    // objects entering generation are those allocated or promoted from previous one
+    uint64_t in_objects = stats->allocated_objects, in_bytes = stats->allocated_bytes;
+    for(uint8_t i = 0; i < stats->gens_count; ++i){
+        uint64_t promoted_objects = gc_stats_load(s->promoted_objects[i]);
+        uint64_t promoted_bytes = gc_stats_load(s->promoted_bytes[i]);
+        uint64_t collected_objects = gc_stats_load(s->freed_objects[i]) + gc_stats_load(s->swept_objects[i]);
+        uint64_t collected_bytes = gc_stats_load(s->freed_bytes[i]) + gc_stats_load(s->swept_bytes[i]);
+        stats->promoted_objects += promoted_objects;
+        stats->promoted_bytes += promoted_bytes;
+        stats->collected_objects += collected_objects;
+        stats->collected_bytes += collected_bytes;
+        // counters read one by one might briefly disagree, generation never holds less than nothing
+        uint64_t out_objects = promoted_objects + collected_objects, out_bytes = promoted_bytes + collected_bytes;
+        stats->gen_objects[i] = in_objects > out_objects ? in_objects - out_objects : 0;
+        stats->gen_bytes[i] = in_bytes > out_bytes ? in_bytes - out_bytes : 0;
+        in_objects = promoted_objects;
+        in_bytes = promoted_bytes;
+    }
+}
+
+// get default heap statistics
+void gc_get_stats(gc_stats* stats){
+    gc_heap_get_stats(gc_get_heap(),stats);
+}
+
+// append formatted text to buffer, length keeps counting past it's end
+static void gc_stats_append(char* buf, size_t size, size_t* len, const char* format, ...){
+    va_list args;
+    va_start(args,format);
+    int n = *len < size ? vsnprintf(buf + *len,size - *len,format,args) : vsnprintf(null,0,format,args);
+    va_end(args);
+    if(n > 0)
+        *len += (size_t)n;
+}
+
+// write stats as json object into buffer
+size_t gc_stats_json(const gc_stats* stats, char* buf, size_t size){
+    size_t len = 0;
+    if(size > 0)
+        buf[0] = '\0';
+    gc_stats_append(buf,size,&len,"{\"cycles\":%" PRIu64 ",\"pauses\":%" PRIu64 ",\"pause_time\":%" PRIu64
+                    ",\"pause_p50\":%" PRIu64 ",\"pause_p99\":%" PRIu64 ",\"pause_max\":%" PRIu64 ",\"pause_histogram\":[",
+                    stats->cycles,stats->pauses,stats->pause_time,stats->pause_p50,stats->pause_p99,stats->pause_max);
+    bool first = true;
+    for(uint32_t i = 0; i < GC_STATS_PAUSE_BUCKETS; ++i){
+        if(stats->pause_histogram[i] == 0)
+            continue;
+        gc_stats_append(buf,size,&len,"%s[%" PRIu64 ",%" PRIu64 "]",first ? "" : ",",
+                        gc_stats_pause_limit(i),stats->pause_histogram[i]);
+        first = false;
+    }
+    gc_stats_append(buf,size,&len,"],\"phase_time\":{");
+    for(uint32_t i = 0; i < GC_STATS_PHASES; ++i)
+        gc_stats_append(buf,size,&len,"%s\"%s\":%" PRIu64,i == 0 ? "" : ",",gc_stats_phase_names[i],stats->phase_time[i]);
+    gc_stats_append(buf,size,&len,"},\"allocated_objects\":%" PRIu64 ",\"allocated_bytes\":%" PRIu64
+                    ",\"allocation_rate\":%" PRIu64 ",\"collected_objects\":%" PRIu64 ",\"collected_bytes\":%" PRIu64
+                    ",\"promoted_objects\":%" PRIu64 ",\"promoted_bytes\":%" PRIu64 ",\"compacted_bytes\":%" PRIu64
+                    ",\"generations\":[",
+                    stats->allocated_objects,stats->allocated_bytes,stats->allocation_rate,stats->collected_objects,
+                    stats->collected_bytes,stats->promoted_objects,stats->promoted_bytes,stats->compacted_bytes);
+    for(uint8_t i = 0; i < stats->gens_count && i < GC_STATS_GENS; ++i)
+        gc_stats_append(buf,size,&len,"%s{\"objects\":%" PRIu64 ",\"bytes\":%" PRIu64 "}",i == 0 ? "" : ",",
+                        stats->gen_objects[i],stats->gen_bytes[i]);
+    gc_stats_append(buf,size,&len,"]}");
+    return len;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,177 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+
+// background sweeper, finalizes and frees transparent lists handed over by collection
+struct gc_sweeper_t {
+    gc_heap* heap; // heap garbage belongs to
+    pthread_t thread;
+    pthread_mutex_t lock; // protects queue
+    pthread_cond_t work_cond; // signaled when list is queued or sweeper should exit
+    pthread_cond_t space_cond; // signaled when sweeper is done with list
+    gc_sweep_policy policy; // what collection does when queue is full
+    bool shutdown; // sweeper should exit once queue is empty
+    // ring of detached transparent lists, list being swept still takes it's place
+    gc_object** queue;
+    uint32_t queue_depth;
+    uint32_t queue_head;
+    uint32_t queue_count;
+};
+
+// finalize and free every object of detached transparent list
+static void gc_sweeper_sweep(gc_sweeper* s, gc_object* list){
+    while(list != null){
+        gc_object* obj = list;
+        list = list->gc_next;
+        if(obj->class->gc_finalize != null)
+            (obj->class->gc_finalize)(obj);
+        gc_stats_add(s->heap->stats.swept_objects[gc_gen_num(obj)],1);
+        gc_stats_add(s->heap->stats.swept_bytes[gc_gen_num(obj)],gc_object_block_reserved(obj));
+#ifdef GC_USE_MALLOC
+        free(gc_object_block(obj));
+#else
+        // memory pool belongs to mutators, slot is given back to it later
+        gc_pool_free_remote(&s->heap->pool,gc_object_block(obj),gc_object_block_size(obj));
+#endif
+    }
+}
+
+// background sweeper thread
+static void* gc_sweeper_thread(void* arg){
+    gc_sweeper* s = (gc_sweeper*)arg;
+    // object class callbacks need to know which heap garbage belongs to
+    collecting_heap = s->heap;
+    pthread_mutex_lock(&s->lock);
+    for(;;){
+        while(s->queue_count == 0 && !s->shutdown)
+            pthread_cond_wait(&s->work_cond,&s->lock);
+        if(s->queue_count == 0)
+            break;
+        gc_object* list = s->queue[s->queue_head];
+        pthread_mutex_unlock(&s->lock);
+        gc_sweeper_sweep(s,list);
+        pthread_mutex_lock(&s->lock);
+        s->queue_head = (s->queue_head + 1) % s->queue_depth;
+        s->queue_count -= 1;
+        pthread_cond_signal(&s->space_cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return null;
+}
+
+// create sweeper and start it's thread
+static gc_sweeper* gc_sweeper_create(gc_heap* heap, uint32_t queue_depth, gc_sweep_policy policy){
+    gc_sweeper* s = (gc_sweeper*)malloc(sizeof(gc_sweeper));
+    if(s == null)
+        return null;
+    s->queue = (gc_object**)malloc(sizeof(gc_object*)*queue_depth);
+    if(s->queue == null){
+        free(s);
+        return null;
+    }
+    s->heap = heap;
+    s->policy = policy;
+    s->shutdown = false;
+    s->queue_depth = queue_depth;
+    s->queue_head = 0;
+    s->queue_count = 0;
+    pthread_mutex_init(&s->lock,null);
+    pthread_cond_init(&s->work_cond,null);
+    pthread_cond_init(&s->space_cond,null);
+    if(pthread_create(&s->thread,null,&gc_sweeper_thread,s) != 0){
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->work_cond);
+        pthread_cond_destroy(&s->space_cond);
+        free(s->queue);
+        free(s);
+        return null;
+    }
+    return s;
+}
+
+// queue detached transparent list for sweeping, returns false if queue is full and policy is to sweep inline
+bool gc_sweeper_submit(gc_sweeper* s, gc_object* list){
+    pthread_mutex_lock(&s->lock);
+    if(s->queue_count == s->queue_depth && s->policy == GC_SWEEP_INLINE){
+        pthread_mutex_unlock(&s->lock);
+        return false;
+    }
+    // wait for sweeper to catch up so garbage doesn't pile up
+    while(s->queue_count == s->queue_depth)
+        pthread_cond_wait(&s->space_cond,&s->lock);
+    s->queue[(s->queue_head + s->queue_count) % s->queue_depth] = list;
+    s->queue_count += 1;
+    pthread_cond_signal(&s->work_cond);
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+
+// sweep queued lists, stop sweeper thread and free it
+void gc_sweeper_destroy(gc_sweeper* s){
+    pthread_mutex_lock(&s->lock);
+    s->shutdown = true;
+    pthread_cond_signal(&s->work_cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread,null);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work_cond);
+    pthread_cond_destroy(&s->space_cond);
+    free(s->queue);
+    free(s);
+}
+
+// enable or disable background sweeper with given queue depth and policy when queue is full
+bool gc_heap_set_sweeper(gc_heap* heap, bool enabled, uint32_t queue_depth, gc_sweep_policy policy){
+    if(heap->sweeper != null){
+        gc_sweeper_destroy(heap->sweeper);
+        heap->sweeper = null;
+    }
+    if(!enabled)
+        return true;
+    if(queue_depth == 0){
+        errno = EINVAL;
+        return false;
+    }
+    heap->sweeper = gc_sweeper_create(heap,queue_depth,policy);
+    if(heap->sweeper == null){
+        errno = EAGAIN;
+        return false;
+    }
+    return true;
+}
+
+// enable or disable background sweeper of default heap
+bool gc_set_sweeper(bool enabled, uint32_t queue_depth, gc_sweep_policy policy){
+    return gc_heap_set_sweeper(gc_get_heap(),enabled,queue_depth,policy);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+
+// tune refresh intervals and tenure ages by survival rates since last full cycle
+void gc_heap_tenure_adapt(gc_heap* heap){
+    uint8_t last = heap->conf.gens_count-1;
+    uint64_t now = get_nanotime();
+    // oldest generation growing faster than allowed, objects are kept in younger generations longer
+    bool overgrown = false;
+    if(heap->tenure_max_growth != 0 && heap->tenure_growth > 0 && now > heap->tenure_time)
+        overgrown = ((uint64_t)heap->tenure_growth)*1000000000ull/(now - heap->tenure_time) > heap->tenure_max_growth;
+    for(uint8_t i = 0; i < heap->conf.gens_count; ++i){
+        gc_gen_config* gen = &(heap->conf.gens[i]);
+        if(gen->tenure_refreshed < GC_TENURE_MIN_SAMPLE)
+            continue;
+        uint32_t survived = gen->tenure_refreshed > gen->tenure_died ? gen->tenure_refreshed - gen->tenure_died : 0;
+        uint32_t survival = (uint32_t)(((uint64_t)survived)*100/gen->tenure_refreshed);
+        if(survival > GC_TENURE_HIGH_SURVIVAL){
+            // refresh finds little garbage, do it less often and let survivors move on sooner
+            if(gen->refresh_interval < gen->tenure_interval*GC_TENURE_RANGE)
+                gen->refresh_interval *= 2;
+            if(i != last && gen->tenure_age > 1 && !(overgrown && i == last-1))
+                gen->tenure_age -= 1;
+        }else if(survival < GC_TENURE_LOW_SURVIVAL){
+            // most refreshed objects die, find them sooner and keep objects here longer
+            if(gen->refresh_interval/2 >= gen->tenure_interval/GC_TENURE_RANGE && gen->refresh_interval > 1)
+                gen->refresh_interval /= 2;
+            if(i != last && gen->tenure_age < GC_TENURE_MAX_AGE)
+                gen->tenure_age += 1;
+        }
+        gen->tenure_refreshed = 0;
+        gen->tenure_died = 0;
+    }
+    if(overgrown && last > 0 && heap->conf.gens[last-1].tenure_age < GC_TENURE_MAX_AGE)
+        heap->conf.gens[last-1].tenure_age += 1;
+    heap->tenure_time = now;
+    heap->tenure_growth = 0;
+}
+
+// enable or disable adaptive tenuring
+void gc_heap_set_tenuring(gc_heap* heap, bool adaptive, uint64_t max_growth){
+    if(adaptive && !heap->tenuring){
+        // adapting starts from current configuration
+        for(uint8_t i = 0; i < heap->conf.gens_count; ++i){
+            heap->conf.gens[i].tenure_age = GC_TENURE_INITIAL_AGE;
+            heap->conf.gens[i].tenure_interval = heap->conf.gens[i].refresh_interval;
+            heap->conf.gens[i].tenure_refreshed = 0;
+            heap->conf.gens[i].tenure_died = 0;
+        }
+        heap->tenure_time = get_nanotime();
+        heap->tenure_growth = 0;
+    }
+    heap->tenuring = adaptive;
+    heap->tenure_max_growth = max_growth;
+}
+
+// enable or disable adaptive tenuring on default heap
+void gc_set_tenuring(bool adaptive, uint64_t max_growth){
+    gc_heap_set_tenuring(gc_get_heap(),adaptive,max_growth);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,362 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <string.h>
+
+// attachments of current thread to heaps
+__thread gc_thread* local_threads = null;
+
+// attach current thread to heap
+void gc_heap_thread_attach(gc_heap* heap){
+    if(gc_thread_find(heap) != null)
+        return;
+    gc_thread* t = (gc_thread*)calloc(1,sizeof(gc_thread));
+    if(t == null){
+        errno = ENOMEM;
+        return;
+    }
+    t->heap = heap;
+    t->stack_base = gc_stack_base();
+
+    pthread_mutex_lock(&heap->lock);
+    // don't join in the middle of collection
+    while(heap->safepoint)
+        pthread_cond_wait(&heap->resume_cond,&heap->lock);
+#ifndef GC_USE_MALLOC
+    // attached threads allocate from their own slabs from now on
+    for(uint32_t i = 0; i < GC_POOL_CLASSES; ++i){
+        if(heap->slabs[i] != null){
+            gc_pool_return_slab(&heap->pool,heap->slabs[i]);
+            heap->slabs[i] = null;
+        }
+    }
+#endif
+    t->next = heap->threads;
+    heap->threads = t;
+    heap->threads_count += 1;
+    pthread_mutex_unlock(&heap->lock);
+
+    t->local_next = local_threads;
+    local_threads = t;
+}
+
+// attach current thread to default heap
+void gc_thread_attach(){
+    gc_heap_thread_attach(gc_get_heap());
+}
+
+// detach current thread from heap
+void gc_heap_thread_detach(gc_heap* heap){
+    gc_thread* t = gc_thread_find(heap);
+    if(t == null)
+        return;
+
+    gc_thread_save_stack_here(t);
+    pthread_mutex_lock(&heap->lock);
+    if(heap->safepoint){
+        // collection waits for thread to park as long as it's attached
+        bool park = !t->safe_region;
+        if(park){
+            heap->threads_parked += 1;
+            pthread_cond_signal(&heap->parked_cond);
+        }
+        while(heap->safepoint)
+            pthread_cond_wait(&heap->resume_cond,&heap->lock);
+        if(park)
+            heap->threads_parked -= 1;
+    }
+    // hand over allocated objects and logged operations to heap
+    gc_thread_publish(t);
+    gc_thread_handoff(t);
+#ifndef GC_USE_MALLOC
+    // give owned slabs back to the pool
+    for(uint32_t i = 0; i < GC_POOL_CLASSES; ++i){
+        if(t->slabs[i] != null)
+            gc_pool_return_slab(&heap->pool,t->slabs[i]);
+    }
+#endif
+    // remove from heap threads
+    gc_thread** p = &heap->threads;
+    while(*p != t)
+        p = &((*p)->next);
+    *p = t->next;
+    heap->threads_count -= 1;
+    pthread_mutex_unlock(&heap->lock);
+
+    // remove from current thread attachments
+    p = &local_threads;
+    while(*p != t)
+        p = &((*p)->local_next);
+    *p = t->local_next;
+
+    free(t->log);
+    free(t);
+}
+
+// detach current thread from default heap
+void gc_thread_detach(){
+    gc_heap_thread_detach(gc_get_heap());
+}
+
+// park attached thread until collection is done
+void gc_thread_park(gc_thread* t){
+    gc_heap* heap = t->heap;
+    gc_thread_save_stack_here(t);
+    pthread_mutex_lock(&heap->lock);
+    heap->threads_parked += 1;
+    pthread_cond_signal(&heap->parked_cond);
+    while(heap->safepoint)
+        pthread_cond_wait(&heap->resume_cond,&heap->lock);
+    heap->threads_parked -= 1;
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// safepoint, attached thread parks here while other thread collects garbage
+void gc_heap_safepoint(gc_heap* heap){
+    gc_thread* t = gc_thread_find(heap);
+    if(t != null)
+        gc_thread_poll(t);
+}
+
+// safepoint on default heap
+void gc_safepoint(){
+    gc_heap_safepoint(gc_get_heap());
+}
+
+// enter safe region, collection doesn't wait for thread inside safe region
+void gc_heap_safe_region_enter(gc_heap* heap){
+    gc_thread* t = gc_thread_find(heap);
+    if(t == null || t->safe_region)
+        return;
+    gc_thread_save_stack_here(t);
+    pthread_mutex_lock(&heap->lock);
+    t->safe_region = true;
+    heap->threads_parked += 1;
+    pthread_cond_signal(&heap->parked_cond);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// enter safe region on default heap
+void gc_safe_region_enter(){
+    gc_heap_safe_region_enter(gc_get_heap());
+}
+
+// leave safe region, waits for collection in progress to finish
+void gc_heap_safe_region_leave(gc_heap* heap){
+    gc_thread* t = gc_thread_find(heap);
+    if(t == null || !t->safe_region)
+        return;
+    pthread_mutex_lock(&heap->lock);
+    while(heap->safepoint)
+        pthread_cond_wait(&heap->resume_cond,&heap->lock);
+    heap->threads_parked -= 1;
+    t->safe_region = false;
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// leave safe region on default heap
+void gc_safe_region_leave(){
+    gc_heap_safe_region_leave(gc_get_heap());
+}
+
+// allocate memory for object from thread owned pool slabs
+gc_object* gc_thread_allocate(gc_thread* t, uint32_t refs_count){
+    size_t size = gc_object_size(refs_count);
+#ifdef GC_USE_MALLOC
+    return (gc_object*)malloc(size);
+#else
+    gc_heap* heap = t->heap;
+    if(size > GC_POOL_MAX_SIZE){
+        // large blocks come from pool itself
+        pthread_mutex_lock(&heap->lock);
+        void* p = gc_pool_alloc(&heap->pool,size);
+        pthread_mutex_unlock(&heap->lock);
+        return (gc_object*)p;
+    }
+    uint16_t class_index = gc_pool_class_index(size);
+    gc_pool_slab* slab = t->slabs[class_index];
+    void* p = slab != null ? gc_pool_slab_alloc(slab) : null;
+    if(p == null){
+        // owned slab is full, exchange it for another one
+        pthread_mutex_lock(&heap->lock);
+        if(slab != null)
+            gc_pool_return_slab(&heap->pool,slab);
+        slab = t->slabs[class_index] = gc_pool_take_slab(&heap->pool,class_index);
+        pthread_mutex_unlock(&heap->lock);
+        if(slab == null)
+            return null;
+        p = gc_pool_slab_alloc(slab);
+    }
+    return (gc_object*)p;
+#endif
+}
+
+// insert chain of objects in front of list
+static inline void gc_list_splice(gc_object** list, gc_object* head, gc_object* tail){
+    tail->gc_next = *list;
+    if(*list != null)
+        (*list)->gc_prev = &(tail->gc_next);
+    *list = head;
+    head->gc_prev = list;
+}
+
+// publish objects allocated by thread to heap white list, heap lock must be held
+void gc_thread_publish(gc_thread* t){
+    if(t->white == null)
+        return;
+    gc_heap* heap = t->heap;
+    if(heap->marking || heap->sweeping){
+        // objects allocated black during background marking or sweep are kept apart from lists collector works on
+        if(heap->allocated == null)
+            heap->allocated_tail = t->white_tail;
+        gc_list_splice(&heap->allocated,t->white,t->white_tail);
+    }else{
+        // splice whole thread white list in front of heap white list
+        gc_list_splice(&heap->white,t->white,t->white_tail);
+    }
+    t->white = null;
+    t->white_tail = null;
+    gc_stats_add(heap->stats.published_objects,t->white_count);
+    gc_stats_add(heap->stats.published_bytes,t->white_bytes);
+    t->white_count = 0;
+    t->white_bytes = 0;
+}
+
+// hand logged operations over to heap log, heap lock must be held
+void gc_thread_handoff(gc_thread* t){
+    if(t->log_count == 0)
+        return;
+    gc_heap* heap = t->heap;
+    if(heap->log_count + t->log_count > heap->log_size){
+        heap->log_size = (heap->log_count + t->log_count)*2;
+        heap->log = (uintptr_t*)realloc(heap->log,sizeof(uintptr_t)*heap->log_size);
+    }
+    memcpy(heap->log+heap->log_count,t->log,sizeof(uintptr_t)*t->log_count);
+    __atomic_store_n(&heap->log_count,heap->log_count+t->log_count,__ATOMIC_RELAXED);
+    t->log_count = 0;
+}
+
+// apply logged operations on shared heap lists
+static void gc_heap_apply_log(gc_heap* heap, uintptr_t* log, uint32_t count){
+    for(uint32_t i = 0; i < count; ++i){
+        gc_object* obj = (gc_object*)(log[i] & ~GC_LOG_TAG_MASK);
+        switch(log[i] & GC_LOG_TAG_MASK){
+            case GC_LOG_SHADE:
+                if(gc_color_is_silver_or_white(obj)){
+                    gc_list_move(obj,&heap->grey);
+                    gc_mark_grey(obj);
+                }
+                break;
+            case GC_LOG_RESCAN:
+                gc_flag_clear(obj,GC_FLAG_LOGGED);
+                if(gc_color_is_black(obj)){
+                    gc_list_move(obj,&heap->grey);
+                    gc_mark_grey(obj);
+                }
+                break;
+            case GC_LOG_REMEMBER:
+                if(gc_color_is_black(obj))
+                    gc_remset_add(heap,obj);
+                break;
+            case GC_LOG_WEAK:
+                gc_weak_add(heap,obj);
+                break;
+        }
+    }
+}
+
+// publish objects and apply logs of all attached threads, all attached threads must be parked
+void gc_heap_flush_threads(gc_heap* heap){
+    // all objects have to be on heap lists before logs are applied
+    for(gc_thread* t = heap->threads; t != null; t = t->next)
+        gc_thread_publish(t);
+    if(heap->allocated != null){
+        // objects allocated during background marking or sweep are black already
+        gc_list_splice(&(heap->black[0]),heap->allocated,heap->allocated_tail);
+        heap->allocated = heap->allocated_tail = null;
+    }
+    gc_heap_apply_log(heap,heap->log,heap->log_count);
+    heap->log_count = 0;
+    for(gc_thread* t = heap->threads; t != null; t = t->next){
+        gc_heap_apply_log(heap,t->log,t->log_count);
+        t->log_count = 0;
+    }
+}
+
+// apply operations handed over to heap log
+void gc_heap_apply_handoff(gc_heap* heap){
+    if(__atomic_load_n(&heap->log_count,__ATOMIC_RELAXED) == 0)
+        return;
+    // take whole log so threads can keep handing over while it's applied
+    pthread_mutex_lock(&heap->lock);
+    uintptr_t* log = heap->log;
+    uint32_t count = heap->log_count;
+    heap->log = null;
+    heap->log_count = heap->log_size = 0;
+    pthread_mutex_unlock(&heap->lock);
+    gc_heap_apply_log(heap,log,count);
+    free(log);
+}
+
+// stop the world, returns with heap lock held once all other attached threads are parked
+bool gc_heap_stop_world(gc_heap* heap, gc_thread* self){
+    // thread might end up parked here
+    if(self != null)
+        gc_thread_save_stack_here(self);
+    pthread_mutex_lock(&heap->lock);
+    if(heap->safepoint){
+        // other thread stopped the world already, wait for it to resume
+        if(self != null){
+            heap->threads_parked += 1;
+            pthread_cond_signal(&heap->parked_cond);
+        }
+        while(heap->safepoint)
+            pthread_cond_wait(&heap->resume_cond,&heap->lock);
+        if(self != null)
+            heap->threads_parked -= 1;
+        pthread_mutex_unlock(&heap->lock);
+        return false;
+    }
+    __atomic_store_n(&heap->safepoint,1,__ATOMIC_RELEASE);
+    while(heap->threads_parked < heap->threads_count - (self != null ? 1 : 0))
+        pthread_cond_wait(&heap->parked_cond,&heap->lock);
+    return true;
+}
+
+// resume parked threads and release heap lock
+void gc_heap_resume_world(gc_heap* heap){
+    __atomic_store_n(&heap->safepoint,0,__ATOMIC_RELEASE);
+    pthread_cond_broadcast(&heap->resume_cond);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
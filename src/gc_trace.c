@@ -0,0 +1,220 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifdef GC_TRACE
+
+// trace event, slot of ring is rewritten in place so it's sequence tells readers if it's complete
+typedef struct {
+    uint64_t seq; // index of event + 1 once it's written, 0 while it's being written
+    uint64_t time; // CLOCK_MONOTONIC nanoseconds
+    uint64_t objects; // units of work done, end events only
+    uintptr_t heap;
+    uint32_t tid;
+    uint8_t type; // GC_TRACE_BEGIN, GC_TRACE_END or GC_TRACE_INSTANT
+    uint8_t name; // pause scheduler phase or GC_TRACE_PAUSE or GC_TRACE_CYCLE
+} gc_trace_event;
+
+// tracing enabled, checked by every trace point
+int gc_trace_enabled = 0;
+// ring of events shared by all heaps, allocated when tracing is first enabled and kept afterwards
+static gc_trace_event* gc_trace_ring = null;
+static uint64_t gc_trace_mask;
+static uint64_t gc_trace_head = 0; // index of next event
+static uint64_t gc_trace_tail = 0; // index of first event not yet flushed
+static pthread_mutex_t gc_trace_lock = PTHREAD_MUTEX_INITIALIZER; // serializes enabling and flushing
+// kernel thread id of current thread, trace viewers group events by it
+static __thread uint32_t gc_trace_tid = 0;
+
+// event names by pause scheduler phase followed by pause and cycle
+static const char* const gc_trace_names[GC_PACE_PHASES+2] = {
+    "none", "transparent", "promotion", "mark", "mark silver", "whiten", "sweep", "evacuate", "fix", "free copies",
+    "weak", "refresh", "pause", "full cycle"
+};
+
+// write event into ring, oldest event is overwritten once it's full
+static void gc_trace_emit(gc_heap* heap, uint8_t type, uint8_t name, uint64_t objects){
+    if(gc_trace_tid == 0)
+        gc_trace_tid = (uint32_t)syscall(SYS_gettid);
+    uint64_t index = __atomic_fetch_add(&gc_trace_head,1,__ATOMIC_RELAXED);
+    gc_trace_event* e = &gc_trace_ring[index & gc_trace_mask];
+    __atomic_store_n(&e->seq,0,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->time,get_nanotime(),__ATOMIC_RELAXED);
+    __atomic_store_n(&e->objects,objects,__ATOMIC_RELAXED);
+    __atomic_store_n(&e->heap,(uintptr_t)heap,__ATOMIC_RELAXED);
+    __atomic_store_n(&e->tid,gc_trace_tid,__ATOMIC_RELAXED);
+    __atomic_store_n(&e->type,type,__ATOMIC_RELAXED);
+    __atomic_store_n(&e->name,name,__ATOMIC_RELAXED);
+    __atomic_store_n(&e->seq,index+1,__ATOMIC_RELEASE);
+}
+
+// units of work done by current cycle so far
+static inline uint64_t gc_trace_work(gc_heap* heap){
+    return ((uint64_t)heap->conf.cycle_objects) + heap->conf.cycle_threshold;
+}
+
+// trace end of current phase and beginning of given one
+void gc_trace_phase(gc_heap* heap, uint8_t phase){
+    uint64_t work = gc_trace_work(heap);
+    if(heap->pace_phase != GC_PACE_NONE)
+        gc_trace_emit(heap,GC_TRACE_END,heap->pace_phase,work - heap->trace_phase_work);
+    if(phase != GC_PACE_NONE)
+        gc_trace_emit(heap,GC_TRACE_BEGIN,phase,0);
+    heap->trace_phase_work = work;
+}
+
+// trace beginning of pause
+void gc_trace_pause_begin(gc_heap* heap){
+    gc_trace_emit(heap,GC_TRACE_BEGIN,GC_TRACE_PAUSE,0);
+    heap->trace_pause_work = gc_trace_work(heap);
+}
+
+// trace end of pause together with phase it ended in
+void gc_trace_pause_end(gc_heap* heap){
+    gc_trace_phase(heap,GC_PACE_NONE);
+    gc_trace_emit(heap,GC_TRACE_END,GC_TRACE_PAUSE,gc_trace_work(heap) - heap->trace_pause_work);
+}
+
+// trace completion of full cycle
+void gc_trace_cycle(gc_heap* heap){
+    gc_trace_emit(heap,GC_TRACE_INSTANT,GC_TRACE_CYCLE,0);
+}
+
+// copy event with given index out of ring, false if it was overwritten or isn't written yet
+static bool gc_trace_read(uint64_t index, gc_trace_event* copy){
+    gc_trace_event* e = &gc_trace_ring[index & gc_trace_mask];
+    if(__atomic_load_n(&e->seq,__ATOMIC_ACQUIRE) != index+1)
+        return false;
+    copy->time = __atomic_load_n(&e->time,__ATOMIC_RELAXED);
+    copy->objects = __atomic_load_n(&e->objects,__ATOMIC_RELAXED);
+    copy->heap = __atomic_load_n(&e->heap,__ATOMIC_RELAXED);
+    copy->tid = __atomic_load_n(&e->tid,__ATOMIC_RELAXED);
+    copy->type = __atomic_load_n(&e->type,__ATOMIC_RELAXED);
+    copy->name = __atomic_load_n(&e->name,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // writer might have started to overwrite it meanwhile
+    return __atomic_load_n(&e->seq,__ATOMIC_RELAXED) == index+1;
+}
+
+#endif
+
+// enable or disable tracing
+bool gc_set_trace(bool enabled, uint32_t events){
+#ifdef GC_TRACE
+    pthread_mutex_lock(&gc_trace_lock);
+    if(enabled){
+        // ring size is power of 2
+        uint64_t size = GC_TRACE_EVENTS;
+        if(events != 0){
+            size = 1;
+            while(size < events)
+                size <<= 1;
+        }
+        if(gc_trace_ring == null){
+            gc_trace_ring = (gc_trace_event*)calloc(size,sizeof(gc_trace_event));
+            if(gc_trace_ring == null){
+                pthread_mutex_unlock(&gc_trace_lock);
+                errno = ENOMEM;
+                return false;
+            }
+            gc_trace_mask = size-1;
+        }else if(events != 0 && size != gc_trace_mask+1){
+            // collecting threads might still be writing into ring, it's never replaced
+            pthread_mutex_unlock(&gc_trace_lock);
+            errno = EBUSY;
+            return false;
+        }
+    }
+    __atomic_store_n(&gc_trace_enabled,enabled ? 1 : 0,__ATOMIC_RELEASE);
+    pthread_mutex_unlock(&gc_trace_lock);
+    return true;
+#else
+    if(enabled){
+        errno = ENOTSUP;
+        return false;
+    }
+    return true;
+#endif
+}
+
+// write traced events to file as chrome trace event json and drop them from ring
+bool gc_trace_flush(const char* path){
+#ifdef GC_TRACE
+    FILE* f = fopen(path,"w");
+    if(f == null)
+        return false;
+    pthread_mutex_lock(&gc_trace_lock);
+    fprintf(f,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    bool first = true;
+    if(gc_trace_ring != null){
+        uint64_t head = __atomic_load_n(&gc_trace_head,__ATOMIC_ACQUIRE);
+        uint64_t index = gc_trace_tail;
+        // events older than ring size were overwritten
+        if(head - index > gc_trace_mask+1)
+            index = head - (gc_trace_mask+1);
+        int pid = (int)getpid();
+        for(; index < head; ++index){
+            // event still being written is left for next flush together with those after it
+            if(__atomic_load_n(&gc_trace_ring[index & gc_trace_mask].seq,__ATOMIC_ACQUIRE) < index+1)
+                break;
+            gc_trace_event e;
+            if(!gc_trace_read(index,&e))
+                continue;
+            // timestamps are microseconds
+            fprintf(f,"%s\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03u,\"pid\":%d,\"tid\":%u,",
+                    first ? "" : ",",gc_trace_names[e.name],e.type,e.time/1000,(unsigned int)(e.time%1000),pid,e.tid);
+            if(e.type == GC_TRACE_END)
+                fprintf(f,"\"args\":{\"heap\":\"%#" PRIxPTR "\",\"objects\":%" PRIu64 "}}",e.heap,e.objects);
+            else if(e.type == GC_TRACE_INSTANT)
+                fprintf(f,"\"s\":\"t\",\"args\":{\"heap\":\"%#" PRIxPTR "\"}}",e.heap);
+            else
+                fprintf(f,"\"args\":{\"heap\":\"%#" PRIxPTR "\"}}",e.heap);
+            first = false;
+        }
+        gc_trace_tail = index;
+    }
+    fprintf(f,"\n]}\n");
+    pthread_mutex_unlock(&gc_trace_lock);
+    bool written = !ferror(f);
+    return fclose(f) == 0 && written;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,180 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gc_internal.h"
+#include <errno.h>
+
+// mark values of weak table pairs which keys were marked after their table, marking them might mark
+// more keys so tables are scanned again until scan doesn't mark anything
+bool gc_heap_mark_ephemerons(gc_heap* heap){
+    for(;;){
+        gc_pace_phase(heap,GC_PACE_MARK);
+        while(heap->weak_index < heap->weak_count){
+            gc_object* obj = heap->weak[heap->weak_index++];
+            // grey tables mark values of marked keys themselves, white and silver ones are garbage
+            if((__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_EPHEMERON) && gc_color_is_black(obj)){
+                gc_object** refs = (gc_object**)(obj+1); // start of refs array
+                uint32_t count = gc_refs_count(obj) & ~1u;
+                for(uint32_t i = 0; i < count; i += 2){
+                    gc_object* value = __atomic_load_n(&refs[i+1],__ATOMIC_ACQUIRE);
+                    if(value == null || !gc_weak_key_live(__atomic_load_n(&refs[i],__ATOMIC_ACQUIRE)))
+                        continue;
+                    if(gc_color_is_silver_or_white(value)){
+                        gc_list_move(value,&heap->grey);
+                        gc_mark_grey(value);
+                        heap->weak_shaded = true;
+                    }
+                    // remember black table referencing value from other generation
+                    if(gc_gen_num(value) != gc_gen_num(obj))
+                        gc_remset_add(heap,obj);
+                }
+                heap->conf.cycle_threshold += count/GC_OBJECT_SCAN_CHUNK;
+            }
+            heap->conf.cycle_threshold += 1;
+            // check pause threshold
+            gc_cycle_check
+        }
+        heap->weak_index = 0;
+        if(!heap->weak_shaded)
+            return true;
+        heap->weak_shaded = false;
+        // run mark grey phase
+        if(!gc_heap_mark(heap))
+            return false;
+    }
+}
+
+// clear weak reference to garbage unless mutator stored another one meanwhile, returns true if it was cleared
+static inline bool gc_weak_clear(gc_object** ref, gc_object* garbage){
+    return __atomic_compare_exchange_n(ref,&garbage,null,false,__ATOMIC_RELEASE,__ATOMIC_RELAXED);
+}
+
+// clear weak references to silver and white objects, weak objects that are garbage themselves are forgotten,
+// background collector clears them while mutators run
+void gc_heap_clear_weak(gc_heap* heap){
+    if(heap->weak_count == 0)
+        return;
+    gc_pace_phase(heap,GC_PACE_WEAK);
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < heap->weak_count; ++i){
+        gc_object* obj = heap->weak[i];
+        heap->conf.cycle_threshold += 1;
+        if(gc_color_is_silver_or_white(obj))
+            continue;
+        heap->weak[kept++] = obj;
+        gc_object** refs = (gc_object**)(obj+1); // start of refs array
+        uint32_t count = gc_refs_count(obj);
+        if(__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_EPHEMERON){
+            // whole pair is removed once key is garbage, value might be garbage only if key was null
+            for(uint32_t j = 0; j + 1 < count; j += 2){
+                gc_object* key = __atomic_load_n(&refs[j],__ATOMIC_ACQUIRE);
+                gc_object* value = __atomic_load_n(&refs[j+1],__ATOMIC_ACQUIRE);
+                if(key != null && gc_color_is_silver_or_white(key)){
+                    if(gc_weak_clear(&refs[j],key) && value != null)
+                        gc_weak_clear(&refs[j+1],value);
+                }else if(value != null && gc_color_is_silver_or_white(value)){
+                    gc_weak_clear(&refs[j+1],value);
+                }
+            }
+        }else{
+            for(uint32_t j = 0; j < count; ++j){
+                gc_object* ref = __atomic_load_n(&refs[j],__ATOMIC_ACQUIRE);
+                if(ref != null && gc_color_is_silver_or_white(ref))
+                    gc_weak_clear(&refs[j],ref);
+            }
+        }
+        heap->conf.cycle_threshold += count/GC_OBJECT_SCAN_CHUNK;
+    }
+    heap->weak_count = kept;
+}
+
+// allocate weak object of given kind, attached threads log it until next collection
+static gc_object* gc_heap_alloc_weak_kind(gc_heap* heap, uint32_t refs_count, uint16_t kind){
+    gc_object* obj = gc_heap_alloc(heap,refs_count);
+    if(obj == null)
+        return null;
+    gc_flag_set(obj,kind);
+    gc_thread* t = gc_thread_find(heap);
+    if(t != null)
+        gc_thread_log(t,obj,GC_LOG_WEAK);
+    else
+        gc_weak_add(heap,obj);
+    return obj;
+}
+
+// allocate weak object
+gc_object* gc_heap_alloc_weak(gc_heap* heap, uint32_t refs_count){
+    return gc_heap_alloc_weak_kind(heap,refs_count,GC_FLAG_WEAK);
+}
+
+// allocate weak object
+gc_object* gc_alloc_weak(uint32_t refs_count){
+    return gc_heap_alloc_weak(gc_get_heap(),refs_count);
+}
+
+// allocate weak table
+gc_object* gc_heap_alloc_weak_table(gc_heap* heap, uint32_t pairs_count){
+    if(pairs_count > UINT32_MAX/2){
+        errno = EINVAL;
+        return null;
+    }
+    return gc_heap_alloc_weak_kind(heap,pairs_count*2,GC_FLAG_EPHEMERON);
+}
+
+// allocate weak table
+gc_object* gc_alloc_weak_table(uint32_t pairs_count){
+    return gc_heap_alloc_weak_table(gc_get_heap(),pairs_count);
+}
+
+// read reference of weak object
+gc_object* gc_heap_get_weak(gc_heap* heap, gc_object* obj, uint32_t ref_index){
+#ifdef GC_CHECKED
+    gc_check(__atomic_load_n(&(obj->gc_flags),__ATOMIC_RELAXED) & (GC_FLAG_WEAK | GC_FLAG_EPHEMERON),"gc_get_weak on object that isn't weak",obj);
+    gc_check(ref_index < gc_refs_count(obj),"gc_get_weak index out of bounds",obj);
+#endif
+    gc_object* ref = __atomic_load_n(&(((gc_object**)(obj+1))[ref_index]),__ATOMIC_ACQUIRE);
+    // background collector clears weak references to garbage while mutators run, ones it didn't get to aren't read
+    if(ref != null && __atomic_load_n(&heap->sweeping,__ATOMIC_RELAXED) && gc_color_is_silver_or_white(ref))
+        return null;
+    // snapshot doesn't hold objects reachable only through weak references, mutator reading one makes it reachable
+    if(ref != null && __atomic_load_n(&heap->marking,__ATOMIC_RELAXED) && gc_color_is_silver_or_white(ref)){
+        gc_thread* t = gc_thread_find(heap);
+        if(t != null)
+            gc_thread_log(t,ref,GC_LOG_SHADE);
+    }
+    return ref;
+}
+
+// read reference of weak object
+gc_object* gc_get_weak(gc_object* obj, uint32_t ref_index){
+    return gc_heap_get_weak(gc_get_heap(),obj,ref_index);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,216 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef GC_CHECK
+#define GC_CHECK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gc.h"
+
+// number of checks that failed, test exits with failure once it's done if any did
+static uint32_t checks_failed = 0;
+
+// report failed check and keep going
+#define check(c) do{ \
+    if(!(c)){ \
+        printf("%s:%d: check failed: %s\n",__FILE__,__LINE__,#c); \
+        checks_failed += 1; \
+    } \
+}while(0)
+
+// exit status of test
+#define check_status() (checks_failed == 0 ? 0 : 1)
+
+// class of plain test objects
+static gc_object_class check_cls = { &gc_object_mark_black, &gc_object_contains, null, 0, null };
+
+// how heaps created by tests collect
+typedef enum {
+    CHECK_INCREMENTAL, // stop the world increments of tiny max pause, cycle takes many gc calls
+    CHECK_CONCURRENT // background collector, calling thread is attached
+} check_mode;
+
+// create heap every generation of which is refreshed and promoted every cycle
+static inline gc_heap* check_heap_create(uint8_t gens_count, check_mode mode){
+    gc_gen_config gens[gens_count];
+    for(uint8_t i = 0; i < gens_count; ++i){
+        gens[i].refresh_interval = 0;
+        gens[i].promotion_interval = 0;
+    }
+    gc_config config;
+    config.gens_count = gens_count;
+    config.gens = gens;
+    config.pause_threshold = 16;
+    config.max_pause = mode == CHECK_INCREMENTAL ? 1000 : 200000000;
+    gc_heap* heap = gc_heap_create(&config);
+    if(heap == null){
+        perror("gc_heap_create");
+        exit(2);
+    }
+    if(mode == CHECK_CONCURRENT){
+        gc_heap_thread_attach(heap);
+        if(!gc_heap_set_concurrent(heap,true,0)){
+            perror("gc_heap_set_concurrent");
+            exit(2);
+        }
+    }
+    return heap;
+}
+
+// allocate plain test object
+static inline gc_object* check_alloc(gc_heap* heap, uint32_t refs_count){
+    gc_object* obj = gc_heap_alloc(heap,refs_count);
+    obj->class = &check_cls;
+    return obj;
+}
+
+// objects expected to die count their finalizers, collector or sweeper thread might run them
+static uint32_t died = 0;
+
+static inline void died_finalize(gc_object* obj){
+    __atomic_add_fetch(&died,1,__ATOMIC_RELAXED);
+}
+
+static gc_object_class died_cls = { &gc_object_mark_black, &gc_object_contains, &died_finalize, 0, null };
+
+// allocate object counting it's finalizer
+static inline gc_object* alloc_died(gc_heap* heap, uint32_t refs_count){
+    gc_object* obj = gc_heap_alloc(heap,refs_count);
+    obj->class = &died_cls;
+    return obj;
+}
+
+// read counter other threads update
+static inline uint32_t load(uint32_t* counter){
+    return __atomic_load_n(counter,__ATOMIC_RELAXED);
+}
+
+// collect until full cycle is done, returns number of gc calls it took
+static inline uint32_t check_collect(gc_heap* heap){
+    uint32_t calls = 0;
+    do{
+        gc_heap_collect(heap);
+        calls += 1;
+    }while(!gc_heap_get_config(heap)->cycle_full);
+    return calls;
+}
+
+// json parser that only checks syntax, returns position after value or null if it isn't valid json
+static inline const char* check_json_value(const char* p);
+
+static inline const char* check_json_space(const char* p){
+    while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p += 1;
+    return p;
+}
+
+static inline const char* check_json_string(const char* p){
+    if(*p++ != '"')
+        return null;
+    for(; *p != '"'; ++p){
+        if((unsigned char)*p < 0x20)
+            return null;
+        if(*p == '\\' && *++p == '\0')
+            return null;
+    }
+    return p+1;
+}
+
+static inline const char* check_json_digits(const char* p){
+    if(*p < '0' || *p > '9')
+        return null;
+    while(*p >= '0' && *p <= '9')
+        p += 1;
+    return p;
+}
+
+static inline const char* check_json_number(const char* p){
+    if(*p == '-')
+        p += 1;
+    if((p = check_json_digits(p)) == null)
+        return null;
+    if(*p == '.' && (p = check_json_digits(p+1)) == null)
+        return null;
+    if(*p == 'e' || *p == 'E'){
+        p += 1;
+        if(*p == '+' || *p == '-')
+            p += 1;
+        p = check_json_digits(p);
+    }
+    return p;
+}
+
+// elements of array or members of object up to closing bracket
+static inline const char* check_json_items(const char* p, char close, bool members){
+    p = check_json_space(p);
+    if(*p == close)
+        return p+1;
+    for(;;){
+        if(members){
+            if((p = check_json_string(p)) == null)
+                return null;
+            p = check_json_space(p);
+            if(*p++ != ':')
+                return null;
+        }
+        if((p = check_json_value(p)) == null)
+            return null;
+        p = check_json_space(p);
+        if(*p == close)
+            return p+1;
+        if(*p++ != ',')
+            return null;
+        p = check_json_space(p);
+    }
+}
+
+static inline const char* check_json_value(const char* p){
+    p = check_json_space(p);
+    switch(*p){
+        case '{':
+            return check_json_items(p+1,'}',true);
+        case '[':
+            return check_json_items(p+1,']',false);
+        case '"':
+            return check_json_string(p);
+        case 't':
+            return strncmp(p,"true",4) == 0 ? p+4 : null;
+        case 'f':
+            return strncmp(p,"false",5) == 0 ? p+5 : null;
+        case 'n':
+            return strncmp(p,"null",4) == 0 ? p+4 : null;
+        default:
+            return check_json_number(p);
+    }
+}
+
+// check if whole text is single json value
+static inline bool check_json(const char* text){
+    const char* p = check_json_value(text);
+    return p != null && *check_json_space(p) == '\0';
+}
+
+#endif
@@ -0,0 +1,237 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// compaction moves oldest generation objects out of sparse slabs, afterwards every reference points to new
+// copy and object graph is the same, gc_set_ref on moved object between compaction increments isn't lost
+
+#include <stdint.h>
+#include <string.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+#ifndef GC_USE_MALLOC
+
+// objects form chains through left reference, right one is changed while objects are moved
+#define NODE_LEFT 0
+#define NODE_RIGHT 1
+#define NODE_REFS 2
+
+#define CHAINS 4096
+#define CHAIN_LENGTH 4
+#define STORES (CHAINS/4)
+#define NODES_MAX (CHAINS*CHAIN_LENGTH + STORES + 1)
+
+// expected graph by node ids, id 0 stands for null
+static uint64_t nodes_count;
+static uint64_t expected_head[CHAINS];
+static uint64_t expected_left[NODES_MAX];
+static uint64_t expected_right[NODES_MAX];
+static bool expected_visited[NODES_MAX];
+static gc_object* address[NODES_MAX];
+static gc_object* address_before[NODES_MAX];
+static bool visited[NODES_MAX];
+static uint64_t stack[NODES_MAX];
+
+// nodes carry no data, class of every node is one of its own and node id is index of that class
+static gc_object_class node_cls[NODES_MAX];
+
+static inline gc_object* node_ref(gc_object* obj, uint32_t index){
+    return ((gc_object**)(obj+1))[index];
+}
+
+static inline uint64_t node_id(gc_object* obj){
+    return obj == null ? 0 : (uint64_t)(obj->class - node_cls);
+}
+
+static gc_object* alloc_node(gc_heap* heap){
+    gc_object* obj = gc_heap_alloc(heap,NODE_REFS);
+    nodes_count += 1;
+    node_cls[nodes_count] = (gc_object_class){ &gc_object_mark_black, &gc_object_contains, null };
+    obj->class = &node_cls[nodes_count];
+    expected_left[nodes_count] = expected_right[nodes_count] = 0;
+    return obj;
+}
+
+// reference of live object points to object that isn't moved or freed
+static bool check_ref(gc_heap* heap, gc_object* ref){
+    if(ref == null)
+        return true;
+    return !(__atomic_load_n(&(ref->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_FORWARDED) && gc_heap_contains(heap,ref) &&
+           node_id(ref) > 0 && node_id(ref) <= nodes_count;
+}
+
+// number of objects reachable in expected graph
+static uint64_t expected_count(){
+    uint64_t count = 0, stack_count = 0;
+    memset(expected_visited,0,sizeof(expected_visited));
+    for(uint32_t c = 0; c < CHAINS; ++c){
+        if(expected_head[c] != 0)
+            stack[stack_count++] = expected_head[c];
+        while(stack_count > 0){
+            uint64_t id = stack[--stack_count];
+            if(expected_visited[id])
+                continue;
+            expected_visited[id] = true;
+            count += 1;
+            if(expected_left[id] != 0)
+                stack[stack_count++] = expected_left[id];
+            if(expected_right[id] != 0)
+                stack[stack_count++] = expected_right[id];
+        }
+    }
+    return count;
+}
+
+// walk objects reachable from root and compare them with expected graph, returns number of objects found
+static uint64_t check_graph(gc_heap* heap, gc_object* root){
+    uint64_t found = 0, stack_count = 0;
+    memset(visited,0,sizeof(visited));
+    for(uint32_t c = 0; c < CHAINS; ++c){
+        gc_object* head = node_ref(root,c);
+        check(check_ref(heap,head));
+        check(node_id(head) == expected_head[c]);
+        if(head == null || !check_ref(heap,head))
+            continue;
+        stack[stack_count++] = node_id(head);
+        address[node_id(head)] = head;
+        while(stack_count > 0){
+            uint64_t id = stack[--stack_count];
+            if(visited[id])
+                continue;
+            visited[id] = true;
+            found += 1;
+            gc_object* left = node_ref(address[id],NODE_LEFT);
+            gc_object* right = node_ref(address[id],NODE_RIGHT);
+            check(check_ref(heap,left) && check_ref(heap,right));
+            check(node_id(left) == expected_left[id]);
+            check(node_id(right) == expected_right[id]);
+            if(left != null && check_ref(heap,left)){
+                address[node_id(left)] = left;
+                stack[stack_count++] = node_id(left);
+            }
+            if(right != null && check_ref(heap,right)){
+                address[node_id(right)] = right;
+                stack[stack_count++] = node_id(right);
+            }
+        }
+    }
+    return found;
+}
+
+static void check_compact(check_mode mode){
+    gc_heap* heap = check_heap_create(2,mode);
+    check(gc_heap_set_compaction(heap,true));
+    gc_object* root = check_alloc(heap,CHAINS);
+    gc_heap_add_root(heap,root);
+    nodes_count = 0;
+    for(uint32_t c = 0; c < CHAINS; ++c){
+        gc_object* next = null;
+        for(uint32_t i = 0; i < CHAIN_LENGTH; ++i){
+            gc_object* obj = alloc_node(heap);
+            gc_heap_set_ref(heap,obj,NODE_LEFT,next);
+            expected_left[node_id(obj)] = node_id(next);
+            next = obj;
+        }
+        gc_heap_set_ref(heap,root,c,next);
+        expected_head[c] = node_id(next);
+    }
+    // sliced cycle starts over from promotion phase in every increment, refreshing every generation again,
+    // chains are promoted in increments that fit whole cycle
+    gc_config* config = gc_heap_get_config(heap);
+    uint64_t max_pause = config->max_pause;
+    if(mode == CHECK_INCREMENTAL)
+        config->max_pause = 1000000000;
+    // promoted into oldest generation
+    for(uint32_t i = 0; i < 3; ++i)
+        check_collect(heap);
+    check(check_graph(heap,root) == CHAINS*CHAIN_LENGTH);
+    check(gc_gen_num(node_ref(root,0)) == 1);
+    memcpy(address_before,address,sizeof(address));
+
+    // three of four chains die, every slab of oldest generation is left sparse
+    for(uint32_t c = 0; c < CHAINS; ++c){
+        if(c % 4 == 0)
+            continue;
+        gc_heap_set_ref(heap,root,c,null);
+        expected_head[c] = 0;
+    }
+
+    // oldest generation is refreshed once by first increment, young one holds only objects stored below
+    if(mode == CHECK_INCREMENTAL){
+        config->max_pause = max_pause;
+        config->gens[1].refresh_interval = 1000000000000ULL;
+        config->gens[1].refresh_time = 0;
+    }
+
+    // objects read through root in between increments might be old copies not yet fixed, their right
+    // reference is pointed to new object or to head of another chain that might be old copy too
+    uint32_t forwarded_stores = 0, stores = 0;
+    do{
+        gc_heap_collect(heap);
+        if(mode == CHECK_INCREMENTAL && heap->compacting && stores < STORES){
+            uint32_t c = stores*4;
+            gc_object* head = node_ref(root,c);
+            if(__atomic_load_n(&(head->gc_flags),__ATOMIC_RELAXED) & GC_FLAG_FORWARDED)
+                forwarded_stores += 1;
+            gc_object* target = stores % 2 == 0 ? alloc_node(heap) : node_ref(root,(c+4) % CHAINS);
+            gc_heap_set_ref(heap,head,NODE_RIGHT,target);
+            expected_right[node_id(head)] = node_id(target);
+            stores += 1;
+        }
+    }while(!gc_heap_get_config(heap)->cycle_full);
+    check(gc_heap_get_config(heap)->cycle_compacted > 0);
+    check(heap->compacting == GC_COMPACT_NONE && heap->forwarded == null);
+    if(mode == CHECK_INCREMENTAL)
+        check(forwarded_stores > 0);
+    check(check_graph(heap,root) == expected_count());
+
+    // survivors were moved out of sparse slabs
+    uint32_t moved = 0;
+    for(uint64_t id = 1; id <= CHAINS*CHAIN_LENGTH; ++id){
+        if(visited[id] && address[id] != address_before[id])
+            moved += 1;
+    }
+    check(moved > 0);
+
+    // later cycles keep graph as it is
+    for(uint32_t i = 0; i < 2; ++i)
+        check_collect(heap);
+    check(check_graph(heap,root) == expected_count());
+    gc_heap_destroy(heap);
+}
+
+#endif
+
+int main(int argc, char** argv){
+#ifndef GC_USE_MALLOC
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_compact(mode);
+#else
+    // compaction requires gc memory pool
+    gc_heap* heap = check_heap_create(1,CHECK_INCREMENTAL);
+    check(!gc_heap_set_compaction(heap,true));
+    gc_heap_destroy(heap);
+#endif
+    return check_status();
+}
@@ -0,0 +1,271 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// heap dump of known object graph analyzed by simplegc_heapdump, retained sizes follow dominator tree, diamond
+// branches don't dominate object they share, weak references don't retain objects and dump taken in the middle
+// of compaction lists moved objects once with references pointing to their new copies
+// usage: gccheck_dump simplegc_heapdump
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+// objects of dominator trees analyzer printed
+#define TREE_MAX 4096
+typedef struct {
+    uint64_t address;
+    uint64_t retained;
+    uint64_t shallow;
+    uint64_t parent; // immediate dominator, 0 for roots
+} tree_node;
+
+static tree_node tree[TREE_MAX];
+static uint32_t tree_count;
+static uint64_t reachable; // objects reachable from roots
+static uint64_t unreachable;
+static uint64_t class_retained; // bytes retained by class asked for
+
+static const char* analyzer;
+
+// write dump of heap into temporary file and parse analyzer report of it
+static bool analyze(gc_heap* heap, gc_object_class* cls){
+    char path[] = "/tmp/gccheck_dump_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0){
+        perror("mkstemp");
+        exit(2);
+    }
+    bool dumped = gc_heap_dump(heap,fd) && gc_heap_dump_wait(heap);
+    close(fd);
+    check(dumped);
+    char cmd[1024];
+    snprintf(cmd,sizeof(cmd),"%s -b -n 100 -d 100 -c %d %s",analyzer,TREE_MAX,path);
+    FILE* out = popen(cmd,"r");
+    if(out == null){
+        perror("popen");
+        exit(2);
+    }
+    char line[512];
+    uint64_t stack[100];
+    bool classes = false;
+    tree_count = 0;
+    reachable = unreachable = class_retained = 0;
+    while(fgets(line,sizeof(line),out) != null){
+        uint64_t retained, shallow, address, class, objects;
+        uint32_t level = 0;
+        while(line[level] == ' ')
+            level += 1;
+        if(sscanf(line,"reachable from roots %" SCNu64 " %*uB, unreachable %" SCNu64,&reachable,&unreachable) == 2)
+            continue;
+        if(strncmp(line,"classes by retained size",24) == 0)
+            classes = true;
+        if(strncmp(line,"largest dominator trees",23) == 0)
+            classes = false;
+        if(classes && sscanf(line,"%" SCNu64 "B %" SCNu64 "B %" SCNu64 " 0x%" SCNx64,&retained,&shallow,&objects,&class) == 4){
+            if(class == (uintptr_t)cls)
+                class_retained = retained;
+            continue;
+        }
+        if(classes || sscanf(line+level,"%" SCNu64 "B %" SCNu64 "B 0x%" SCNx64,&retained,&shallow,&address) != 3)
+            continue;
+        level /= 2;
+        if(tree_count == TREE_MAX || level >= 100){
+            check(tree_count < TREE_MAX && level < 100);
+            break;
+        }
+        stack[level] = address;
+        tree[tree_count].address = address;
+        tree[tree_count].retained = retained;
+        tree[tree_count].shallow = shallow;
+        tree[tree_count].parent = level > 0 ? stack[level-1] : 0;
+        tree_count += 1;
+    }
+    int status = pclose(out);
+    unlink(path);
+    check(status == 0);
+    return status == 0;
+}
+
+// dominator tree node of object, null if analyzer didn't find it reachable
+static tree_node* tree_find(gc_object* obj){
+    for(uint32_t i = 0; i < tree_count; ++i){
+        if(tree[i].address == (uintptr_t)obj)
+            return &tree[i];
+    }
+    return null;
+}
+
+// object is dominated by parent and retains given bytes
+static void check_node(gc_object* obj, gc_object* parent, uint64_t retained){
+    tree_node* n = tree_find(obj);
+    check(n != null);
+    if(n == null)
+        return;
+    check(n->parent == (uintptr_t)parent);
+    check(n->shallow == gc_object_block_reserved(obj));
+    check(n->retained == retained);
+}
+
+static gc_object_class tree_cls = { &gc_object_mark_black, &gc_object_contains, null, 0, null };
+
+// root references diamond, weak object and tree
+//   root -> a, b -> d -> e, a and b both reference d so only root dominates it
+//   root -> weak -> x, a, weak references neither retain x nor share a with root
+//   root -> t -> c0..c2 -> two leaves each
+static void check_dump_graph(check_mode mode){
+    gc_heap* heap = check_heap_create(1,mode);
+    gc_object* root = check_alloc(heap,4);
+    gc_heap_add_root(heap,root);
+    gc_object* a = check_alloc(heap,1);
+    gc_object* b = check_alloc(heap,2);
+    gc_object* d = check_alloc(heap,1);
+    gc_object* e = check_alloc(heap,300);
+    gc_heap_set_ref(heap,root,0,a);
+    gc_heap_set_ref(heap,root,1,b);
+    gc_heap_set_ref(heap,a,0,d);
+    gc_heap_set_ref(heap,b,1,d);
+    gc_heap_set_ref(heap,d,0,e);
+    gc_object* weak = gc_heap_alloc_weak(heap,2);
+    weak->class = &check_cls;
+    gc_heap_set_ref(heap,root,2,weak);
+    gc_heap_set_ref(heap,weak,1,a);
+    gc_object* t = check_alloc(heap,3);
+    t->class = &tree_cls;
+    gc_heap_set_ref(heap,root,3,t);
+    gc_object* c[3];
+    gc_object* leaves[6];
+    for(uint32_t i = 0; i < 3; ++i){
+        c[i] = check_alloc(heap,2);
+        c[i]->class = &tree_cls;
+        gc_heap_set_ref(heap,t,i,c[i]);
+        for(uint32_t j = 0; j < 2; ++j){
+            leaves[i*2+j] = check_alloc(heap,i*500+j);
+            leaves[i*2+j]->class = &tree_cls;
+            gc_heap_set_ref(heap,c[i],j,leaves[i*2+j]);
+        }
+    }
+    check_collect(heap);
+    // object referenced only weakly is left in dump as it's not collected yet
+    gc_object* x = check_alloc(heap,10);
+    gc_heap_set_ref(heap,weak,0,x);
+
+    if(!analyze(heap,&tree_cls)){
+        gc_heap_destroy(heap);
+        return;
+    }
+    check(reachable == 16);
+    check(unreachable == 1);
+    check(tree_find(x) == null);
+    uint64_t e_size = gc_object_block_reserved(e), d_size = gc_object_block_reserved(d) + e_size;
+    check_node(a,root,gc_object_block_reserved(a));
+    check_node(b,root,gc_object_block_reserved(b));
+    check_node(d,root,d_size);
+    check_node(e,d,e_size);
+    check_node(weak,root,gc_object_block_reserved(weak));
+    uint64_t t_size = gc_object_block_reserved(t);
+    for(uint32_t i = 0; i < 3; ++i){
+        uint64_t c_size = gc_object_block_reserved(c[i]);
+        for(uint32_t j = 0; j < 2; ++j){
+            gc_object* leaf = leaves[i*2+j];
+            check_node(leaf,c[i],gc_object_block_reserved(leaf));
+            c_size += gc_object_block_reserved(leaf);
+        }
+        check_node(c[i],t,c_size);
+        t_size += c_size;
+    }
+    check_node(t,root,t_size);
+    check(class_retained == t_size);
+    check_node(root,null,gc_object_block_reserved(root) + gc_object_block_reserved(a) + gc_object_block_reserved(b) +
+                         d_size + gc_object_block_reserved(weak) + t_size);
+    gc_heap_destroy(heap);
+}
+
+#ifndef GC_USE_MALLOC
+
+// chains of two objects, three of four die so oldest generation gets compacted
+#define CHAINS 2048
+
+// dump taken while references to moved objects are being fixed lists new copies only
+static void check_dump_compacting(){
+    gc_heap* heap = check_heap_create(2,CHECK_INCREMENTAL);
+    check(gc_heap_set_compaction(heap,true));
+    gc_object* root = check_alloc(heap,CHAINS);
+    gc_heap_add_root(heap,root);
+    gc_object** heads = (gc_object**)(root+1);
+    for(uint32_t i = 0; i < CHAINS; ++i){
+        gc_object* head = check_alloc(heap,1);
+        gc_heap_set_ref(heap,head,0,check_alloc(heap,0));
+        gc_heap_set_ref(heap,root,i,head);
+    }
+    for(uint32_t i = 0; i < 3; ++i)
+        check_collect(heap);
+    for(uint32_t i = 0; i < CHAINS; ++i){
+        if(i % 4 != 0)
+            gc_heap_set_ref(heap,root,i,null);
+    }
+    do{
+        gc_heap_collect(heap);
+    }while(heap->compacting != GC_COMPACT_FIX && !gc_heap_get_config(heap)->cycle_full);
+    check(heap->compacting == GC_COMPACT_FIX && heap->forwarded != null);
+    bool analyzed = analyze(heap,null);
+    check_collect(heap);
+    check(gc_heap_get_config(heap)->cycle_compacted > 0);
+    if(!analyzed){
+        gc_heap_destroy(heap);
+        return;
+    }
+
+    // objects are found at addresses of their new copies
+    check(reachable == 1 + CHAINS/4*2);
+    uint64_t size = gc_object_block_reserved(root);
+    for(uint32_t i = 0; i < CHAINS; i += 4){
+        gc_object* head = heads[i];
+        gc_object* tail = ((gc_object**)(head+1))[0];
+        uint64_t tail_size = gc_object_block_reserved(tail);
+        check_node(tail,head,tail_size);
+        check_node(head,root,gc_object_block_reserved(head) + tail_size);
+        size += gc_object_block_reserved(head) + tail_size;
+    }
+    check_node(root,null,size);
+    gc_heap_destroy(heap);
+}
+
+#endif
+
+int main(int argc, char** argv){
+    if(argc != 2){
+        fprintf(stderr,"usage: %s simplegc_heapdump\n",argv[0]);
+        return 2;
+    }
+    analyzer = argv[1];
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_dump_graph(mode);
+#ifndef GC_USE_MALLOC
+    check_dump_compacting();
+#endif
+    return check_status();
+}
@@ -0,0 +1,126 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// objects with many references are marked in chunks, increment that runs out of pause time saves how far it got
+// and next one resumes from there, reference counts don't have to fit 16 bits of object header
+
+#include <stdint.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+// array of more references than 16 bit count holds, each referencing child of it's own
+#define HUGE_REFS 200000
+// objects around large object threshold and 16 bit limit, first and last references point to children
+static const uint32_t sizes[] = { 124, 125, 126, 1000, 65534, 65535, 65536, 70000 };
+#define SIZES (sizeof(sizes)/sizeof(sizes[0]))
+// gc calls cycle may take, marking that starts over with every increment doesn't finish in them
+#define CALLS_MAX 1000000
+
+static void check_large(check_mode mode){
+    gc_heap* heap = check_heap_create(2,mode);
+    died = 0;
+    gc_object* array = check_alloc(heap,HUGE_REFS);
+    gc_heap_add_root(heap,array);
+    check(gc_object_refs_count(array) == HUGE_REFS && array->refs_count == GC_REFS_LARGE);
+    for(uint32_t i = 0; i < HUGE_REFS; ++i)
+        gc_heap_set_ref(heap,array,i,alloc_died(heap,0));
+    gc_object* objs[SIZES];
+    for(uint32_t i = 0; i < SIZES; ++i){
+        objs[i] = check_alloc(heap,sizes[i]);
+        gc_heap_add_root(heap,objs[i]);
+        check(gc_object_refs_count(objs[i]) == sizes[i]);
+        check(gc_object_large(objs[i]) == (sizes[i] >= 125));
+        gc_heap_set_ref(heap,objs[i],0,alloc_died(heap,0));
+        gc_heap_set_ref(heap,objs[i],sizes[i]-1,alloc_died(heap,0));
+    }
+
+    // array gets promoted and marked again in following cycles, promoted ahead of it's children it stays
+    // remembered until cycle that leaves silver objects, there it's marked once more, so one child dies then
+    uint32_t moved = 0;
+    for(uint32_t cycle = 0; cycle < 4; ++cycle){
+        if(cycle == 2)
+            gc_heap_set_ref(heap,array,1,null);
+        uint32_t calls = 0, scan = 0, partial = 0, restarts = 0;
+        do{
+            gc_heap_collect(heap);
+            calls += 1;
+            if(mode != CHECK_INCREMENTAL || !gc_color_is_grey(array))
+                continue;
+            // scan position of grey array only moves forward, marking that starts over never gets done
+            uint32_t now = gc_object_prefix_of(array)->scan;
+            check(now <= HUGE_REFS);
+            restarts += now < scan ? 1 : 0;
+            scan = now;
+            if(now == 0)
+                continue;
+            partial += 1;
+            // once every object is in oldest generation and array isn't remembered, child moved from part not
+            // yet scanned into scanned part is reachable only through reference marking already went past,
+            // it survives still and child it replaces dies, storing young child would get array marked again
+            if(cycle == 3 && moved == 0 && now < HUGE_REFS/2){
+                gc_heap_set_ref(heap,array,0,((gc_object**)(array+1))[HUGE_REFS-1]);
+                gc_heap_set_ref(heap,array,HUGE_REFS-1,null);
+                moved = 1;
+            }
+        }while(!gc_heap_get_config(heap)->cycle_full && calls < CALLS_MAX && restarts <= 1);
+        check(gc_heap_get_config(heap)->cycle_full);
+        if(mode == CHECK_INCREMENTAL)
+            check(partial > 0 && restarts <= (cycle == 2 ? 1 : 0));
+        if(!gc_heap_get_config(heap)->cycle_full){
+            gc_heap_destroy(heap);
+            return;
+        }
+    }
+    if(mode == CHECK_INCREMENTAL)
+        check(moved == 1);
+    check_collect(heap);
+    check(load(&died) == 1 + moved);
+    gc_object** refs = (gc_object**)(array+1);
+    uint32_t children = 0;
+    for(uint32_t i = 0; i < HUGE_REFS; ++i){
+        if(refs[i] != null && refs[i]->class == &died_cls)
+            children += 1;
+    }
+    check(children == HUGE_REFS - 1 - moved);
+    for(uint32_t i = 0; i < SIZES; ++i){
+        refs = (gc_object**)(objs[i]+1);
+        check(refs[0] != null && refs[0]->class == &died_cls);
+        check(refs[sizes[i]-1] != null && refs[sizes[i]-1]->class == &died_cls);
+    }
+
+    // every child dies with objects holding it
+    gc_heap_remove_root(heap,array);
+    for(uint32_t i = 0; i < SIZES; ++i)
+        gc_heap_remove_root(heap,objs[i]);
+    for(uint32_t i = 0; i < 3; ++i)
+        check_collect(heap);
+    check(load(&died) == HUGE_REFS + SIZES*2);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_large(mode);
+    return check_status();
+}
@@ -0,0 +1,154 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// objects allocated with class layout keep their data as is, only words of class refs bitmap are traced
+
+#include <stdint.h>
+#include <string.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+// children count their finalizers, layout objects count calls of their class gc_mark_black
+static uint32_t marked = 0;
+
+static void counting_mark_black(gc_object* obj){
+    __atomic_add_fetch(&marked,1,__ATOMIC_RELAXED);
+    gc_object_mark_black(obj);
+}
+
+// mixed data and references, data words hold addresses of objects too
+typedef struct {
+    uint64_t number;
+    gc_object* first;
+    uintptr_t address;
+    double value;
+    gc_object* second;
+    char text[13];
+} mixed;
+
+static const uint64_t mixed_refs[] = { gc_layout_bit(mixed,first) | gc_layout_bit(mixed,second) };
+static gc_object_class mixed_cls = { &counting_mark_black, &gc_object_contains, null, sizeof(mixed), mixed_refs };
+
+// large object with references spread over bitmap words, data words in between
+#define WIDE_WORDS 300
+static const uint32_t wide_ref_words[] = { 0, 63, 64, 127, 200, 299 };
+#define WIDE_REFS (sizeof(wide_ref_words)/sizeof(wide_ref_words[0]))
+static uint64_t wide_refs[(WIDE_WORDS+63)/64];
+static gc_object_class wide_cls = { &counting_mark_black, &gc_object_contains, null, WIDE_WORDS*sizeof(uint64_t), wide_refs };
+
+// class without references
+static gc_object_class data_cls = { &counting_mark_black, &gc_object_contains, null, 100, null };
+
+#define MIXED_COUNT 1000
+
+static void check_layout(check_mode mode){
+    gc_heap* heap = check_heap_create(2,mode);
+    died = marked = 0;
+    gc_object* root = check_alloc(heap,MIXED_COUNT+2);
+    gc_heap_add_root(heap,root);
+
+    // references keep children alive, addresses in data words don't
+    for(uint32_t i = 0; i < MIXED_COUNT; ++i){
+        gc_object* obj = gc_heap_alloc_object(heap,&mixed_cls);
+        mixed* m = (mixed*)gc_object_data(obj);
+        check(gc_object_refs_count(obj) == (sizeof(mixed)+7)/8);
+        check(m->number == 0 && m->first == null && m->address == 0 && m->second == null && m->text[12] == 0);
+        m->number = i;
+        m->value = i/2.0;
+        snprintf(m->text,sizeof(m->text),"object %u",i);
+        gc_heap_set_ref(heap,obj,gc_layout_index(mixed,first),alloc_died(heap,0));
+        if(i % 2 == 0)
+            gc_heap_set_ref(heap,obj,gc_layout_index(mixed,second),alloc_died(heap,0));
+        m->address = (uintptr_t)alloc_died(heap,0);
+        gc_heap_set_ref(heap,root,i,obj);
+    }
+
+    gc_object* wide = gc_heap_alloc_object(heap,&wide_cls);
+    check(gc_object_refs_count(wide) == WIDE_WORDS && gc_object_large(wide));
+    uint64_t* words = (uint64_t*)gc_object_data(wide);
+    for(uint32_t i = 0; i < WIDE_WORDS; ++i)
+        check(words[i] == 0);
+    for(uint32_t i = 0; i < WIDE_WORDS; ++i)
+        words[i] = (uintptr_t)alloc_died(heap,0);
+    for(uint32_t i = 0; i < WIDE_REFS; ++i)
+        gc_heap_set_ref(heap,wide,wide_ref_words[i],alloc_died(heap,0));
+    gc_heap_set_ref(heap,root,MIXED_COUNT,wide);
+
+    gc_object* data = gc_heap_alloc_object(heap,&data_cls);
+    check(gc_object_refs_count(data) == 13);
+    memset(gc_object_data(data),0xAB,100);
+    gc_heap_set_ref(heap,root,MIXED_COUNT+1,data);
+
+    // children referenced only from data words die, data stays as it was written, reference words of wide
+    // object held addresses of children too before they were set
+    uint32_t garbage = MIXED_COUNT + WIDE_WORDS;
+    for(uint32_t i = 0; i < 4; ++i)
+        check_collect(heap);
+    check(load(&died) == garbage);
+    check(load(&marked) == 0);
+    gc_object** refs = (gc_object**)(root+1);
+    for(uint32_t i = 0; i < MIXED_COUNT; ++i){
+        mixed* m = (mixed*)gc_object_data(refs[i]);
+        char text[13];
+        snprintf(text,sizeof(text),"object %u",i);
+        check(m->number == i && m->value == i/2.0 && strcmp(m->text,text) == 0);
+        check(m->first != null && m->first->class == &died_cls);
+        check(i % 2 == 0 ? m->second != null && m->second->class == &died_cls : m->second == null);
+    }
+    for(uint32_t i = 0; i < WIDE_REFS; ++i){
+        gc_object* child = (gc_object*)words[wide_ref_words[i]];
+        check(child != null && child->class == &died_cls);
+    }
+    const unsigned char* bytes = (const unsigned char*)gc_object_data(data);
+    for(uint32_t i = 0; i < 100; ++i)
+        check(bytes[i] == 0xAB);
+
+    // children stored into reference words of old objects survive, overwritten ones die
+    for(uint32_t i = 0; i < MIXED_COUNT; i += 2)
+        gc_heap_set_ref(heap,refs[i],gc_layout_index(mixed,second),alloc_died(heap,0));
+    gc_heap_set_ref(heap,wide,wide_ref_words[WIDE_REFS-1],alloc_died(heap,0));
+    for(uint32_t i = 0; i < 2; ++i)
+        check_collect(heap);
+    check(load(&died) == garbage + MIXED_COUNT/2 + 1);
+    for(uint32_t i = 0; i < MIXED_COUNT; i += 2){
+        mixed* m = (mixed*)gc_object_data(refs[i]);
+        check(m->second != null && m->second->class == &died_cls);
+    }
+
+    // every child dies with objects holding it
+    gc_heap_remove_root(heap,root);
+    for(uint32_t i = 0; i < 3; ++i)
+        check_collect(heap);
+    check(load(&died) == MIXED_COUNT*2 + MIXED_COUNT/2*2 + WIDE_WORDS + WIDE_REFS + 1);
+    check(load(&marked) == 0);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    for(uint32_t i = 0; i < WIDE_REFS; ++i)
+        wide_refs[wide_ref_words[i]/64] |= ((uint64_t)1) << (wide_ref_words[i]%64);
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_layout(mode);
+    return check_status();
+}
@@ -0,0 +1,249 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// gc_heap_contains and gc_heap_lookup find live objects of every size from any address inside them
+// and never garbage waiting to be freed, even while sweep is split into increments or runs concurrently
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+// number of references of objects, single page slabs, spans and large blocks of their own
+static const uint32_t sizes[] = { 0, 1, 7, 60, 124, 125, 140, 300, 1000, 2040, 5000 };
+#define SIZES (sizeof(sizes)/sizeof(sizes[0]))
+#define COPIES 50
+
+static gc_heap* heap;
+static gc_object* dead[SIZES*COPIES];
+static char* dead_last[SIZES*COPIES]; // last byte of dead object, freed ones can't be asked for their size
+static uint32_t dead_count = 0;
+static uint32_t finalized = 0;
+static uint32_t found_dead = 0;
+
+// every dead object is transparent or freed already while garbage is being freed
+static void dead_finalize(gc_object* obj){
+    finalized += 1;
+    for(uint32_t i = 0; i < dead_count; ++i){
+        gc_object* o = dead[i];
+        if(gc_heap_contains(heap,o) || gc_heap_lookup(heap,o) != null ||
+           gc_heap_lookup(heap,dead_last[i]) != null)
+            found_dead += 1;
+    }
+}
+
+static gc_object_class dead_cls = { &gc_object_mark_black, &gc_object_contains, &dead_finalize, 0, null };
+
+// check object is found from it's first and last byte and every reference in between
+static void check_found(gc_object* obj){
+    check(gc_heap_contains(heap,obj));
+    check(gc_heap_lookup(heap,obj) == obj);
+    char* block = (char*)gc_object_block(obj);
+    check(gc_heap_lookup(heap,block) == obj);
+    check(gc_heap_lookup(heap,block + gc_object_block_size(obj) - 1) == obj);
+    uint32_t count = gc_object_refs_count(obj);
+    gc_object** refs = (gc_object**)(obj+1);
+    for(uint32_t i = 0; i < count; i += 1 + count/8)
+        check(gc_heap_lookup(heap,&refs[i]) == obj);
+    // interior pointer isn't object itself
+    if(count > 0)
+        check(!gc_heap_contains(heap,(gc_object*)&refs[0]));
+}
+
+// objects allocated with malloc are looked up in lists, fewer of them keep test quick
+#ifdef GC_USE_MALLOC
+#define SWEPT 500
+#else
+#define SWEPT 20000
+#endif
+#define LATE 64
+static gc_object* swept[SWEPT];
+
+// objects allocated while sweep is in progress, they have to survive it
+static void alloc_late(gc_object* holder, uint32_t* late){
+    if(*late == LATE)
+        return;
+    gc_object* obj = check_alloc(heap,0);
+    check(gc_heap_lookup(heap,obj) == obj);
+    gc_heap_set_ref(heap,holder,(*late)++,obj);
+}
+
+// check objects allocated while sweep was in progress are still there
+static void check_late(gc_object* holder, uint32_t late){
+    gc_object** refs = (gc_object**)(holder+1);
+    for(uint32_t i = 0; i < late; ++i)
+        check(gc_heap_contains(heap,refs[i]));
+}
+
+// allocate objects that die, weak object references each of them if it's given, returns root holding late objects
+static gc_object* alloc_swept(gc_object* weak){
+    gc_object* holder = check_alloc(heap,LATE);
+    gc_heap_add_root(heap,holder);
+    for(uint32_t i = 0; i < SWEPT; ++i){
+        swept[i] = check_alloc(heap,1);
+        if(weak != null)
+            gc_heap_set_ref(heap,weak,i,swept[i]);
+    }
+    return holder;
+}
+
+// number of objects that died found by lookup or read from weak object
+static uint32_t found_swept(gc_object* weak){
+    uint32_t found = 0;
+    for(uint32_t i = 0; i < SWEPT; ++i){
+        if(gc_heap_lookup(heap,swept[i]) != null)
+            found += 1;
+        if(weak != null && gc_heap_get_weak(heap,weak,i) != null)
+            found += 1;
+    }
+    return found;
+}
+
+// objects allocated in between increments of sweep are black and survive it, garbage it didn't get to
+// yet isn't found
+static void check_sweep_increments(){
+    heap = check_heap_create(1,CHECK_INCREMENTAL);
+    gc_object* holder = alloc_swept(null);
+    uint32_t increments = 0, late = 0, found = 0;
+    do{
+        gc_heap_collect(heap);
+        if(heap->sweeping){
+            increments += 1;
+            found += found_swept(null);
+            alloc_late(holder,&late);
+        }
+    }while(!gc_heap_get_config(heap)->cycle_full);
+    check(increments > 1);
+    check(found == 0);
+    check(late > 0);
+    check_collect(heap);
+    check_late(holder,late);
+    gc_heap_destroy(heap);
+}
+
+#define SWEEP_ROUNDS 20
+
+static void* sweep_collect(bool* done){
+    check_collect(heap);
+    __atomic_store_n(done,true,__ATOMIC_RELEASE);
+    return null;
+}
+
+// background collector sweeps and clears weak references outside of pause, mutator running meanwhile
+// doesn't find garbage or read it from weak object and objects it allocates survive, cycles are repeated
+// until mutator gets to run during sweep, on single cpu collector might always be done before it does
+static void check_sweep_concurrent(){
+    heap = check_heap_create(1,CHECK_CONCURRENT);
+    gc_object* weak = gc_heap_alloc_weak(heap,SWEPT);
+    weak->class = &check_cls;
+    gc_heap_add_root(heap,weak);
+    uint32_t sweeping = 0, found = 0;
+    for(uint32_t round = 0; round < SWEEP_ROUNDS && sweeping == 0; ++round){
+        gc_object* holder = alloc_swept(weak);
+        bool done = false;
+        uint32_t late = 0;
+        pthread_t collect;
+        pthread_create(&collect,null,(void*(*)(void*))&sweep_collect,&done);
+        while(!__atomic_load_n(&done,__ATOMIC_ACQUIRE)){
+            gc_heap_safepoint(heap);
+            // sweep ends in pause, it can't end before this thread gets to safepoint again
+            if(__atomic_load_n(&heap->sweeping,__ATOMIC_RELAXED)){
+                sweeping += 1;
+                found += found_swept(weak);
+                alloc_late(holder,&late);
+            }
+        }
+        gc_heap_safe_region_enter(heap);
+        pthread_join(collect,null);
+        gc_heap_safe_region_leave(heap);
+        check(found_swept(weak) == 0);
+        check_collect(heap);
+        check_late(holder,late);
+        gc_heap_remove_root(heap,holder);
+    }
+    check(found == 0);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    check_sweep_increments();
+    check_sweep_concurrent();
+
+    heap = check_heap_create(1,CHECK_INCREMENTAL);
+    gc_object* live[SIZES*COPIES];
+    uint32_t live_count = 0;
+    for(uint32_t c = 0; c < COPIES; ++c){
+        for(uint32_t s = 0; s < SIZES; ++s){
+            gc_object* obj = check_alloc(heap,sizes[s]);
+            if(c % 2 == 0){
+                gc_heap_add_root(heap,obj);
+                live[live_count++] = obj;
+            }else{
+                obj->class = &dead_cls;
+                dead_last[dead_count] = ((char*)gc_object_block(obj)) + gc_object_block_size(obj) - 1;
+                dead[dead_count++] = obj;
+            }
+        }
+    }
+
+    // objects are found before and after collection
+    for(uint32_t i = 0; i < live_count; ++i)
+        check_found(live[i]);
+    for(uint32_t i = 0; i < dead_count; ++i)
+        check_found(dead[i]);
+    check_collect(heap);
+    for(uint32_t i = 0; i < live_count; ++i)
+        check_found(live[i]);
+    check(finalized == dead_count);
+    check(found_dead == 0);
+
+    // memory outside of heap and past object end
+    int local;
+    check(gc_heap_lookup(heap,&local) == null);
+    check(gc_heap_lookup(heap,null) == null);
+    check(!gc_heap_contains(heap,null));
+    check(!gc_heap_contains(heap,(gc_object*)&local));
+#ifndef GC_USE_MALLOC
+    // 140 references take 1160 bytes, rest of span slot past object isn't part of it
+    gc_object* obj = live[6];
+    check(gc_object_refs_count(obj) == 140);
+    size_t size = gc_object_block_size(obj);
+    check(gc_pool_reserved(size) > size);
+    check(gc_heap_lookup(heap,((char*)gc_object_block(obj)) + size) != obj);
+
+    // stats count reserved bytes, span slots are close to object size instead of being rounded up to pages
+    gc_stats before, after;
+    gc_heap_get_stats(heap,&before);
+    gc_heap_add_root(heap,check_alloc(heap,140));
+    gc_heap_get_stats(heap,&after);
+    check(after.allocated_bytes - before.allocated_bytes == gc_pool_reserved(size));
+    check(gc_pool_reserved(size) < size + size/4);
+    check(gc_pool_reserved(gc_object_size(1000)) < 2*GC_POOL_SLAB_SIZE);
+    check(gc_pool_reserved(gc_object_size(5000)) == 10*GC_POOL_SLAB_SIZE);
+#endif
+
+    gc_heap_destroy(heap);
+    return check_status();
+}
@@ -0,0 +1,112 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// objects from large object threshold up are mapped into regions of their own, region is unmapped as soon as
+// object dies and cycle stats follow how many of them are mapped, smaller ones don't count
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+#ifndef GC_USE_MALLOC
+
+#define LARGE 4
+// references of object just above default threshold
+#define LARGE_REFS (GC_POOL_LOS_THRESHOLD/sizeof(gc_object*))
+// references of object too big for slabs but below threshold
+#define MEDIUM_REFS (GC_POOL_LOS_THRESHOLD/sizeof(gc_object*)/4)
+
+// size of region object is mapped into
+#define region_size(refs) ((gc_object_size(refs) + GC_POOL_SLAB_SIZE - 1) & ~((size_t)GC_POOL_SLAB_SIZE - 1))
+
+// check if region of large object is mapped, mincore fails with ENOMEM for ranges that aren't
+// object header might follow prefix of large object, region starts at page object is in
+static bool mapped(gc_object* obj, size_t size){
+    unsigned char pages[region_size(LARGE_REFS)/GC_POOL_SLAB_SIZE];
+    void* region = (void*)(((uintptr_t)obj) & ~((uintptr_t)GC_POOL_SLAB_SIZE - 1));
+    return mincore(region,size,pages) == 0;
+}
+
+static void check_large_space(check_mode mode){
+    gc_heap* heap = check_heap_create(1,mode);
+    gc_config* config = gc_heap_get_config(heap);
+    gc_object* objs[LARGE];
+    for(uint32_t i = 0; i < LARGE; ++i){
+        objs[i] = check_alloc(heap,LARGE_REFS);
+        gc_heap_add_root(heap,objs[i]);
+    }
+    gc_object* medium = check_alloc(heap,MEDIUM_REFS);
+    gc_heap_add_root(heap,medium);
+    check_collect(heap);
+    check(config->cycle_large_objects == LARGE);
+    check(config->cycle_large_bytes == LARGE*region_size(LARGE_REFS));
+    for(uint32_t i = 0; i < LARGE; ++i)
+        check(mapped(objs[i],region_size(LARGE_REFS)));
+
+    // half of them die, their regions are gone once cycle frees them
+    for(uint32_t i = 0; i < LARGE/2; ++i)
+        gc_heap_remove_root(heap,objs[i]);
+    gc_heap_remove_root(heap,medium);
+    check_collect(heap);
+    check(config->cycle_large_objects == LARGE/2);
+    check(config->cycle_large_bytes == (LARGE/2)*region_size(LARGE_REFS));
+    for(uint32_t i = 0; i < LARGE; ++i){
+        errno = 0;
+        check(mapped(objs[i],region_size(LARGE_REFS)) == (i >= LARGE/2));
+        if(i < LARGE/2)
+            check(errno == ENOMEM);
+    }
+
+    // threshold has to be above sizes slabs hold, objects allocated once it's off aren't mapped
+    check(!gc_heap_set_large_threshold(heap,GC_POOL_MAX_SIZE) && errno == EINVAL);
+    check(gc_heap_set_large_threshold(heap,0));
+    gc_object* unmapped = check_alloc(heap,LARGE_REFS);
+    gc_heap_add_root(heap,unmapped);
+    check_collect(heap);
+    check(config->cycle_large_objects == LARGE/2);
+    gc_heap_remove_root(heap,unmapped);
+    for(uint32_t i = LARGE/2; i < LARGE; ++i)
+        gc_heap_remove_root(heap,objs[i]);
+    check_collect(heap);
+    check(config->cycle_large_objects == 0 && config->cycle_large_bytes == 0);
+    gc_heap_destroy(heap);
+}
+
+#endif
+
+int main(int argc, char** argv){
+#ifndef GC_USE_MALLOC
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_large_space(mode);
+#else
+    // large object space requires gc memory pool
+    gc_heap* heap = check_heap_create(1,CHECK_INCREMENTAL);
+    check(!gc_heap_set_large_threshold(heap,128*1024) && errno == ENOTSUP);
+    check(gc_heap_set_large_threshold(heap,0));
+    gc_heap_destroy(heap);
+#endif
+    return check_status();
+}
@@ -0,0 +1,308 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// gc_set_refs and gc_copy_refs store like memmove, overlapping ranges included, and objects moved between
+// holders with them survive stop the world increments with and without store buffer and background marking
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+// children carry their number and count their finalizers same as objects expected to die
+static gc_object_class child_cls = { &gc_object_mark_black, &gc_object_contains, &died_finalize, sizeof(uint64_t), null };
+
+static gc_object* alloc_child(gc_heap* heap, uint64_t id){
+    gc_object* obj = gc_heap_alloc_object(heap,&child_cls);
+    *(uint64_t*)gc_object_data(obj) = id;
+    return obj;
+}
+
+static gc_object* ref(gc_object* obj, uint32_t i){
+    return __atomic_load_n(((gc_object**)(obj+1)) + i,__ATOMIC_ACQUIRE);
+}
+
+// references of object are same as expected ones
+static bool refs_equal(gc_object* obj, gc_object** expected, uint32_t count){
+    for(uint32_t i = 0; i < count; ++i){
+        if(ref(obj,i) != expected[i])
+            return false;
+    }
+    return true;
+}
+
+#define SLOTS 8
+
+// stores within same object and between objects match memmove on plain array, children left without
+// reference die
+static void check_stores(check_mode mode){
+    gc_heap* heap = check_heap_create(2,mode);
+    died = 0;
+    gc_object* holder = check_alloc(heap,SLOTS);
+    gc_object* other = check_alloc(heap,SLOTS);
+    gc_heap_add_root(heap,holder);
+    gc_heap_add_root(heap,other);
+    gc_object* children[SLOTS];
+    gc_object* expected[SLOTS];
+    for(uint32_t i = 0; i < SLOTS; ++i)
+        children[i] = alloc_child(heap,i);
+
+    gc_heap_set_refs(heap,holder,0,SLOTS,children);
+    memcpy(expected,children,sizeof(expected));
+    check(refs_equal(holder,expected,SLOTS));
+
+    // forward overlap, destination after source
+    gc_heap_copy_refs(heap,holder,2,holder,0,5);
+    memmove(expected+2,expected,5*sizeof(gc_object*));
+    check(refs_equal(holder,expected,SLOTS));
+
+    // backward overlap, destination before source
+    gc_heap_copy_refs(heap,holder,0,holder,3,5);
+    memmove(expected,expected+3,5*sizeof(gc_object*));
+    check(refs_equal(holder,expected,SLOTS));
+
+    // values overlapping slots of same object
+    gc_heap_set_refs(heap,holder,1,6,((gc_object**)(holder+1)) + 2);
+    memmove(expected+1,expected+2,6*sizeof(gc_object*));
+    check(refs_equal(holder,expected,SLOTS));
+
+    // null values clear slots, copying nothing changes nothing
+    gc_heap_set_refs(heap,holder,5,3,null);
+    memset(expected+5,0,3*sizeof(gc_object*));
+    gc_heap_copy_refs(heap,holder,0,holder,5,0);
+    gc_heap_set_refs(heap,holder,0,0,null);
+    check(refs_equal(holder,expected,SLOTS));
+
+    // copy between objects
+    gc_heap_copy_refs(heap,other,4,holder,0,0);
+    gc_heap_copy_refs(heap,other,0,holder,0,4);
+    check(refs_equal(other,expected,4));
+    check(ref(other,4) == null);
+
+    // children referenced by neither holder die
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < SLOTS; ++i){
+        bool found = false;
+        for(uint32_t j = 0; j < SLOTS; ++j)
+            found = found || expected[j] == children[i];
+        kept += found ? 1 : 0;
+    }
+    check_collect(heap);
+    check_collect(heap);
+    check(load(&died) == SLOTS - kept);
+    check(refs_equal(holder,expected,SLOTS));
+    check(refs_equal(other,expected,4));
+
+    gc_heap_set_refs(heap,holder,0,SLOTS,null);
+    gc_heap_set_refs(heap,other,0,SLOTS,null);
+    check_collect(heap);
+    check_collect(heap);
+    check(load(&died) == SLOTS);
+    gc_heap_destroy(heap);
+}
+
+#define CHILDREN 64
+#define FILLERS 2000
+#define CYCLES 8
+#define GATE_MOVES 5
+#define INCREMENT_MOVES 200
+
+// gate in middle of chain holds background marking until thread has moved children few times, odd number
+// of moves leaves children in other holder at start of next cycle, gate marked during pause doesn't wait
+// since thread is stopped then
+static gc_heap* gate_heap = null;
+static uint32_t gate_entered = 0;
+static uint32_t gate_released = 0;
+
+static void gate_mark_black(gc_object* obj){
+    gc_heap* heap = __atomic_load_n(&gate_heap,__ATOMIC_ACQUIRE);
+    if(heap != null && heap->background){
+        uint32_t entered = __atomic_add_fetch(&gate_entered,1,__ATOMIC_ACQ_REL);
+        while(__atomic_load_n(&gate_released,__ATOMIC_ACQUIRE) < entered)
+            ;
+    }
+    gc_object_mark_black(obj);
+}
+
+static gc_object_class gate_cls = { &gate_mark_black, &gc_object_contains, null, 0, null };
+
+// children are moved back and forth between two holders, rotated by one with overlapping copy each time
+typedef struct {
+    gc_heap* heap;
+    gc_object* front; // rooted directly, marked early in cycle
+    gc_object* back; // reached through long chain, marked late in cycle
+    bool in_front; // which holder children are in, other one is all null
+    uint32_t offset; // slot i holds child (i + offset) % CHILDREN
+    uint32_t regreyed; // moves into black holder of unmarked children that marked holder grey again
+    uint32_t buffered; // moves into black holder that were logged to store buffer instead
+    uint32_t logged; // moves into black holder of unmarked children during background marking
+    bool done; // collecting thread is done
+} churn;
+
+static void churn_move(churn* c){
+    gc_heap* heap = c->heap;
+    gc_object* src = c->in_front ? c->front : c->back;
+    gc_object* dst = c->in_front ? c->back : c->front;
+    if(c->in_front){
+        // rotate right, overlapping copy goes backwards
+        gc_object* last = ref(src,CHILDREN-1);
+        gc_heap_copy_refs(heap,src,1,src,0,CHILDREN-1);
+        gc_heap_set_refs(heap,src,0,1,&last);
+        c->offset = (c->offset + CHILDREN - 1) % CHILDREN;
+    }else{
+        // rotate left, overlapping copy goes forwards
+        gc_object* first = ref(src,0);
+        gc_heap_copy_refs(heap,src,0,src,1,CHILDREN-1);
+        gc_heap_set_refs(heap,src,CHILDREN-1,1,&first);
+        c->offset = (c->offset + 1) % CHILDREN;
+    }
+    bool black = gc_color_is_black(dst);
+    bool unmarked = false;
+    for(uint32_t i = 0; i < CHILDREN; ++i)
+        unmarked = unmarked || gc_color_is_silver_or_white(ref(src,i));
+    if(c->in_front){
+        gc_heap_copy_refs(heap,dst,0,src,0,CHILDREN);
+    }else{
+        gc_object* values[CHILDREN];
+        for(uint32_t i = 0; i < CHILDREN; ++i)
+            values[i] = ref(src,i);
+        gc_heap_set_refs(heap,dst,0,CHILDREN,values);
+    }
+    gc_heap_set_refs(heap,src,0,CHILDREN,null);
+    c->in_front = !c->in_front;
+    if(black && unmarked && __atomic_load_n(&heap->marking,__ATOMIC_RELAXED)){
+        // old references overwritten in source are logged instead
+        c->logged += 1;
+    }else if(black && unmarked){
+        if(heap->store_buffering){
+            // holder isn't marked grey at store, it's logged and rescanned at next collection
+            check(gc_color_is_black(dst));
+            c->buffered += 1;
+        }else{
+            check(!gc_color_is_black(dst));
+            c->regreyed += 1;
+        }
+    }
+}
+
+static void* churn_collect(churn* c){
+    for(uint32_t i = 0; i < CYCLES; ++i)
+        check_collect(c->heap);
+    __atomic_store_n(&c->done,true,__ATOMIC_RELEASE);
+    return null;
+}
+
+// every child is always referenced by one of holders, none of them dies while they're moved in between
+// increments or while background marking is running
+static void check_churn(check_mode mode, bool store_buffering){
+    gc_heap* heap = check_heap_create(2,mode);
+    gc_heap_set_store_buffer(heap,store_buffering);
+    died = 0;
+    churn c;
+    memset(&c,0,sizeof(c));
+    c.heap = heap;
+    c.front = check_alloc(heap,CHILDREN);
+    c.back = check_alloc(heap,CHILDREN);
+    c.in_front = true;
+    gc_heap_add_root(heap,c.front);
+    gc_object* chain = check_alloc(heap,1);
+    gc_heap_add_root(heap,chain);
+    gc_object* tail = chain;
+    for(uint32_t i = 0; i < FILLERS; ++i){
+        gc_object* filler = check_alloc(heap,1);
+        if(i == FILLERS/2)
+            filler->class = &gate_cls;
+        gc_heap_set_ref(heap,tail,0,filler);
+        tail = filler;
+    }
+    gc_heap_set_ref(heap,tail,0,c.back);
+    for(uint32_t i = 0; i < CHILDREN; ++i)
+        gc_heap_set_ref(heap,c.front,i,alloc_child(heap,i));
+
+    if(mode == CHECK_CONCURRENT){
+        gate_entered = gate_released = 0;
+        __atomic_store_n(&gate_heap,heap,__ATOMIC_RELEASE);
+        pthread_t collect;
+        pthread_create(&collect,null,(void*(*)(void*))&churn_collect,&c);
+        while(!__atomic_load_n(&c.done,__ATOMIC_ACQUIRE)){
+            churn_move(&c);
+            gc_heap_safepoint(heap);
+            uint32_t entered = __atomic_load_n(&gate_entered,__ATOMIC_ACQUIRE);
+            if(entered > gate_released){
+                check(__atomic_load_n(&heap->marking,__ATOMIC_RELAXED));
+                for(uint32_t i = 0; i < GATE_MOVES; ++i)
+                    churn_move(&c);
+                __atomic_store_n(&gate_released,entered,__ATOMIC_RELEASE);
+            }
+        }
+        gc_heap_safe_region_enter(heap);
+        pthread_join(collect,null);
+        gc_heap_safe_region_leave(heap);
+        __atomic_store_n(&gate_heap,null,__ATOMIC_RELEASE);
+        check(c.logged > 0);
+    }else{
+        // holder stored into after every increment is marked again by next one, with tiny max pause that's
+        // all increment gets to do, so moves stop after first increments of cycle to let it end
+        for(uint32_t i = 0; i < CYCLES; ++i){
+            uint32_t increments = 0;
+            do{
+                gc_heap_collect(heap);
+                if(increments++ < INCREMENT_MOVES)
+                    churn_move(&c);
+            }while(!gc_heap_get_config(heap)->cycle_full);
+        }
+        if(store_buffering)
+            check(c.buffered > 0);
+        else
+            check(c.regreyed > 0);
+    }
+    check_collect(heap);
+    check(load(&died) == 0);
+
+    gc_object* holder = c.in_front ? c.front : c.back;
+    gc_object* empty = c.in_front ? c.back : c.front;
+    for(uint32_t i = 0; i < CHILDREN; ++i){
+        gc_object* child = ref(holder,i);
+        check(child != null && child->class == &child_cls);
+        check(child != null && *(uint64_t*)gc_object_data(child) == (i + c.offset) % CHILDREN);
+        check(ref(empty,i) == null);
+    }
+
+    gc_heap_remove_root(heap,c.front);
+    gc_heap_set_refs(heap,c.back,0,CHILDREN,null);
+    check_collect(heap);
+    check_collect(heap);
+    check(load(&died) == CHILDREN);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode){
+        check_stores(mode);
+        check_churn(mode,false);
+    }
+    check_churn(CHECK_INCREMENTAL,true);
+    return check_status();
+}
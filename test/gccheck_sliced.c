@@ -0,0 +1,87 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// cycle sliced into many increments does the same work as one done in single increment, it continues from
+// phase previous increment stopped in instead of starting over and refreshing generations again, only object
+// increment stopped in the middle of is checked again by next one
+
+#include <stdint.h>
+#include "gccheck.h"
+
+#define LIVE 2000
+#define CYCLES 3
+// sliced cycle starting over in every increment never gets full
+#define MAX_CALLS 1000000
+
+// heap refreshing every generation each microsecond, which passes many times during sliced cycle
+static gc_heap* sliced_heap_create(uint64_t max_pause){
+    gc_heap* heap = check_heap_create(2,CHECK_INCREMENTAL);
+    gc_config* config = gc_heap_get_config(heap);
+    config->max_pause = max_pause;
+    for(uint8_t i = 0; i < config->gens_count; ++i)
+        config->gens[i].refresh_interval = 1000;
+    return heap;
+}
+
+// live objects held by root, as many garbage ones allocated alongside them
+static void sliced_fill(gc_heap* heap){
+    gc_object* root = check_alloc(heap,LIVE);
+    gc_heap_add_root(heap,root);
+    for(uint32_t i = 0; i < LIVE; ++i){
+        gc_heap_set_ref(heap,root,i,check_alloc(heap,1));
+        check_alloc(heap,1);
+    }
+}
+
+// objects checked during whole cycle summed over it's increments
+static uint64_t sliced_cycle(gc_heap* heap, uint32_t* calls){
+    uint64_t objects = 0;
+    *calls = 0;
+    do{
+        gc_heap_collect(heap);
+        objects += gc_heap_get_config(heap)->cycle_objects;
+        *calls += 1;
+    }while(!gc_heap_get_config(heap)->cycle_full && *calls < MAX_CALLS);
+    check(gc_heap_get_config(heap)->cycle_full);
+    return objects;
+}
+
+int main(int argc, char** argv){
+    gc_heap* sliced = sliced_heap_create(1000);
+    gc_heap* whole = sliced_heap_create(1000000000);
+    sliced_fill(sliced);
+    sliced_fill(whole);
+    for(uint32_t c = 0; c < CYCLES; ++c){
+        uint32_t sliced_calls, whole_calls;
+        uint64_t sliced_objects = sliced_cycle(sliced,&sliced_calls);
+        uint64_t whole_objects = sliced_cycle(whole,&whole_calls);
+        check(sliced_calls > 1);
+        check(whole_calls == 1);
+        check(sliced_objects >= whole_objects);
+        check(sliced_objects <= whole_objects + sliced_calls);
+    }
+    gc_heap_destroy(sliced);
+    gc_heap_destroy(whole);
+    return check_status();
+}
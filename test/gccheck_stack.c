@@ -0,0 +1,121 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// objects referenced only from thread stacks and registers survive conservative collection,
+// including ones held by attached thread parked at safepoint or inside safe region
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include "gccheck.h"
+
+// objects held by collecting thread's own stack and registers live only while stacks are scanned
+__attribute__((noinline))
+static void check_self(bool conservative){
+    gc_heap* heap = check_heap_create(1,CHECK_INCREMENTAL);
+    gc_heap_set_conservative(heap,conservative);
+    died = 0;
+    gc_object* volatile on_stack = alloc_died(heap,0);
+#if defined(__x86_64__)
+    register gc_object* in_register asm("r12") = alloc_died(heap,0);
+#else
+    gc_object* in_register = alloc_died(heap,0);
+#endif
+    check_collect(heap);
+    // keeps register value alive across collection
+    __asm__ volatile("" : : "r"(in_register));
+    check(load(&died) == (conservative ? 0 : 2));
+    if(conservative){
+        check(gc_heap_contains(heap,on_stack));
+        check(gc_heap_contains(heap,in_register));
+    }
+    gc_heap_destroy(heap);
+}
+
+// attached thread holding object in it's stack while main thread collects
+typedef struct {
+    gc_heap* heap;
+    bool safe_region; // wait inside safe region instead of polling safepoint
+    uint32_t state; // 0 starting, 1 attached, 2 conservative enabled, 3 holding object, 4 released
+} check_holder;
+
+static void wait_state(check_holder* h, uint32_t state){
+    while(load(&h->state) != state){
+        if(!h->safe_region)
+            gc_heap_safepoint(h->heap);
+        struct timespec ts = { 0, 100000 };
+        nanosleep(&ts,null);
+    }
+}
+
+static void* holder_run(check_holder* h){
+    gc_heap_thread_attach(h->heap);
+    __atomic_store_n(&h->state,1,__ATOMIC_RELEASE);
+    wait_state(h,2);
+    gc_object* held = alloc_died(h->heap,0);
+    if(h->safe_region)
+        gc_heap_safe_region_enter(h->heap);
+    __atomic_store_n(&h->state,3,__ATOMIC_RELEASE);
+    wait_state(h,4);
+    if(h->safe_region)
+        gc_heap_safe_region_leave(h->heap);
+    // keeps held object alive while thread waits
+    __asm__ volatile("" : : "r"(held));
+    gc_heap_thread_detach(h->heap);
+    return null;
+}
+
+// stack and registers saved by parked thread are roots, object dies once scanning is off
+static void check_parked(bool safe_region){
+    gc_heap* heap = check_heap_create(1,CHECK_INCREMENTAL);
+    died = 0;
+    check_holder h = { heap, safe_region, 0 };
+    pthread_t thread;
+    pthread_create(&thread,null,(void*(*)(void*))&holder_run,&h);
+    while(load(&h.state) != 1)
+        sched_yield();
+    gc_heap_set_conservative(heap,true);
+    __atomic_store_n(&h.state,2,__ATOMIC_RELEASE);
+    while(load(&h.state) != 3)
+        sched_yield();
+
+    check_collect(heap);
+    check(load(&died) == 0);
+    __atomic_store_n(&h.state,4,__ATOMIC_RELEASE);
+    pthread_join(thread,null);
+
+    gc_heap_set_conservative(heap,false);
+    check_collect(heap);
+    check(load(&died) == 1);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    check_self(false);
+    check_self(true);
+    check_parked(false);
+    check_parked(true);
+    return check_status();
+}
@@ -0,0 +1,181 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// pause histogram buckets and percentiles of gc_heap_get_stats and json gc_stats_json writes
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+static gc_stats stats;
+static gc_stats prev;
+
+// histogram bucket pause of given duration was counted into
+static uint32_t pause_bucket(gc_heap* heap, uint64_t duration){
+    gc_heap_get_stats(heap,&prev);
+    gc_stats_pause(heap,duration);
+    gc_heap_get_stats(heap,&stats);
+    uint32_t bucket = GC_STATS_PAUSE_BUCKETS;
+    for(uint32_t i = 0; i < GC_STATS_PAUSE_BUCKETS; ++i){
+        if(stats.pause_histogram[i] == prev.pause_histogram[i])
+            continue;
+        check(bucket == GC_STATS_PAUSE_BUCKETS && stats.pause_histogram[i] == prev.pause_histogram[i] + 1);
+        bucket = i;
+    }
+    check(bucket < GC_STATS_PAUSE_BUCKETS);
+    return bucket;
+}
+
+// bucket holds durations from limit of previous one up to it's own limit
+static void check_bucket(gc_heap* heap, uint64_t duration){
+    uint32_t bucket = pause_bucket(heap,duration);
+    if(bucket == GC_STATS_PAUSE_BUCKETS)
+        return;
+    check(duration < gc_stats_pause_limit(bucket) || bucket == GC_STATS_PAUSE_BUCKETS-1);
+    check(bucket == 0 || duration >= gc_stats_pause_limit(bucket-1));
+}
+
+static void check_buckets(){
+    gc_heap* heap = check_heap_create(1,CHECK_INCREMENTAL);
+    // durations below 4 get bucket each, powers of two above are split into four
+    for(uint64_t d = 0; d < 4; ++d)
+        check(pause_bucket(heap,d) == d);
+    check(pause_bucket(heap,4) == 4);
+    check(pause_bucket(heap,5) == 5);
+    check(pause_bucket(heap,7) == 7);
+    check(pause_bucket(heap,8) == 8);
+    check(pause_bucket(heap,9) == 8);
+    check(pause_bucket(heap,10) == 9);
+    check(gc_stats_pause_limit(3) == 4 && gc_stats_pause_limit(4) == 5 && gc_stats_pause_limit(7) == 8);
+    // longest durations fall into last bucket, which has no limit
+    check(pause_bucket(heap,UINT64_MAX) == GC_STATS_PAUSE_BUCKETS-1);
+    check(pause_bucket(heap,1ull << 63) == GC_STATS_PAUSE_BUCKETS-4);
+    check(gc_stats_pause_limit(GC_STATS_PAUSE_BUCKETS-1) == UINT64_MAX);
+    check(gc_stats_pause_limit(GC_STATS_PAUSE_BUCKETS-2) < UINT64_MAX);
+    // every bucket edge and durations right around it
+    for(uint32_t i = 0; i < GC_STATS_PAUSE_BUCKETS-1; ++i){
+        uint64_t limit = gc_stats_pause_limit(i);
+        check(i == 0 || limit > gc_stats_pause_limit(i-1));
+        check_bucket(heap,limit-1);
+        check_bucket(heap,limit);
+        check_bucket(heap,limit+1);
+    }
+    for(uint64_t d = 0; d < 5000; ++d)
+        check_bucket(heap,d);
+    gc_heap_destroy(heap);
+}
+
+// percentiles are upper bounds of buckets ranked pause falls into, bounded by longest pause
+static void check_percentiles(){
+    gc_heap* heap = check_heap_create(1,CHECK_INCREMENTAL);
+    for(uint32_t i = 0; i < 98; ++i)
+        gc_stats_pause(heap,5);
+    gc_stats_pause(heap,1000);
+    gc_stats_pause(heap,100000);
+    gc_heap_get_stats(heap,&stats);
+    check(stats.pauses == 100);
+    check(stats.pause_time == 98*5 + 1000 + 100000);
+    check(stats.pause_max == 100000);
+    check(stats.pause_p50 == 5);
+    // 1000 is counted into bucket of 896 to 1023
+    check(stats.pause_p99 == 1023);
+    gc_heap_destroy(heap);
+
+    heap = check_heap_create(1,CHECK_INCREMENTAL);
+    for(uint32_t i = 0; i < 10; ++i)
+        gc_stats_pause(heap,1000);
+    gc_heap_get_stats(heap,&stats);
+    check(stats.pause_p50 == 1000 && stats.pause_p99 == 1000);
+    gc_heap_destroy(heap);
+
+    // empty histogram
+    heap = check_heap_create(1,CHECK_INCREMENTAL);
+    gc_heap_get_stats(heap,&stats);
+    check(stats.pauses == 0 && stats.pause_p50 == 0 && stats.pause_p99 == 0 && stats.pause_max == 0);
+    gc_heap_destroy(heap);
+}
+
+// json is valid and truncated one keeps length of whole json
+static void check_json_stats(check_mode mode){
+    gc_heap* heap = check_heap_create(3,mode);
+    gc_object* root = check_alloc(heap,100);
+    gc_heap_add_root(heap,root);
+    for(uint32_t i = 0; i < 1000; ++i){
+        gc_object* obj = check_alloc(heap,i % 10);
+        if(i % 10 == 0)
+            gc_heap_set_ref(heap,root,i/10,obj);
+    }
+    for(uint32_t i = 0; i < 4; ++i)
+        check_collect(heap);
+    gc_heap_get_stats(heap,&stats);
+    check(stats.cycles >= 4 && stats.pauses > 0);
+    check(stats.allocated_objects == 1001);
+    check(stats.collected_objects == 900);
+    check(stats.gens_count == 3);
+    check(stats.gen_objects[0] + stats.gen_objects[1] + stats.gen_objects[2] == 101);
+
+    char json[16384];
+    size_t len = gc_stats_json(&stats,json,sizeof(json));
+    check(len == strlen(json) && len < sizeof(json));
+    check(check_json(json));
+    check(strstr(json,"\"allocated_objects\":1001,") != null);
+    check(strstr(json,"\"generations\":[{") != null);
+    check(gc_stats_json(&stats,null,0) == len);
+    char buf[16384];
+    size_t sizes[] = { 1, 2, 10, len/2, len, len+1 };
+    for(uint32_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i){
+        memset(buf,'x',sizeof(buf));
+        check(gc_stats_json(&stats,buf,sizes[i]) == len);
+        size_t written = sizes[i] - 1 < len ? sizes[i] - 1 : len;
+        check(strlen(buf) == written && strncmp(buf,json,written) == 0);
+        check(buf[sizes[i]] == 'x');
+    }
+    gc_heap_destroy(heap);
+
+    // histogram lists non empty buckets as limit and count pairs
+    heap = check_heap_create(1,CHECK_INCREMENTAL);
+    for(uint32_t i = 0; i < 3; ++i)
+        gc_stats_pause(heap,5);
+    gc_stats_pause(heap,UINT64_MAX);
+    gc_heap_get_stats(heap,&stats);
+    len = gc_stats_json(&stats,json,sizeof(json));
+    check(check_json(json));
+    char histogram[128];
+    snprintf(histogram,sizeof(histogram),"\"pause_histogram\":[[6,3],[%" PRIu64 ",1]]",UINT64_MAX);
+    check(strstr(json,histogram) != null);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    check_buckets();
+    check_percentiles();
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_json_stats(mode);
+    // json checker itself
+    check(check_json("{\"a\":[1,-2.5e3,\"x\\\"\",true,null,{}]}") && !check_json("{\"a\":[1,]}") && !check_json("{\"a\":1") &&
+          !check_json("[1] 2"));
+    return check_status();
+}
@@ -0,0 +1,107 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// adaptive tenuring refreshes mostly dying generations more often and keeps their objects longer, mostly
+// surviving ones the other way round, oldest generation growing faster than max_growth delays tenuring into it
+
+#include <stdint.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+#define OBJECTS 1000
+#define REFRESH_INTERVAL 1000000
+
+// heap where cycle is done in single gc call, adaptation starts from REFRESH_INTERVAL of every generation
+static gc_heap* tenure_heap_create(uint8_t gens_count, uint64_t max_growth){
+    gc_heap* heap = check_heap_create(gens_count,CHECK_INCREMENTAL);
+    gc_config* config = gc_heap_get_config(heap);
+    config->max_pause = 1000000000;
+    for(uint8_t i = 0; i < gens_count; ++i)
+        config->gens[i].refresh_interval = REFRESH_INTERVAL;
+    gc_heap_set_tenuring(heap,true,max_growth);
+    return heap;
+}
+
+// full cycle that refreshes every generation regardless of it's refresh interval
+static void tenure_collect(gc_heap* heap){
+    gc_config* config = gc_heap_get_config(heap);
+    for(uint8_t i = 0; i < config->gens_count; ++i)
+        config->gens[i].refresh_time = 0;
+    check_collect(heap);
+}
+
+// objects survive one refresh of young generation, then all but survivors of each hundred die
+static void check_survival(uint32_t survivors){
+    gc_heap* heap = tenure_heap_create(2,0);
+    gc_config* config = gc_heap_get_config(heap);
+    gc_object* holder = check_alloc(heap,OBJECTS);
+    gc_heap_add_root(heap,holder);
+    for(uint32_t i = 0; i < OBJECTS; ++i)
+        gc_heap_set_ref(heap,holder,i,check_alloc(heap,0));
+    tenure_collect(heap);
+    check(config->gens[0].refresh_interval == REFRESH_INTERVAL);
+    check(config->gens[0].tenure_age == GC_TENURE_INITIAL_AGE);
+    for(uint32_t i = 0; i < OBJECTS; ++i){
+        if(i % 100 >= survivors)
+            gc_heap_set_ref(heap,holder,i,null);
+    }
+    tenure_collect(heap);
+    if(survivors > GC_TENURE_HIGH_SURVIVAL){
+        check(config->gens[0].refresh_interval > REFRESH_INTERVAL);
+        check(config->gens[0].tenure_age < GC_TENURE_INITIAL_AGE);
+    }else{
+        check(config->gens[0].refresh_interval < REFRESH_INTERVAL);
+        check(config->gens[0].tenure_age > GC_TENURE_INITIAL_AGE);
+    }
+    // oldest generation promotes nowhere
+    check(config->gens[1].tenure_age == GC_TENURE_INITIAL_AGE);
+    gc_heap_destroy(heap);
+}
+
+// oldest generation grew by OBJECTS during last second, generation before it mostly survives and would tenure
+// sooner if growth is within max_growth, otherwise it tenures later
+static void check_growth(uint64_t max_growth){
+    gc_heap* heap = tenure_heap_create(3,max_growth);
+    gc_config* config = gc_heap_get_config(heap);
+    config->gens[1].tenure_refreshed = OBJECTS;
+    config->gens[1].tenure_died = 0;
+    heap->tenure_growth = OBJECTS;
+    heap->tenure_time = get_nanotime() - 1000000000;
+    gc_heap_tenure_adapt(heap);
+    if(max_growth != 0 && max_growth < OBJECTS)
+        check(config->gens[1].tenure_age == GC_TENURE_INITIAL_AGE+1);
+    else
+        check(config->gens[1].tenure_age == GC_TENURE_INITIAL_AGE-1);
+    check(config->gens[0].tenure_age == GC_TENURE_INITIAL_AGE);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    check_survival(5);
+    check_survival(100);
+    check_growth(0);
+    check_growth(OBJECTS*2);
+    check_growth(OBJECTS/10);
+    return check_status();
+}
@@ -0,0 +1,218 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// gc_trace_flush writes chrome trace event json where every begin has matching end on same thread,
+// ring keeps newest events once it overflows and can't be resized once it's allocated
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+#ifdef GC_TRACE
+
+#define RING_EVENTS 4096
+
+// events of flushed trace
+#define EVENTS_MAX (RING_EVENTS*2)
+typedef struct {
+    char name[32];
+    char ph;
+    uint64_t ts; // nanoseconds
+    uint32_t tid;
+    uint64_t heap;
+} trace_event;
+
+static trace_event events[EVENTS_MAX];
+static uint32_t events_count;
+static char trace[EVENTS_MAX*256];
+static char trace_path[] = "/tmp/gccheck_trace_XXXXXX";
+
+// flush trace and read it's events back
+static void flush(){
+    check(gc_trace_flush(trace_path));
+    FILE* f = fopen(trace_path,"r");
+    if(f == null){
+        perror(trace_path);
+        exit(2);
+    }
+    size_t len = fread(trace,1,sizeof(trace)-1,f);
+    trace[len] = '\0';
+    fclose(f);
+    check(len < sizeof(trace)-1);
+    check(check_json(trace));
+    check(strncmp(trace,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[",39) == 0);
+    events_count = 0;
+    // each event is written on line of it's own
+    for(char* line = strchr(trace,'\n'); line != null; line = strchr(line+1,'\n')){
+        trace_event* e = &events[events_count];
+        uint64_t us;
+        uint32_t frac;
+        int pid;
+        if(sscanf(line+1,"{\"name\":\"%31[^\"]\",\"cat\":\"gc\",\"ph\":\"%c\",\"ts\":%" SCNu64 ".%u,\"pid\":%d,\"tid\":%u,",
+                  e->name,&e->ph,&us,&frac,&pid,&e->tid) != 6)
+            continue;
+        check(pid == (int)getpid());
+        char* heap = strstr(line+1,"\"heap\":\"");
+        check(heap != null && sscanf(heap,"\"heap\":\"%" SCNx64 "\"",&e->heap) == 1);
+        e->ts = us*1000 + frac;
+        if(events_count == EVENTS_MAX){
+            check(events_count < EVENTS_MAX);
+            break;
+        }
+        events_count += 1;
+    }
+}
+
+// every pause and phase begin is followed by it's end on same thread, phases nest inside pauses
+// counts pauses and full cycles traced and sweeps inside and outside of pauses
+static void check_balanced(gc_heap* heap, uint32_t* pauses, uint32_t* cycles, uint32_t sweeps[2]){
+    uint32_t tids[8], depth[8], tids_count = 0;
+    const char* open[8][8];
+    uint64_t last_ts[8];
+    for(uint32_t i = 0; i < events_count; ++i){
+        trace_event* e = &events[i];
+        check(e->heap == (uintptr_t)heap);
+        if(e->ph == 'i'){
+            check(strcmp(e->name,"full cycle") == 0);
+            *cycles += 1;
+            continue;
+        }
+        uint32_t t = 0;
+        while(t < tids_count && tids[t] != e->tid)
+            t += 1;
+        if(t == tids_count){
+            if(tids_count == 8){
+                check(tids_count < 8);
+                return;
+            }
+            tids[tids_count] = e->tid;
+            depth[tids_count] = 0;
+            last_ts[tids_count] = 0;
+            tids_count += 1;
+        }
+        check(e->ts >= last_ts[t]);
+        last_ts[t] = e->ts;
+        if(e->ph == 'B'){
+            // phase doesn't begin while another one of same thread is running
+            check(depth[t] == 0 || (depth[t] == 1 && strcmp(open[t][0],"pause") == 0 && strcmp(e->name,"pause") != 0));
+            if(depth[t] < 8)
+                open[t][depth[t]++] = e->name;
+            *pauses += strcmp(e->name,"pause") == 0 ? 1 : 0;
+            if(strcmp(e->name,"sweep") == 0)
+                sweeps[depth[t] == 2 ? 0 : 1] += 1;
+        }else{
+            check(e->ph == 'E');
+            check(depth[t] > 0 && strcmp(open[t][depth[t]-1],e->name) == 0);
+            if(depth[t] > 0)
+                depth[t] -= 1;
+        }
+    }
+    for(uint32_t t = 0; t < tids_count; ++t)
+        check(depth[t] == 0);
+}
+
+static void check_trace(check_mode mode){
+    gc_heap* heap = check_heap_create(2,mode);
+    gc_object* root = check_alloc(heap,100);
+    gc_heap_add_root(heap,root);
+    for(uint32_t i = 0; i < 1000; ++i){
+        gc_object* obj = check_alloc(heap,1);
+        if(i % 10 == 0)
+            gc_heap_set_ref(heap,root,i/10,obj);
+    }
+    // events of other tests are dropped
+    flush();
+    // trace is flushed after every gc call so ring doesn't overflow in cycles of tiny pauses, collector
+    // is done with cycle once gc call returns
+    uint32_t calls = 0, pauses = 0, cycles = 0, sweeps[2] = { 0, 0 };
+    for(uint32_t i = 0; i < 2; ++i){
+        do{
+            gc_heap_collect(heap);
+            calls += 1;
+            flush();
+            check(events_count > 0 && events_count < RING_EVENTS);
+            check_balanced(heap,&pauses,&cycles,sweeps);
+        }while(!gc_heap_get_config(heap)->cycle_full);
+    }
+    check(mode == CHECK_INCREMENTAL ? pauses == calls : pauses > calls);
+    check(cycles == 2);
+    // background collector sweeps while mutators run
+    check(mode == CHECK_INCREMENTAL ? sweeps[0] > 0 && sweeps[1] == 0 : sweeps[0] == 0 && sweeps[1] > 0);
+    // flushed events are dropped from ring
+    flush();
+    check(events_count == 0);
+
+    // disabled tracing doesn't emit events
+    check(gc_set_trace(false,0));
+    check_collect(heap);
+    flush();
+    check(events_count == 0);
+    check(gc_set_trace(true,0));
+    gc_heap_destroy(heap);
+}
+
+// ring keeps newest events and drops oldest ones
+static void check_overflow(){
+    static char heaps[RING_EVENTS+100];
+    flush();
+    for(uint32_t i = 0; i < RING_EVENTS+100; ++i)
+        gc_trace_cycle((gc_heap*)&heaps[i]);
+    flush();
+    check(events_count == RING_EVENTS);
+    for(uint32_t i = 0; i < events_count; ++i)
+        check(events[i].heap == (uintptr_t)&heaps[100+i] && events[i].ph == 'i');
+}
+
+#endif
+
+int main(int argc, char** argv){
+#ifdef GC_TRACE
+    int fd = mkstemp(trace_path);
+    if(fd < 0){
+        perror("mkstemp");
+        return 2;
+    }
+    close(fd);
+    check(gc_set_trace(true,RING_EVENTS-1));
+    // ring isn't resized, same size or default keeps it
+    errno = 0;
+    check(!gc_set_trace(true,RING_EVENTS*2) && errno == EBUSY);
+    check(gc_set_trace(true,RING_EVENTS));
+    check(gc_set_trace(true,0));
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode)
+        check_trace(mode);
+    check_overflow();
+    unlink(trace_path);
+#else
+    // tracing isn't compiled in
+    errno = 0;
+    check(!gc_set_trace(true,0) && errno == ENOTSUP);
+    check(!gc_trace_flush("/dev/null") && errno == ENOTSUP);
+#endif
+    return check_status();
+}
@@ -0,0 +1,247 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// weak objects and weak tables don't keep objects alive, weak table pair goes away with it's key and
+// gc_get_weak keeps object read during background marking alive
+
+#include <pthread.h>
+#include <stdint.h>
+#include "gccheck.h"
+#include "gc_internal.h"
+
+// objects expected to live count their finalizers same as ones expected to die
+static uint32_t lived = 0;
+
+static void lived_finalize(gc_object* obj){
+    __atomic_add_fetch(&lived,1,__ATOMIC_RELAXED);
+}
+
+static gc_object_class lived_cls = { &gc_object_mark_black, &gc_object_contains, &lived_finalize, 0, null };
+
+static gc_object* alloc_lived(gc_heap* heap, uint32_t refs_count){
+    gc_object* obj = gc_heap_alloc(heap,refs_count);
+    obj->class = &lived_cls;
+    return obj;
+}
+
+// weak reference reads null once object it points to died, live objects are still read
+static void check_weak(check_mode mode){
+    gc_heap* heap = check_heap_create(1,mode);
+    died = lived = 0;
+    gc_object* weak = gc_heap_alloc_weak(heap,3);
+    weak->class = &lived_cls;
+    gc_heap_add_root(heap,weak);
+    gc_object* target = alloc_died(heap,1);
+    gc_object* kept = alloc_lived(heap,0);
+    gc_heap_add_root(heap,kept);
+    gc_heap_set_ref(heap,weak,0,target);
+    gc_heap_set_ref(heap,weak,1,kept);
+    // target references kept object, that's not reason for either to die or live
+    gc_heap_set_ref(heap,target,0,kept);
+    check(gc_heap_get_weak(heap,weak,0) == target);
+
+    check_collect(heap);
+    check(gc_heap_get_weak(heap,weak,0) == null);
+    check(gc_heap_get_weak(heap,weak,1) == kept);
+    check(gc_heap_get_weak(heap,weak,2) == null);
+    check(load(&died) == 1);
+    check(load(&lived) == 0);
+
+    // object dies once it's last strong reference is gone
+    gc_heap_remove_root(heap,kept);
+    kept->class = &died_cls;
+    check_collect(heap);
+    check(gc_heap_get_weak(heap,weak,1) == null);
+    check(load(&died) == 2);
+    check(load(&lived) == 0);
+    gc_heap_destroy(heap);
+}
+
+// weak table pair with dead key is cleared whole, value reachable only through it's own key dies with it
+// while value of live key is kept alive and might keep keys of other pairs alive in turn
+static void check_weak_table(check_mode mode){
+    gc_heap* heap = check_heap_create(1,mode);
+    died = lived = 0;
+    gc_object* table = gc_heap_alloc_weak_table(heap,5);
+    table->class = &lived_cls;
+    gc_heap_add_root(heap,table);
+    gc_object* holder = alloc_lived(heap,4);
+    gc_heap_add_root(heap,holder);
+
+    // pair 0: dead key, value held strongly elsewhere, whole pair is cleared and value lives
+    gc_object* key0 = alloc_died(heap,0);
+    gc_object* value0 = alloc_lived(heap,0);
+    gc_heap_set_ref(heap,holder,0,value0);
+    gc_heap_set_ref(heap,table,0,key0);
+    gc_heap_set_ref(heap,table,1,value0);
+
+    // pair 1: value references it's own key and nothing else does, both die
+    gc_object* key1 = alloc_died(heap,0);
+    gc_object* value1 = alloc_died(heap,1);
+    gc_heap_set_ref(heap,value1,0,key1);
+    gc_heap_set_ref(heap,table,2,key1);
+    gc_heap_set_ref(heap,table,3,value1);
+
+    // pair 2: live key keeps it's value alive
+    gc_object* key2 = alloc_lived(heap,0);
+    gc_object* value2 = alloc_lived(heap,1);
+    gc_heap_set_ref(heap,holder,1,key2);
+    gc_heap_set_ref(heap,table,4,key2);
+    gc_heap_set_ref(heap,table,5,value2);
+
+    // pair 3: key is alive only through value of pair 2, so it's value lives too, table visits repeat
+    // until nothing more is marked
+    gc_object* key3 = alloc_lived(heap,0);
+    gc_object* value3 = alloc_lived(heap,0);
+    gc_heap_set_ref(heap,value2,0,key3);
+    gc_heap_set_ref(heap,table,6,key3);
+    gc_heap_set_ref(heap,table,7,value3);
+
+    // pair 4: two pairs referencing each others keys through values only, both die
+    gc_object* key4 = alloc_died(heap,0);
+    gc_object* value4 = alloc_died(heap,1);
+    gc_object* cycle_key = alloc_died(heap,0);
+    gc_object* cycle_value = alloc_died(heap,1);
+    gc_heap_set_ref(heap,value4,0,cycle_key);
+    gc_heap_set_ref(heap,cycle_value,0,key4);
+    gc_heap_set_ref(heap,table,8,key4);
+    gc_heap_set_ref(heap,table,9,value4);
+    gc_object* other = gc_heap_alloc_weak_table(heap,1);
+    other->class = &lived_cls;
+    gc_heap_add_root(heap,other);
+    gc_heap_set_ref(heap,other,0,cycle_key);
+    gc_heap_set_ref(heap,other,1,cycle_value);
+
+    check_collect(heap);
+    check(gc_heap_get_weak(heap,table,0) == null);
+    check(gc_heap_get_weak(heap,table,1) == null);
+    check(gc_heap_get_weak(heap,table,2) == null);
+    check(gc_heap_get_weak(heap,table,3) == null);
+    check(gc_heap_get_weak(heap,table,4) == key2);
+    check(gc_heap_get_weak(heap,table,5) == value2);
+    check(gc_heap_get_weak(heap,table,6) == key3);
+    check(gc_heap_get_weak(heap,table,7) == value3);
+    check(gc_heap_get_weak(heap,table,8) == null);
+    check(gc_heap_get_weak(heap,table,9) == null);
+    check(gc_heap_get_weak(heap,other,0) == null);
+    check(gc_heap_get_weak(heap,other,1) == null);
+    check(gc_heap_contains(heap,value0));
+    check(load(&died) == 7);
+    check(load(&lived) == 0);
+
+    // pair 3 goes away once pair 2 value stops referencing it's key
+    gc_heap_set_ref(heap,value2,0,null);
+    key3->class = &died_cls;
+    value3->class = &died_cls;
+    check_collect(heap);
+    check(gc_heap_get_weak(heap,table,4) == key2);
+    check(gc_heap_get_weak(heap,table,6) == null);
+    check(gc_heap_get_weak(heap,table,7) == null);
+    check(load(&died) == 9);
+    check(load(&lived) == 0);
+    gc_heap_destroy(heap);
+}
+
+// marking of armed gate object holds collector in the middle of background marking until test lets it go
+static uint32_t gate_armed = 0;
+static uint32_t gate_entered = 0;
+static uint32_t gate_released = 0;
+
+static void gate_mark_black(gc_object* obj){
+    if(!__atomic_load_n(&gate_armed,__ATOMIC_ACQUIRE)){
+        gc_object_mark_black(obj);
+        return;
+    }
+    __atomic_store_n(&gate_entered,1,__ATOMIC_RELEASE);
+    while(!__atomic_load_n(&gate_released,__ATOMIC_ACQUIRE))
+        ;
+    gc_object_mark_black(obj);
+}
+
+static gc_object_class gate_cls = { &gate_mark_black, &gc_object_contains, &lived_finalize, 0, null };
+
+// object reachable only through weak reference is kept alive once it's read during background marking,
+// even when it's stored into object marked already
+#define SHADE_TARGETS 64
+static void check_weak_shade(){
+    gc_heap* heap = check_heap_create(1,CHECK_CONCURRENT);
+    died = lived = 0;
+    // holder is marked before gate it references
+    gc_object* holder = alloc_lived(heap,SHADE_TARGETS+1);
+    gc_heap_add_root(heap,holder);
+    gc_object* gate = gc_heap_alloc(heap,0);
+    gate->class = &gate_cls;
+    gc_heap_set_ref(heap,holder,SHADE_TARGETS,gate);
+    gc_object* weak = gc_heap_alloc_weak(heap,SHADE_TARGETS);
+    weak->class = &lived_cls;
+    gc_heap_add_root(heap,weak);
+    gc_object* targets[SHADE_TARGETS];
+    for(uint32_t i = 0; i < SHADE_TARGETS; ++i){
+        targets[i] = alloc_lived(heap,0);
+        gc_heap_add_root(heap,targets[i]);
+        gc_heap_set_ref(heap,weak,i,targets[i]);
+    }
+    // objects get published to heap by cycle, afterwards targets are reachable only through weak references
+    check_collect(heap);
+    for(uint32_t i = 0; i < SHADE_TARGETS; ++i)
+        gc_heap_remove_root(heap,targets[i]);
+    __atomic_store_n(&gate_armed,1,__ATOMIC_RELEASE);
+
+    // thread parks at safepoints until collector marks gate, then weak references are read while collector
+    // waits for gate, thread isn't at safepoint meanwhile so cycle can't get past marking
+    pthread_t collect;
+    pthread_create(&collect,null,(void*(*)(void*))&gc_heap_collect,heap);
+    while(!__atomic_load_n(&gate_entered,__ATOMIC_ACQUIRE))
+        gc_heap_safepoint(heap);
+    check(__atomic_load_n(&heap->marking,__ATOMIC_RELAXED));
+    for(uint32_t i = 0; i < SHADE_TARGETS; ++i){
+        gc_object* target = gc_heap_get_weak(heap,weak,i);
+        check(target != null);
+        gc_heap_set_ref(heap,holder,i,target);
+    }
+    __atomic_store_n(&gate_released,1,__ATOMIC_RELEASE);
+    // final pause of cycle doesn't wait for thread waiting inside safe region
+    gc_heap_safe_region_enter(heap);
+    pthread_join(collect,null);
+    gc_heap_safe_region_leave(heap);
+
+    check_collect(heap);
+    for(uint32_t i = 0; i < SHADE_TARGETS; ++i){
+        gc_object* target = gc_heap_get_weak(heap,weak,i);
+        check(target != null && target == ((gc_object**)(holder+1))[i]);
+        check(gc_heap_contains(heap,target));
+    }
+    check(load(&died) == 0);
+    check(load(&lived) == 0);
+    gc_heap_destroy(heap);
+}
+
+int main(int argc, char** argv){
+    for(check_mode mode = CHECK_INCREMENTAL; mode <= CHECK_CONCURRENT; ++mode){
+        check_weak(mode);
+        check_weak_table(mode);
+    }
+    check_weak_shade();
+    return check_status();
+}
@@ -23,6 +23,7 @@ THE SOFTWARE.
 */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 #include <time.h>
@@ -97,6 +98,19 @@ void initialize_gc(){
     config.pause_threshold = 100; // 100 objects
     config.max_pause = 200000000; // 200 milliseconds
     gc_init(&config);
+    // optionally mark with multiple threads
+    char* mark_threads = getenv("GCTEST_MARK_THREADS");
+    if(mark_threads != null)
+        gc_set_mark_threads(atoi(mark_threads));
+    // optionally free garbage on background thread
+    char* sweeper = getenv("GCTEST_SWEEPER");
+    if(sweeper != null)
+        gc_set_sweeper(true,atoi(sweeper),GC_SWEEP_BLOCK);
+    // optionally collect on background thread
+    if(getenv("GCTEST_CONCURRENT") != null){
+        gc_thread_attach();
+        gc_set_concurrent(true,0);
+    }
 }
 
 void survivors_finalize(gc_object* obj){
@@ -140,6 +154,8 @@ void end(){
 
     array_free(all_objects);
     array_free(objects);
+    // garbage handed over to background sweeper has to be finalized before survivors are counted
+    gc_set_sweeper(false,0,GC_SWEEP_BLOCK);
     // register new finalizer for survivors counting
     cls.gc_finalize = &survivors_finalize;
     gc_destroy();
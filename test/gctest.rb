@@ -250,7 +250,7 @@ class GCTest
             @testcode << "#{t}();\n"
             @testfuns << "void #{t}();\n"
         end
-        gcobj = "../build/src/CMakeFiles/simplegc.dir/gc.c.o"
+        gclib = "../build/src/libgc.a"
         s = ""
         s << "
             #{include}
@@ -280,7 +280,7 @@ class GCTest
         lds = tests.map {|t| t+".o "}.join
         system("gcc -std=gnu99 -O2 -I../include -Wall -g -c ./gctest.c")
         system("gcc -std=gnu99 -O2 -I../include -Wall -g -c ./gctestmain.c")
-        system("gcc -lrt -o gctest #{gcobj} ./gctest.o ./gctestmain.o #{lds}")
+        system("gcc -o gctest ./gctest.o ./gctestmain.o #{lds} #{gclib} -lrt -lpthread")
         system("./gctest")
 
         File.delete("gctest.o")
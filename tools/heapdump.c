@@ -0,0 +1,615 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Dmitry "troydm" Geurkov (d.geurkov@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// heap dump analyzer
+// loads dump written by gc_dump through mmap and computes dominator tree of objects reachable from roots,
+// object dominates another one if every path from roots to it goes through it, so it retains memory of all
+// objects it dominates, weak objects and weak tables don't retain objects they reference
+// reports retained size by class, each object counted once, and largest dominator trees
+// usage: simplegc_heapdump [-n count] [-d depth] [-c children] [-b] dump
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gc.h"
+
+// no node
+#define HEAPDUMP_NONE UINT32_MAX
+// default number of classes and dominator trees listed
+#define HEAPDUMP_TOP 20
+// default depth dominator trees are listed to
+#define HEAPDUMP_DEPTH 4
+// default number of children listed per dominator tree node
+#define HEAPDUMP_CHILDREN 5
+
+// loaded dump, nodes are numbered in depth first order from virtual root 0 referencing every root object,
+// objects unreachable from roots are numbered after reachable ones
+typedef struct {
+    const char* data; // mapped dump
+    size_t size;
+    const gc_dump_header* header;
+    bool truncated; // dump ends before it's end record
+    uint32_t count; // number of nodes, virtual root included
+    const gc_dump_object** objects; // object record of each node, null for virtual root
+    uint32_t reachable; // number of nodes reachable from virtual root
+    uint32_t* idom; // immediate dominator of reachable node
+    uint64_t* retained; // bytes retained by reachable node, it's own included
+    uint64_t* child_start; // children of reachable node in dominator tree
+    uint32_t* child;
+    uint32_t* class_of; // class of node
+    uint32_t classes_count;
+    uint64_t* class_address;
+    uint64_t* class_objects;
+    uint64_t* class_bytes;
+    uint64_t* class_retained; // bytes retained by objects of class not dominated by other objects of it
+} heapdump;
+
+// address hash table, maps address to index of record with it
+typedef struct {
+    uint32_t* slots; // index + 1, 0 if empty
+    uint32_t shift;
+    uint64_t mask;
+} heapdump_index;
+
+static void* heapdump_alloc(size_t count, size_t size){
+    void* p = calloc(count == 0 ? 1 : count,size);
+    if(p == NULL){
+        fprintf(stderr,"out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static inline uint64_t heapdump_hash(uint64_t address){
+    return (address >> 3) * 0x9E3779B97F4A7C15ull;
+}
+
+// create index with room for given number of addresses
+static void heapdump_index_init(heapdump_index* x, uint64_t count){
+    uint32_t bits = 4;
+    while((1ull << bits) < count*2)
+        bits += 1;
+    x->slots = (uint32_t*)heapdump_alloc(1ull << bits,sizeof(uint32_t));
+    x->shift = 64 - bits;
+    x->mask = (1ull << bits) - 1;
+}
+
+// find index of address, adds it with given index if it isn't there yet
+static uint32_t heapdump_index_find(heapdump_index* x, const uint64_t* addresses, uint64_t address, uint32_t add){
+    for(uint64_t i = heapdump_hash(address) >> x->shift;; i = (i+1) & x->mask){
+        if(x->slots[i] == 0){
+            if(add != HEAPDUMP_NONE)
+                x->slots[i] = add + 1;
+            return add;
+        }
+        if(addresses[x->slots[i]-1] == address)
+            return x->slots[i]-1;
+    }
+}
+
+// references of object record
+static inline const uint64_t* heapdump_refs(const gc_dump_object* o){
+    return (const uint64_t*)(o+1);
+}
+
+// map dump and index it's object records, records[0] is left for virtual root
+static bool heapdump_map(heapdump* d, const char* path){
+    int fd = open(path,O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd,&st) != 0){
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        close(fd);
+        return false;
+    }
+    d->size = st.st_size;
+    if(d->size < sizeof(gc_dump_header)){
+        fprintf(stderr,"%s: not a heap dump\n",path);
+        close(fd);
+        return false;
+    }
+    d->data = (const char*)mmap(NULL,d->size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(d->data == MAP_FAILED){
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    d->header = (const gc_dump_header*)d->data;
+    if(memcmp(d->header->magic,GC_DUMP_MAGIC,sizeof(GC_DUMP_MAGIC)) != 0 || d->header->version != GC_DUMP_VERSION){
+        fprintf(stderr,"%s: not a heap dump of version %d\n",path,GC_DUMP_VERSION);
+        return false;
+    }
+    madvise((void*)d->data,d->size,MADV_SEQUENTIAL);
+    uint64_t size = 1024;
+    d->objects = (const gc_dump_object**)heapdump_alloc(size,sizeof(gc_dump_object*));
+    d->count = 1;
+    d->truncated = true;
+    size_t offset = sizeof(gc_dump_header);
+    while(offset + sizeof(gc_dump_end) <= d->size){
+        uint8_t kind = (uint8_t)d->data[offset];
+        if(kind == GC_DUMP_END){
+            d->truncated = ((const gc_dump_end*)(d->data+offset))->objects != d->count-1;
+            break;
+        }
+        const gc_dump_object* o = (const gc_dump_object*)(d->data+offset);
+        if(kind != GC_DUMP_OBJECT || offset + sizeof(gc_dump_object) > d->size ||
+           o->refs_count > (d->size - offset - sizeof(gc_dump_object))/sizeof(uint64_t)){
+            if(kind != GC_DUMP_OBJECT)
+                fprintf(stderr,"%s: unknown record at %zu\n",path,offset);
+            break;
+        }
+        if(d->count == HEAPDUMP_NONE-1){
+            fprintf(stderr,"%s: too many objects\n",path);
+            return false;
+        }
+        if(d->count == size){
+            size *= 2;
+            d->objects = (const gc_dump_object**)realloc(d->objects,size*sizeof(gc_dump_object*));
+            if(d->objects == NULL){
+                fprintf(stderr,"out of memory\n");
+                exit(1);
+            }
+        }
+        d->objects[d->count++] = o;
+        offset += sizeof(gc_dump_object) + o->refs_count*sizeof(uint64_t);
+    }
+    if(d->truncated)
+        fprintf(stderr,"%s: dump is truncated, analyzing %" PRIu32 " objects it holds\n",path,d->count-1);
+    madvise((void*)d->data,d->size,MADV_RANDOM);
+    return true;
+}
+
+// find dominator of every object reachable from roots with Lengauer-Tarjan algorithm, nodes are renumbered
+// in depth first order, immediate dominator of node always comes before it then
+static void heapdump_dominators(heapdump* d){
+    uint32_t n = d->count;
+    // index of every object by address
+    uint64_t* addresses = (uint64_t*)heapdump_alloc(n,sizeof(uint64_t));
+    heapdump_index index;
+    heapdump_index_init(&index,n);
+    for(uint32_t i = 1; i < n; ++i){
+        addresses[i] = d->objects[i]->address;
+        heapdump_index_find(&index,addresses,addresses[i],i);
+    }
+    // references between dumped objects, virtual root references every root, weak references are left out
+    uint64_t edges = 0;
+    for(uint32_t i = 1; i < n; ++i)
+        edges += (d->objects[i]->roots > 0 ? 1 : 0) + (d->objects[i]->flags ? 0 : d->objects[i]->refs_count);
+    uint64_t* succ_start = (uint64_t*)heapdump_alloc(n+1,sizeof(uint64_t));
+    uint32_t* succ = (uint32_t*)heapdump_alloc(edges,sizeof(uint32_t));
+    uint32_t* in = (uint32_t*)heapdump_alloc(n,sizeof(uint32_t));
+    edges = 0;
+    for(uint32_t i = 1; i < n; ++i){
+        if(d->objects[i]->roots > 0)
+            succ[edges++] = i;
+    }
+    for(uint32_t i = 1; i < n; ++i){
+        succ_start[i] = edges;
+        const gc_dump_object* o = d->objects[i];
+        if(o->flags != 0)
+            continue;
+        const uint64_t* refs = heapdump_refs(o);
+        for(uint64_t j = 0; j < o->refs_count; ++j){
+            // references to objects not in dump are left out
+            uint32_t to = heapdump_index_find(&index,addresses,refs[j],HEAPDUMP_NONE);
+            if(to != HEAPDUMP_NONE)
+                succ[edges++] = to;
+        }
+    }
+    succ_start[n] = edges;
+    free(index.slots);
+    free(addresses);
+    for(uint64_t e = 0; e < edges; ++e)
+        in[succ[e]] += 1;
+    uint64_t* pred_start = (uint64_t*)heapdump_alloc(n+1,sizeof(uint64_t));
+    uint32_t* pred = (uint32_t*)heapdump_alloc(edges,sizeof(uint32_t));
+    for(uint32_t i = 0; i < n; ++i)
+        pred_start[i+1] = pred_start[i] + in[i];
+    memset(in,0,n*sizeof(uint32_t));
+    for(uint32_t i = 0; i < n; ++i){
+        for(uint64_t e = succ_start[i]; e < succ_start[i+1]; ++e)
+            pred[pred_start[succ[e]] + in[succ[e]]++] = i;
+    }
+    free(in);
+
+    // depth first numbering from virtual root
+    uint32_t* num = (uint32_t*)heapdump_alloc(n,sizeof(uint32_t));
+    uint32_t* order = (uint32_t*)heapdump_alloc(n,sizeof(uint32_t));
+    uint32_t* parent = (uint32_t*)heapdump_alloc(n,sizeof(uint32_t));
+    uint32_t* stack = (uint32_t*)heapdump_alloc(n,sizeof(uint32_t));
+    uint64_t* cursor = (uint64_t*)heapdump_alloc(n,sizeof(uint64_t));
+    memset(num,0xFF,n*sizeof(uint32_t));
+    uint32_t reachable = 1, depth = 1;
+    num[0] = order[0] = stack[0] = 0;
+    cursor[0] = succ_start[0];
+    while(depth > 0){
+        uint32_t v = stack[depth-1];
+        if(cursor[v] == succ_start[v+1]){
+            depth -= 1;
+            continue;
+        }
+        uint32_t w = succ[cursor[v]++];
+        if(num[w] != HEAPDUMP_NONE)
+            continue;
+        num[w] = reachable;
+        order[reachable] = w;
+        parent[reachable++] = num[v];
+        cursor[w] = succ_start[w];
+        stack[depth++] = w;
+    }
+    free(cursor);
+    free(succ_start);
+    free(succ);
+
+    // semidominators are computed in reverse depth first order, forest of processed nodes is path compressed
+    uint32_t* semi = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    uint32_t* ancestor = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    uint32_t* best = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    uint32_t* samedom = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    uint32_t* bucket = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    uint32_t* bucket_next = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    uint32_t* idom = (uint32_t*)heapdump_alloc(reachable,sizeof(uint32_t));
+    for(uint32_t i = 0; i < reachable; ++i){
+        semi[i] = best[i] = i;
+        ancestor[i] = samedom[i] = bucket[i] = HEAPDUMP_NONE;
+    }
+    for(uint32_t i = reachable-1; i > 0; --i){
+        uint32_t p = parent[i], s = p;
+        uint32_t v = order[i];
+        for(uint64_t e = pred_start[v]; e < pred_start[v+1]; ++e){
+            uint32_t u = num[pred[e]];
+            if(u == HEAPDUMP_NONE)
+                continue;
+            if(u > i){
+                // node with lowest semidominator on path to it's processed ancestor, path is compressed meanwhile
+                uint32_t x = u, sp = 0;
+                while(ancestor[ancestor[x]] != HEAPDUMP_NONE){
+                    stack[sp++] = x;
+                    x = ancestor[x];
+                }
+                while(sp > 0){
+                    x = stack[--sp];
+                    uint32_t a = ancestor[x];
+                    if(semi[best[a]] < semi[best[x]])
+                        best[x] = best[a];
+                    ancestor[x] = ancestor[a];
+                }
+                u = semi[best[u]];
+            }
+            s = u < s ? u : s;
+        }
+        semi[i] = s;
+        bucket_next[i] = bucket[s];
+        bucket[s] = i;
+        ancestor[i] = p;
+        for(uint32_t w = bucket[p]; w != HEAPDUMP_NONE; w = bucket_next[w]){
+            uint32_t x = w, sp = 0;
+            while(ancestor[ancestor[x]] != HEAPDUMP_NONE){
+                stack[sp++] = x;
+                x = ancestor[x];
+            }
+            while(sp > 0){
+                x = stack[--sp];
+                uint32_t a = ancestor[x];
+                if(semi[best[a]] < semi[best[x]])
+                    best[x] = best[a];
+                ancestor[x] = ancestor[a];
+            }
+            uint32_t y = best[w];
+            if(semi[y] == semi[w])
+                idom[w] = p;
+            else
+                samedom[w] = y;
+        }
+        bucket[p] = HEAPDUMP_NONE;
+    }
+    idom[0] = HEAPDUMP_NONE;
+    for(uint32_t i = 1; i < reachable; ++i){
+        if(samedom[i] != HEAPDUMP_NONE)
+            idom[i] = idom[samedom[i]];
+    }
+    free(semi);
+    free(ancestor);
+    free(best);
+    free(samedom);
+    free(bucket);
+    free(bucket_next);
+    free(parent);
+    free(pred_start);
+    free(pred);
+    free(stack);
+
+    // unreachable objects follow reachable ones
+    uint32_t next = reachable;
+    for(uint32_t i = 1; i < n; ++i){
+        if(num[i] == HEAPDUMP_NONE)
+            order[next++] = i;
+    }
+    const gc_dump_object** objects = (const gc_dump_object**)heapdump_alloc(n,sizeof(gc_dump_object*));
+    for(uint32_t i = 0; i < n; ++i)
+        objects[i] = d->objects[order[i]];
+    free(d->objects);
+    free(order);
+    free(num);
+    d->objects = objects;
+    d->reachable = reachable;
+    d->idom = idom;
+}
+
+// sum retained sizes up dominator tree and build it's child lists
+static void heapdump_retained(heapdump* d){
+    d->retained = (uint64_t*)heapdump_alloc(d->reachable,sizeof(uint64_t));
+    d->child_start = (uint64_t*)heapdump_alloc(d->reachable+1,sizeof(uint64_t));
+    d->child = (uint32_t*)heapdump_alloc(d->reachable,sizeof(uint32_t));
+    for(uint32_t i = 1; i < d->reachable; ++i)
+        d->retained[i] = d->objects[i]->size;
+    for(uint32_t i = d->reachable-1; i > 0; --i){
+        d->retained[d->idom[i]] += d->retained[i];
+        d->child_start[d->idom[i]+1] += 1;
+    }
+    for(uint32_t i = 0; i < d->reachable; ++i)
+        d->child_start[i+1] += d->child_start[i];
+    uint64_t* fill = (uint64_t*)heapdump_alloc(d->reachable,sizeof(uint64_t));
+    memcpy(fill,d->child_start,d->reachable*sizeof(uint64_t));
+    for(uint32_t i = 1; i < d->reachable; ++i)
+        d->child[fill[d->idom[i]]++] = i;
+    free(fill);
+}
+
+// group objects by class, objects of class not dominated by other objects of it retain what whole class does
+static void heapdump_classes(heapdump* d){
+    uint32_t size = 64;
+    d->class_address = (uint64_t*)heapdump_alloc(size,sizeof(uint64_t));
+    d->class_of = (uint32_t*)heapdump_alloc(d->count,sizeof(uint32_t));
+    heapdump_index index;
+    heapdump_index_init(&index,size);
+    for(uint32_t i = 1; i < d->count; ++i){
+        uint64_t address = d->objects[i]->class;
+        d->class_of[i] = heapdump_index_find(&index,d->class_address,address,d->classes_count);
+        if(d->class_of[i] != d->classes_count)
+            continue;
+        d->class_address[d->classes_count++] = address;
+        if(d->classes_count*2 < size)
+            continue;
+        // grow and rebuild index
+        size *= 2;
+        d->class_address = (uint64_t*)realloc(d->class_address,size*sizeof(uint64_t));
+        if(d->class_address == NULL){
+            fprintf(stderr,"out of memory\n");
+            exit(1);
+        }
+        free(index.slots);
+        heapdump_index_init(&index,size);
+        for(uint32_t c = 0; c < d->classes_count; ++c)
+            heapdump_index_find(&index,d->class_address,d->class_address[c],c);
+    }
+    free(index.slots);
+    d->class_objects = (uint64_t*)heapdump_alloc(d->classes_count,sizeof(uint64_t));
+    d->class_bytes = (uint64_t*)heapdump_alloc(d->classes_count,sizeof(uint64_t));
+    d->class_retained = (uint64_t*)heapdump_alloc(d->classes_count,sizeof(uint64_t));
+    for(uint32_t i = 1; i < d->count; ++i){
+        d->class_objects[d->class_of[i]] += 1;
+        d->class_bytes[d->class_of[i]] += d->objects[i]->size;
+    }
+    // walk dominator tree counting objects of each class on path from root
+    uint32_t* on_path = (uint32_t*)heapdump_alloc(d->classes_count,sizeof(uint32_t));
+    uint32_t* stack = (uint32_t*)heapdump_alloc(d->reachable,sizeof(uint32_t));
+    uint64_t* cursor = (uint64_t*)heapdump_alloc(d->reachable,sizeof(uint64_t));
+    uint32_t depth = 1;
+    stack[0] = 0;
+    cursor[0] = d->child_start[0];
+    while(depth > 0){
+        uint32_t v = stack[depth-1];
+        if(cursor[v] == d->child_start[v+1]){
+            if(v != 0)
+                on_path[d->class_of[v]] -= 1;
+            depth -= 1;
+            continue;
+        }
+        uint32_t w = d->child[cursor[v]++];
+        if(on_path[d->class_of[w]]++ == 0)
+            d->class_retained[d->class_of[w]] += d->retained[w];
+        cursor[w] = d->child_start[w];
+        stack[depth++] = w;
+    }
+    free(on_path);
+    free(stack);
+    free(cursor);
+}
+
+// print sizes as exact byte counts
+static bool heapdump_exact = false;
+
+// format byte count
+static const char* heapdump_bytes(char* buf, uint64_t bytes){
+    const char* units = "KMGTP";
+    if(bytes < 1024 || heapdump_exact){
+        sprintf(buf,"%" PRIu64 "B",bytes);
+        return buf;
+    }
+    double value = bytes/1024.0;
+    for(; value >= 1024 && units[1] != 0; ++units)
+        value /= 1024;
+    sprintf(buf,"%.1f%c",value,*units);
+    return buf;
+}
+
+// select up to k items with largest values, largest first, returns number selected
+// items null selects from indexes 0 to count
+static uint32_t heapdump_top(const uint64_t* values, const uint32_t* items, uint64_t count, uint32_t k, uint32_t* top){
+    uint32_t selected = 0;
+    for(uint64_t i = 0; i < count; ++i){
+        uint32_t item = items != NULL ? items[i] : (uint32_t)i;
+        if(selected == k && values[item] <= values[top[k-1]])
+            continue;
+        uint32_t j = selected < k ? selected++ : k-1;
+        for(; j > 0 && values[top[j-1]] < values[item]; --j)
+            top[j] = top[j-1];
+        top[j] = item;
+    }
+    return selected;
+}
+
+// print dominator tree of node down to depth, with largest children first
+static void heapdump_print_tree(heapdump* d, uint32_t v, uint32_t level, uint32_t depth, uint32_t children){
+    char retained[24], shallow[24];
+    const gc_dump_object* o = d->objects[v];
+    printf("%*s%-8s %-8s 0x%" PRIx64 " class 0x%" PRIx64 " gen %u",level*2,"",heapdump_bytes(retained,d->retained[v]),
+           heapdump_bytes(shallow,o->size),o->address,o->class,o->gen);
+    if(o->roots > 0)
+        printf(" roots %u",o->roots);
+    if(o->flags & GC_DUMP_WEAK)
+        printf(" weak");
+    if(o->flags & GC_DUMP_WEAK_TABLE)
+        printf(" weak table");
+    printf("\n");
+    uint64_t count = d->child_start[v+1] - d->child_start[v];
+    if(count == 0 || level+1 >= depth)
+        return;
+    uint32_t* top = (uint32_t*)heapdump_alloc(children,sizeof(uint32_t));
+    uint32_t selected = heapdump_top(d->retained,d->child+d->child_start[v],count,children,top);
+    uint64_t rest = d->retained[v] - o->size;
+    for(uint32_t i = 0; i < selected; ++i){
+        heapdump_print_tree(d,top[i],level+1,depth,children);
+        rest -= d->retained[top[i]];
+    }
+    if(count > selected)
+        printf("%*s%-8s %" PRIu64 " more objects\n",(level+1)*2,"",heapdump_bytes(retained,rest),count-selected);
+    free(top);
+}
+
+// print report
+static void heapdump_report(heapdump* d, uint32_t count, uint32_t depth, uint32_t children){
+    char b1[24], b2[24], b3[24];
+    uint64_t bytes = 0, roots = 0, unreachable = 0;
+    uint64_t gen_objects[GC_STATS_GENS], gen_bytes[GC_STATS_GENS];
+    memset(gen_objects,0,sizeof(gen_objects));
+    memset(gen_bytes,0,sizeof(gen_bytes));
+    for(uint32_t i = 1; i < d->count; ++i){
+        const gc_dump_object* o = d->objects[i];
+        bytes += o->size;
+        roots += o->roots > 0 ? 1 : 0;
+        unreachable += i >= d->reachable ? o->size : 0;
+        gen_objects[o->gen % GC_STATS_GENS] += 1;
+        gen_bytes[o->gen % GC_STATS_GENS] += o->size;
+    }
+    time_t taken = (time_t)(d->header->time / 1000000000ull);
+    char date[64];
+    strftime(date,sizeof(date),"%Y-%m-%d %H:%M:%S",localtime(&taken));
+    printf("heap dump taken %s\n",date);
+    printf("objects %" PRIu32 " %s, roots %" PRIu64 "\n",d->count-1,heapdump_bytes(b1,bytes),roots);
+    printf("reachable from roots %" PRIu32 " %s, unreachable %" PRIu32 " %s\n",d->reachable-1,heapdump_bytes(b2,d->retained[0]),
+           d->count-d->reachable,heapdump_bytes(b3,unreachable));
+    for(uint32_t g = 0; g < d->header->gens_count && g < GC_STATS_GENS; ++g)
+        printf("generation %u: objects %" PRIu64 " %s\n",g,gen_objects[g],heapdump_bytes(b1,gen_bytes[g]));
+
+    printf("\nclasses by retained size\n");
+    printf("%-10s %-10s %-12s %s\n","retained","shallow","objects","class");
+    uint32_t* top = (uint32_t*)heapdump_alloc(count,sizeof(uint32_t));
+    uint32_t selected = heapdump_top(d->class_retained,NULL,d->classes_count,count,top);
+    for(uint32_t i = 0; i < selected; ++i){
+        uint32_t c = top[i];
+        printf("%-10s %-10s %-12" PRIu64 " 0x%" PRIx64 "\n",heapdump_bytes(b1,d->class_retained[c]),
+               heapdump_bytes(b2,d->class_bytes[c]),d->class_objects[c],d->class_address[c]);
+    }
+
+    printf("\nlargest dominator trees\n");
+    printf("%-8s %-8s %s\n","retained","shallow","object");
+    uint64_t roots_count = d->child_start[1] - d->child_start[0];
+    selected = heapdump_top(d->retained,d->child+d->child_start[0],roots_count,count,top);
+    for(uint32_t i = 0; i < selected; ++i)
+        heapdump_print_tree(d,top[i],0,depth,children);
+    free(top);
+}
+
+// release loaded dump
+static void heapdump_free(heapdump* d){
+    free(d->objects);
+    free(d->idom);
+    free(d->retained);
+    free(d->child_start);
+    free(d->child);
+    free(d->class_of);
+    free(d->class_address);
+    free(d->class_objects);
+    free(d->class_bytes);
+    free(d->class_retained);
+    munmap((void*)d->data,d->size);
+}
+
+static void heapdump_usage(const char* name){
+    fprintf(stderr,"usage: %s [-n count] [-d depth] [-c children] [-b] dump\n"
+                   "  -n  number of classes and dominator trees listed, default %d\n"
+                   "  -d  depth dominator trees are listed to, default %d\n"
+                   "  -c  number of children listed per object, default %d\n"
+                   "  -b  print sizes in bytes\n",name,HEAPDUMP_TOP,HEAPDUMP_DEPTH,HEAPDUMP_CHILDREN);
+}
+
+int main(int argc, char** argv){
+    uint32_t count = HEAPDUMP_TOP, depth = HEAPDUMP_DEPTH, children = HEAPDUMP_CHILDREN;
+    int opt;
+    while((opt = getopt(argc,argv,"n:d:c:b")) != -1){
+        switch(opt){
+            case 'n':
+                count = (uint32_t)atoi(optarg);
+                break;
+            case 'd':
+                depth = (uint32_t)atoi(optarg);
+                break;
+            case 'c':
+                children = (uint32_t)atoi(optarg);
+                break;
+            case 'b':
+                heapdump_exact = true;
+                break;
+            default:
+                heapdump_usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind != argc-1 || count == 0 || depth == 0 || children == 0){
+        heapdump_usage(argv[0]);
+        return 1;
+    }
+    heapdump d;
+    memset(&d,0,sizeof(d));
+    if(!heapdump_map(&d,argv[optind]))
+        return 1;
+    heapdump_dominators(&d);
+    heapdump_retained(&d);
+    heapdump_classes(&d);
+    heapdump_report(&d,count,depth,children);
+    heapdump_free(&d);
+    return 0;
+}